@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CUTILS_ATOMIC_BUILTIN_H
+#define ANDROID_CUTILS_ATOMIC_BUILTIN_H
+
+/*
+ * The android_atomic_* operations implemented with the compiler's __atomic
+ * builtins rather than per-architecture assembly.  atomic-inline.h uses this
+ * instead of atomic-arm.h, atomic-mips.h or atomic-x86.h when the build
+ * defines ANDROID_ATOMIC_USE_BUILTINS to 1.  Needs GCC 4.7 or later.
+ *
+ * Each operation keeps the barriers its callers rely on today, which is
+ * sometimes more than its name says:
+ *   - android_atomic_release_load() is a full barrier followed by the load,
+ *     and android_atomic_acquire_store() the store followed by a full
+ *     barrier.  Store-then-load handshakes such as QueueWaitList's depend on
+ *     that.
+ *   - The acquire and release compare-and-set operations are SEQ_CST: both
+ *     arch versions order the store against later loads, and the same
+ *     handshakes depend on it.  On x86 this is the same lock cmpxchg.
+ *   - The arithmetic operations are RELEASE, as documented in atomic.h and
+ *     as the ARM version implements them.
+ * Code that wants less should use atomic-explicit.h.
+ */
+
+#include <stdint.h>
+
+#ifndef ANDROID_ATOMIC_INLINE
+#define ANDROID_ATOMIC_INLINE inline __attribute__((always_inline))
+#endif
+
+extern ANDROID_ATOMIC_INLINE void android_compiler_barrier(void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+#if ANDROID_SMP == 0
+extern ANDROID_ATOMIC_INLINE void android_memory_barrier(void)
+{
+    android_compiler_barrier();
+}
+extern ANDROID_ATOMIC_INLINE void android_memory_store_barrier(void)
+{
+    android_compiler_barrier();
+}
+#else
+extern ANDROID_ATOMIC_INLINE void android_memory_barrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+extern ANDROID_ATOMIC_INLINE void android_memory_store_barrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+#endif
+
+extern ANDROID_ATOMIC_INLINE int32_t
+android_atomic_acquire_load(volatile const int32_t *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+extern ANDROID_ATOMIC_INLINE int32_t
+android_atomic_release_load(volatile const int32_t *ptr)
+{
+    android_memory_barrier();
+    return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+extern ANDROID_ATOMIC_INLINE void
+android_atomic_acquire_store(int32_t value, volatile int32_t *ptr)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELAXED);
+    android_memory_barrier();
+}
+
+extern ANDROID_ATOMIC_INLINE void
+android_atomic_release_store(int32_t value, volatile int32_t *ptr)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+extern ANDROID_ATOMIC_INLINE int
+android_atomic_cas(int32_t old_value, int32_t new_value, volatile int32_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+extern ANDROID_ATOMIC_INLINE int
+android_atomic_acquire_cas(int32_t old_value,
+                           int32_t new_value,
+                           volatile int32_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+extern ANDROID_ATOMIC_INLINE int
+android_atomic_release_cas(int32_t old_value,
+                           int32_t new_value,
+                           volatile int32_t *ptr)
+{
+    return !__atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+extern ANDROID_ATOMIC_INLINE int32_t
+android_atomic_add(int32_t increment, volatile int32_t *ptr)
+{
+    return __atomic_fetch_add(ptr, increment, __ATOMIC_RELEASE);
+}
+
+extern ANDROID_ATOMIC_INLINE int32_t
+android_atomic_inc(volatile int32_t *addr)
+{
+    return android_atomic_add(1, addr);
+}
+
+extern ANDROID_ATOMIC_INLINE int32_t
+android_atomic_dec(volatile int32_t *addr)
+{
+    return android_atomic_add(-1, addr);
+}
+
+extern ANDROID_ATOMIC_INLINE int32_t
+android_atomic_and(int32_t value, volatile int32_t *ptr)
+{
+    return __atomic_fetch_and(ptr, value, __ATOMIC_RELEASE);
+}
+
+extern ANDROID_ATOMIC_INLINE int32_t
+android_atomic_or(int32_t value, volatile int32_t *ptr)
+{
+    return __atomic_fetch_or(ptr, value, __ATOMIC_RELEASE);
+}
+
+#endif /* ANDROID_CUTILS_ATOMIC_BUILTIN_H */
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CUTILS_ATOMIC_EXPLICIT_H
+#define ANDROID_CUTILS_ATOMIC_EXPLICIT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Atomic operations with an explicit memory order, for hot paths that do not
+ * need the barriers of the android_atomic_* functions in atomic.h.  They are
+ * always inlined, and take one of the orders below, with the meaning of the
+ * C11 memory_order of the same name:
+ *
+ *   RELAXED  the operation is atomic, but orders no other memory access
+ *   ACQUIRE  no later access moves above the load
+ *   RELEASE  no earlier access moves below the store
+ *   ACQ_REL  both, for read-modify-write operations
+ *   SEQ_CST  a full barrier on both sides
+ *
+ * Loads take RELAXED, ACQUIRE or SEQ_CST, stores RELAXED, RELEASE or SEQ_CST.
+ * The order should be a constant, so that the compiler emits only the
+ * barrier it asks for.
+ *
+ * A typical reference count takes references with RELAXED, drops them with
+ * RELEASE, and issues an ACQUIRE fence before destroying the object once the
+ * count reaches zero.
+ *
+ * As with android_atomic_acquire_cas(), the compare-and-set operations return
+ * zero if the new value was stored.
+ *
+ * The 64-bit operations need an 8-byte aligned address and a CPU with 64-bit
+ * atomics (ldrexd/strexd on ARMv7, cmpxchg8b on x86).
+ *
+ * Compilers without the __atomic builtins (GCC before 4.7) fall back on the
+ * __sync builtins, which treat every order as SEQ_CST.
+ */
+
+#define ANDROID_ATOMIC_EXPLICIT static __inline__ __attribute__((always_inline))
+
+#if defined(__ATOMIC_RELAXED)
+
+#define ANDROID_MEMORY_ORDER_RELAXED __ATOMIC_RELAXED
+#define ANDROID_MEMORY_ORDER_ACQUIRE __ATOMIC_ACQUIRE
+#define ANDROID_MEMORY_ORDER_RELEASE __ATOMIC_RELEASE
+#define ANDROID_MEMORY_ORDER_ACQ_REL __ATOMIC_ACQ_REL
+#define ANDROID_MEMORY_ORDER_SEQ_CST __ATOMIC_SEQ_CST
+
+/* A failed compare-and-set only loads, so it cannot have release semantics. */
+#define ANDROID_ATOMIC_CAS_FAILURE_ORDER(order) \
+    ((order) == __ATOMIC_RELEASE ? __ATOMIC_RELAXED : \
+     (order) == __ATOMIC_ACQ_REL ? __ATOMIC_ACQUIRE : (order))
+
+ANDROID_ATOMIC_EXPLICIT void android_atomic_fence(int order)
+{
+    __atomic_thread_fence(order);
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_load_explicit(volatile const int32_t* addr, int order)
+{
+    return __atomic_load_n(addr, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT void
+android_atomic_store_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    __atomic_store_n(addr, value, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_add_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    return __atomic_fetch_add(addr, value, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_and_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    return __atomic_fetch_and(addr, value, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_or_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    return __atomic_fetch_or(addr, value, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT int
+android_atomic_cas_explicit(int32_t oldvalue, int32_t newvalue,
+        volatile int32_t* addr, int order)
+{
+    return !__atomic_compare_exchange_n(addr, &oldvalue, newvalue, 0, order,
+            ANDROID_ATOMIC_CAS_FAILURE_ORDER(order));
+}
+
+ANDROID_ATOMIC_EXPLICIT int64_t
+android_atomic64_load_explicit(volatile const int64_t* addr, int order)
+{
+    return __atomic_load_n(addr, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT void
+android_atomic64_store_explicit(int64_t value, volatile int64_t* addr, int order)
+{
+    __atomic_store_n(addr, value, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT int64_t
+android_atomic64_add_explicit(int64_t value, volatile int64_t* addr, int order)
+{
+    return __atomic_fetch_add(addr, value, order);
+}
+
+ANDROID_ATOMIC_EXPLICIT int
+android_atomic64_cas_explicit(int64_t oldvalue, int64_t newvalue,
+        volatile int64_t* addr, int order)
+{
+    return !__atomic_compare_exchange_n(addr, &oldvalue, newvalue, 0, order,
+            ANDROID_ATOMIC_CAS_FAILURE_ORDER(order));
+}
+
+#else /* !defined(__ATOMIC_RELAXED) */
+
+#define ANDROID_MEMORY_ORDER_RELAXED 0
+#define ANDROID_MEMORY_ORDER_ACQUIRE 2
+#define ANDROID_MEMORY_ORDER_RELEASE 3
+#define ANDROID_MEMORY_ORDER_ACQ_REL 4
+#define ANDROID_MEMORY_ORDER_SEQ_CST 5
+
+ANDROID_ATOMIC_EXPLICIT void android_atomic_fence(int order)
+{
+    __sync_synchronize();
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_load_explicit(volatile const int32_t* addr, int order)
+{
+    int32_t value;
+    __sync_synchronize();
+    value = *addr;
+    __sync_synchronize();
+    return value;
+}
+
+ANDROID_ATOMIC_EXPLICIT void
+android_atomic_store_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    __sync_synchronize();
+    *addr = value;
+    __sync_synchronize();
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_add_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    return __sync_fetch_and_add(addr, value);
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_and_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    return __sync_fetch_and_and(addr, value);
+}
+
+ANDROID_ATOMIC_EXPLICIT int32_t
+android_atomic_or_explicit(int32_t value, volatile int32_t* addr, int order)
+{
+    return __sync_fetch_and_or(addr, value);
+}
+
+ANDROID_ATOMIC_EXPLICIT int
+android_atomic_cas_explicit(int32_t oldvalue, int32_t newvalue,
+        volatile int32_t* addr, int order)
+{
+    return !__sync_bool_compare_and_swap(addr, oldvalue, newvalue);
+}
+
+/* A plain 64-bit access is not atomic on 32-bit CPUs, so these go through
+ * compare-and-swap. */
+ANDROID_ATOMIC_EXPLICIT int64_t
+android_atomic64_load_explicit(volatile const int64_t* addr, int order)
+{
+    return __sync_val_compare_and_swap((volatile int64_t*) addr, 0, 0);
+}
+
+ANDROID_ATOMIC_EXPLICIT void
+android_atomic64_store_explicit(int64_t value, volatile int64_t* addr, int order)
+{
+    int64_t old;
+    do {
+        old = *addr;
+    } while (!__sync_bool_compare_and_swap(addr, old, value));
+}
+
+ANDROID_ATOMIC_EXPLICIT int64_t
+android_atomic64_add_explicit(int64_t value, volatile int64_t* addr, int order)
+{
+    return __sync_fetch_and_add(addr, value);
+}
+
+ANDROID_ATOMIC_EXPLICIT int
+android_atomic64_cas_explicit(int64_t oldvalue, int64_t newvalue,
+        volatile int64_t* addr, int order)
+{
+    return !__sync_bool_compare_and_swap(addr, oldvalue, newvalue);
+}
+
+#endif /* defined(__ATOMIC_RELAXED) */
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ANDROID_CUTILS_ATOMIC_EXPLICIT_H
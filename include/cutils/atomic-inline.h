@@ -32,6 +32,10 @@ extern "C" {
  * Anything that does include this file must set ANDROID_SMP to either
  * 0 or 1, indicating compilation for UP or SMP, respectively.
  *
+ * Setting ANDROID_ATOMIC_USE_BUILTINS to 1 replaces the per-architecture
+ * implementations with one built on the compiler's __atomic builtins (see
+ * atomic-builtin.h).
+ *
  * Macros defined in this header:
  *
  * void ANDROID_MEMBAR_FULL(void)
@@ -43,7 +47,9 @@ extern "C" {
 # error "Must define ANDROID_SMP before including atomic-inline.h"
 #endif
 
-#if defined(__arm__)
+#if defined(ANDROID_ATOMIC_USE_BUILTINS) && ANDROID_ATOMIC_USE_BUILTINS
+#include <cutils/atomic-builtin.h>
+#elif defined(__arm__)
 #include <cutils/atomic-arm.h>
 #elif defined(__i386__) || defined(__x86_64__)
 #include <cutils/atomic-x86.h>
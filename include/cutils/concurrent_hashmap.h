@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Hash map for concurrent use.
+ *
+ * Unlike Hashmap, which callers serialize with hashmapLock(), every function
+ * here may be called from any thread without external locking.  Keys are
+ * spread over a fixed number of stripes, each an independent table with its
+ * own lock, so threads working on different stripes do not contend.
+ *
+ * A stripe that outgrows its table doubles it incrementally: each later put
+ * or remove on the stripe moves a few buckets over, so no single call pays
+ * for rehashing the whole table.  Entries come from per-stripe pools; their
+ * memory is reused for later entries and only released by
+ * concurrentHashmapFree().
+ */
+
+#ifndef __CONCURRENT_HASHMAP_H
+#define __CONCURRENT_HASHMAP_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A concurrent hash map. */
+typedef struct ConcurrentHashmap ConcurrentHashmap;
+
+/**
+ * Creates a new concurrent hash map. Returns NULL if memory allocation
+ * fails. The hash and equals functions are the same as for hashmapCreate()
+ * and are called with a stripe lock held.
+ *
+ * @param initialCapacity number of expected entries
+ * @param hash function which hashes keys
+ * @param equals function which compares keys for equality
+ */
+ConcurrentHashmap* concurrentHashmapCreate(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
+
+/**
+ * Frees the hash map. Does not free the keys or values themselves. No other
+ * thread may be using the map.
+ */
+void concurrentHashmapFree(ConcurrentHashmap* map);
+
+/**
+ * Puts value for the given key in the map. Returns pre-existing value if
+ * any.
+ *
+ * If memory allocation fails, this function returns NULL, the map's size
+ * does not increase, and errno is set to ENOMEM.
+ */
+void* concurrentHashmapPut(ConcurrentHashmap* map, void* key, void* value);
+
+/**
+ * Gets a value from the map. Returns NULL if no entry for the given key is
+ * found or if the value itself is NULL.
+ */
+void* concurrentHashmapGet(ConcurrentHashmap* map, void* key);
+
+/**
+ * Returns true if the map contains an entry for the given key.
+ */
+bool concurrentHashmapContainsKey(ConcurrentHashmap* map, void* key);
+
+/**
+ * Gets the value for a key. If a value is not found, this function gets a
+ * value and creates an entry using the given callback, atomically with
+ * respect to other threads memoizing the same key. The callback runs with
+ * the key's stripe locked and must not call back into the map.
+ *
+ * If memory allocation fails, the callback is not called, this function
+ * returns NULL, and errno is set to ENOMEM.
+ */
+void* concurrentHashmapMemoize(ConcurrentHashmap* map, void* key,
+        void* (*initialValue)(void* key, void* context), void* context);
+
+/**
+ * Removes an entry from the map. Returns the removed value or NULL if no
+ * entry was present.
+ */
+void* concurrentHashmapRemove(ConcurrentHashmap* map, void* key);
+
+/**
+ * Gets the number of entries in this map. Only a snapshot while other
+ * threads are modifying the map.
+ */
+size_t concurrentHashmapSize(ConcurrentHashmap* map);
+
+/**
+ * Invokes the given callback on each entry in the map. Stops iterating if
+ * the callback returns false. Stripes are visited one at a time with their
+ * lock held, so the callback must not call back into the map, and entries
+ * added or removed meanwhile by other threads may or may not be seen.
+ */
+void concurrentHashmapForEach(ConcurrentHashmap* map,
+        bool (*callback)(void* key, void* value, void* context),
+        void* context);
+
+/**
+ * For debugging.
+ */
+
+/**
+ * Gets current capacity, summed over all stripes.
+ */
+size_t concurrentHashmapCurrentCapacity(ConcurrentHashmap* map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CONCURRENT_HASHMAP_H */
@@ -50,6 +50,39 @@ int property_set(const char *key, const char *value);
     
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);    
 
+/* property_handle: a cached reference to one property, for code that polls
+** it.  The property is looked up by name once; after that, checking it costs
+** a load of its serial number, and reading it copies the cached value until
+** the serial changes.  A property that does not exist yet is looked up again
+** on each check.
+**
+** A handle is not thread-safe; threads sharing one must serialize its use.
+** The key must stay valid for the life of the handle.
+*/
+struct prop_info;
+
+struct property_handle {
+    const char *key;
+    const struct prop_info *pi;
+    unsigned serial;
+    int len;                        /* -1 until the first property_handle_get */
+    char value[PROPERTY_VALUE_MAX];
+};
+
+#define PROPERTY_HANDLE_INITIALIZER(key) { (key), NULL, 0xffffffffU, -1, "" }
+
+void property_handle_init(struct property_handle *handle, const char *key);
+
+/* property_handle_changed: returns nonzero if the value may differ from the
+** one the last property_handle_get returned, or if it was never read.
+*/
+int property_handle_changed(struct property_handle *handle);
+
+/* property_handle_get: as property_get, for the handle's key.
+*/
+int property_handle_get(struct property_handle *handle, char *value,
+                        const char *default_value);
+
 #if defined(__BIONIC_FORTIFY)
 
 extern int __property_get_real(const char *, char *, const char *)
@@ -17,8 +17,13 @@
 #ifndef __CUTILS_STR_PARMS_H
 #define __CUTILS_STR_PARMS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct str_parms;
 
 struct str_parms *str_parms_create(void);
@@ -46,4 +51,76 @@ char *str_parms_to_str(struct str_parms *str_parms);
 /* debug */
 void str_parms_dump(struct str_parms *str_parms);
 
+/*
+ * Allocation-free access to "key=value;key=value" strings, for paths that
+ * parse or build parameter strings on every call.
+ *
+ * str_parms_view_parse() splits a string into pairs the way
+ * str_parms_create_str() does, but records each key and value as a span of
+ * the original string in a caller-provided array instead of copying them.
+ * The string is not modified and must outlive the view.  Pairs keep their
+ * order; when a key appears more than once, lookups and str_parms_view_to_str()
+ * use the last value, as str_parms_create_str() keeps it.
+ */
+struct str_parms_pair {
+    const char *key;
+    size_t key_len;
+    const char *value;
+    size_t value_len;
+};
+
+struct str_parms_view {
+    struct str_parms_pair *pairs;
+    size_t count;
+};
+
+/* Returns 0, or -ENOSPC if 'str' holds more than 'capacity' pairs, in which
+ * case the view holds the first 'capacity' of them. */
+int str_parms_view_parse(struct str_parms_view *view,
+                         struct str_parms_pair *pairs, size_t capacity,
+                         const char *str);
+
+/* Returns the last pair for 'key', or NULL. */
+const struct str_parms_pair *str_parms_view_find(
+        const struct str_parms_view *view, const char *key);
+
+/* Same results as the str_parms_get_* functions. */
+int str_parms_view_get_str(const struct str_parms_view *view, const char *key,
+                           char *out_val, int len);
+int str_parms_view_get_int(const struct str_parms_view *view, const char *key,
+                           int *out_val);
+int str_parms_view_get_float(const struct str_parms_view *view,
+                             const char *key, float *out_val);
+
+/* Writes the view back out as "key=value;..." with one pair per key.
+ * Returns the length written, or -ENOSPC if it does not fit in 'size' bytes
+ * including the terminating NUL; 'buf' then holds an empty string. */
+int str_parms_view_to_str(const struct str_parms_view *view, char *buf,
+                          size_t size);
+
+/*
+ * Builds a "key=value;key=value" string in a caller-provided buffer, in a
+ * single pass.  Keys are not checked for duplicates.  An add that does not
+ * fit returns -ENOSPC and leaves the string as it was; the buffer always
+ * holds a NUL-terminated string of 'len' bytes.
+ */
+struct str_parms_writer {
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+void str_parms_writer_init(struct str_parms_writer *writer, char *buf,
+                           size_t size);
+int str_parms_writer_add_str(struct str_parms_writer *writer, const char *key,
+                             const char *value);
+int str_parms_writer_add_int(struct str_parms_writer *writer, const char *key,
+                             int value);
+int str_parms_writer_add_float(struct str_parms_writer *writer,
+                               const char *key, float value);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __CUTILS_STR_PARMS_H */
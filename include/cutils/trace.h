@@ -29,6 +29,7 @@
 #else
 #include <cutils/atomic.h>
 #endif
+#include <cutils/atomic-explicit.h>
 
 __BEGIN_DECLS
 
@@ -144,7 +145,8 @@ extern int atrace_marker_fd;
 #define ATRACE_INIT() atrace_init()
 static inline void atrace_init()
 {
-    if (CC_UNLIKELY(!android_atomic_acquire_load(&atrace_is_ready))) {
+    if (CC_UNLIKELY(!android_atomic_load_explicit(&atrace_is_ready,
+            ANDROID_MEMORY_ORDER_ACQUIRE))) {
         atrace_setup();
     }
 }
@@ -38,6 +38,16 @@ EventTagMap* android_openEventTagMap(const char* fileName);
  */
 void android_closeEventTagMap(EventTagMap* map);
 
+/*
+ * Parse the specified map file and write a precompiled index of it to
+ * indexName, which android_openEventTagMap() uses when it is named
+ * "<fileName>.idx" and matches the map file's contents.  This is run at
+ * build time; android_openEventTagMap() never writes an index.
+ *
+ * Returns 0 on success.
+ */
+int android_writeEventTagIndex(const char* fileName, const char* indexName);
+
 /*
  * Look up a tag by index.  Returns the tag string, or NULL if not found.
  */
@@ -583,6 +583,33 @@ typedef enum {
 int __android_log_buf_write(int bufID, int prio, const char *tag, const char *text);
 int __android_log_buf_print(int bufID, int prio, const char *tag, const char *fmt, ...);
 
+/*
+ * Opt-in batched logging for hot native threads.
+ *
+ * Between __android_log_batch_begin() and __android_log_batch_end(), records
+ * logged by the calling thread are queued in a per-thread buffer rather than
+ * written to the driver right away.  A shared writer thread hands them to
+ * the driver, still one record per write, once the buffer fills up or the
+ * oldest record is flushIntervalMs old.  A record at or above flushPrio
+ * drains the queue and is written synchronously by the calling thread.
+ * Records from one thread always reach the driver in order.
+ *
+ * This is not coalescing: the driver takes one record per write, so the
+ * number of writes is unchanged; they only move off the calling thread.
+ * The driver stamps each record with the pid, tid and time of the write,
+ * so queued records show the flush time and the tid of whichever thread
+ * flushed them, usually the writer thread.  In logcat they lose their
+ * per-thread attribution, and they are not ordered against records from
+ * threads that are not batching: a queued record can appear after records
+ * that were logged later.  Only batch threads whose logs are read on their
+ * own, and never where timing or tids in the log matter.
+ *
+ * Returns 0 on success, or a negative errno.
+ */
+int __android_log_batch_begin(int flushPrio, int flushIntervalMs);
+int __android_log_batch_flush(void);
+int __android_log_batch_end(void);
+
 
 #ifdef __cplusplus
 }
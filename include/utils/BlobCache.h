@@ -20,9 +20,10 @@
 #include <stddef.h>
 
 #include <utils/Flattenable.h>
+#include <utils/LruCache.h>
 #include <utils/RefBase.h>
-#include <utils/SortedVector.h>
 #include <utils/threads.h>
+#include <utils/TypeHelpers.h>
 
 namespace android {
 
@@ -33,6 +34,10 @@ namespace android {
 // and then reloaded in a subsequent execution of the program.  This
 // serialization is non-portable and the data should only be used by the device
 // that generated it.
+//
+// Entries are kept in a hash table in least-recently-used order.  When a new
+// entry does not fit, the least recently used entries are evicted one at a
+// time until it does.
 class BlobCache : public RefBase {
 
 public:
@@ -51,7 +56,8 @@ public:
     // put in the cache (based on the maxKeySize, maxValueSize, and maxTotalSize
     // values specified to the BlobCache constructor), then the key/value pair
     // will be in the cache after set returns.  Note, however, that a subsequent
-    // call to set may evict old key/value pairs from the cache.
+    // call to set may evict the least recently used key/value pairs from the
+    // cache.
     //
     // Preconditions:
     //   key != NULL
@@ -67,7 +73,8 @@ public:
     // is non-NULL and the size of the cached value is less than valueSize bytes
     // then the cached value is copied into the buffer pointed to by the value
     // argument.  If the key is not present in the cache then 0 is returned and
-    // the buffer pointed to by the value argument is not modified.
+    // the buffer pointed to by the value argument is not modified.  A
+    // successful lookup marks the entry as the most recently used.
     //
     // Note that when calling get multiple times with the same key, the later
     // calls may fail, returning 0, even if earlier calls succeeded.  The return
@@ -106,25 +113,12 @@ private:
     BlobCache(const BlobCache&);
     void operator=(const BlobCache&);
 
-    // A random function helper to get around MinGW not having nrand48()
-    long int blob_random();
-
-    // clean evicts a randomly chosen set of entries from the cache such that
-    // the total size of all remaining entries is less than mMaxTotalSize/2.
-    void clean();
-
-    // isCleanable returns true if the cache is full enough for the clean method
-    // to have some effect, and false otherwise.
-    bool isCleanable() const;
-
     // A Blob is an immutable sized unstructured data blob.
     class Blob : public RefBase {
     public:
         Blob(const void* data, size_t size, bool copyData);
         ~Blob();
 
-        bool operator<(const Blob& rhs) const;
-
         const void* getData() const;
         size_t getSize() const;
 
@@ -144,28 +138,39 @@ private:
         bool mOwnsData;
     };
 
-    // A CacheEntry is a single key/value pair in the cache.
-    class CacheEntry {
+    // A Key identifies a cache entry.  Keys stored in the cache hold a
+    // reference to a Blob with their own copy of the key data, while the keys
+    // used for lookups simply point at the caller's data, so that get does
+    // not need to allocate.
+    class Key {
     public:
-        CacheEntry();
-        CacheEntry(const sp<Blob>& key, const sp<Blob>& value);
-        CacheEntry(const CacheEntry& ce);
+        Key(const void* data, size_t size);
+        explicit Key(const sp<Blob>& blob);
 
-        bool operator<(const CacheEntry& rhs) const;
-        const CacheEntry& operator=(const CacheEntry&);
+        bool operator==(const Key& rhs) const;
 
-        sp<Blob> getKey() const;
-        sp<Blob> getValue() const;
+        const void* getData() const { return mData; }
+        size_t getSize() const { return mSize; }
 
-        void setValue(const sp<Blob>& value);
+        friend inline hash_t hash_type(const Key& key) { return key.mHash; }
 
     private:
+        // mBlob owns the key data, or is NULL for lookup keys.
+        sp<Blob> mBlob;
 
-        // mKey is the key that identifies the cache entry.
-        sp<Blob> mKey;
+        // mData and mSize describe the key data.
+        const void* mData;
+        size_t mSize;
 
-        // mValue is the cached data associated with the key.
-        sp<Blob> mValue;
+        // mHash is the hash of the key data, computed once up front.
+        hash_t mHash;
+    };
+
+    // A Sizer charges each cache entry the combined size of its key and
+    // value against mMaxTotalSize.
+    class Sizer : public EntrySizer<Key, sp<Blob> > {
+    public:
+        virtual size_t operator()(const Key& key, const sp<Blob>& value);
     };
 
     // A Header is the header for the entire BlobCache serialization format. No
@@ -225,17 +230,14 @@ private:
     // will be evicted from the cache to make room for the new entry.
     const size_t mMaxTotalSize;
 
-    // mTotalSize is the total combined size of all keys and values currently in
-    // the cache.
-    size_t mTotalSize;
-
-    // mRandState is the pseudo-random number generator state. It is passed to
-    // nrand48 to generate random numbers when needed.
-    unsigned short mRandState[3];
+    // mSizer is the entry sizer registered with mCacheEntries.
+    Sizer mSizer;
 
-    // mCacheEntries stores all the cache entries that are resident in memory.
-    // Cache entries are added to it by the 'set' method.
-    SortedVector<CacheEntry> mCacheEntries;
+    // mCacheEntries maps each key to its value blob and keeps the entries in
+    // least-recently-used order, evicting the oldest ones to keep the total
+    // combined size of all keys and values within mMaxTotalSize.  Cache
+    // entries are added to it by the 'set' method.
+    LruCache<Key, sp<Blob> > mCacheEntries;
 };
 
 }
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_CONCURRENT_QUEUE_H
+#define ANDROID_UTILS_CONCURRENT_QUEUE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <cutils/atomic.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+/*
+ * Bounded lock-free queues for handing items between threads.
+ *
+ * SpscQueue allows one producer and one consumer thread, MpscQueue allows any
+ * number of producers and one consumer.  Both hold at most 'capacity' items,
+ * rounded up to a power of two.  TYPE must be default-constructible and
+ * assignable; a popped slot is reset to TYPE() so that the queue does not keep
+ * references (e.g. sp<>) alive.
+ *
+ * tryPush()/tryPop() never block and fail when the queue is full/empty.
+ * push()/pop() block until they succeed.  Blocking only touches the mutex
+ * when a thread actually has to sleep; the fast paths are a few atomic
+ * loads and stores.
+ */
+
+/*
+ * Sleep/wakeup support shared by the queues.  A thread that is about to sleep
+ * announces itself in 'waiters' and re-checks the queue under the lock; the
+ * other side only takes the lock to signal if it sees a waiter.  Both sides
+ * need a full barrier between their store and their load, so that either the
+ * sleeper sees the new state or the other side sees the sleeper: the acquire
+ * CAS puts one after the waiter's store, the release load puts one before the
+ * notifier's load.
+ */
+class QueueWaitList {
+public:
+    QueueWaitList() : mWaiters(0) { }
+
+    template<typename Q>
+    void waitUntil(const Q* queue, bool (Q::*ready)() const) {
+        AutoMutex _l(mLock);
+        int32_t waiters;
+        do {
+            waiters = mWaiters;
+        } while (android_atomic_acquire_cas(waiters, waiters + 1, &mWaiters) != 0);
+        while (!(queue->*ready)()) {
+            mCondition.wait(mLock);
+        }
+        android_atomic_dec(&mWaiters);
+    }
+
+    void wakeAll() {
+        if (android_atomic_release_load(&mWaiters) != 0) {
+            AutoMutex _l(mLock);
+            mCondition.broadcast();
+        }
+    }
+
+    void wakeOne() {
+        if (android_atomic_release_load(&mWaiters) != 0) {
+            AutoMutex _l(mLock);
+            mCondition.signal();
+        }
+    }
+
+private:
+    QueueWaitList(const QueueWaitList&);
+    QueueWaitList& operator=(const QueueWaitList&);
+
+    Mutex mLock;
+    Condition mCondition;
+    volatile int32_t mWaiters;
+};
+
+inline uint32_t queueCapacityFor(size_t capacity) {
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+/*
+ * Queue positions count up forever and wrap, so they are kept unsigned; these
+ * only adapt them to the int32_t atomics.
+ */
+inline uint32_t queueAcquireLoad(volatile const uint32_t* addr) {
+    return uint32_t(android_atomic_acquire_load(
+            reinterpret_cast<volatile const int32_t*>(addr)));
+}
+
+inline void queueReleaseStore(uint32_t value, volatile uint32_t* addr) {
+    android_atomic_release_store(int32_t(value),
+            reinterpret_cast<volatile int32_t*>(addr));
+}
+
+inline bool queueReleaseCas(uint32_t oldValue, uint32_t newValue,
+        volatile uint32_t* addr) {
+    return android_atomic_release_cas(int32_t(oldValue), int32_t(newValue),
+            reinterpret_cast<volatile int32_t*>(addr)) == 0;
+}
+
+// ---------------------------------------------------------------------------
+
+template<typename TYPE>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity);
+    ~SpscQueue();
+
+    // Producer side.
+    bool tryPush(const TYPE& item);
+    void push(const TYPE& item);
+
+    // Consumer side.
+    bool tryPop(TYPE* outItem);
+    void pop(TYPE* outItem);
+
+    size_t capacity() const { return mMask + 1; }
+    // Only exact when called from the producer or consumer with the other idle.
+    size_t size() const { return mTail - mHead; }
+    bool isEmpty() const { return size() == 0; }
+
+private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+    bool hasItems() const;
+    bool hasSpace() const;
+
+    const uint32_t mMask;
+    TYPE* const mSlots;
+    // Written only by the consumer / producer respectively.  They count up
+    // forever and are masked on use, so full and empty are distinguishable.
+    volatile uint32_t mHead;
+    volatile uint32_t mTail;
+    QueueWaitList mNotEmpty;
+    QueueWaitList mNotFull;
+};
+
+template<typename TYPE>
+SpscQueue<TYPE>::SpscQueue(size_t capacity)
+    : mMask(queueCapacityFor(capacity) - 1), mSlots(new TYPE[mMask + 1]),
+      mHead(0), mTail(0) {
+}
+
+template<typename TYPE>
+SpscQueue<TYPE>::~SpscQueue() {
+    delete[] mSlots;
+}
+
+template<typename TYPE>
+bool SpscQueue<TYPE>::hasItems() const {
+    return queueAcquireLoad(&mTail) != mHead;
+}
+
+template<typename TYPE>
+bool SpscQueue<TYPE>::hasSpace() const {
+    return mTail - queueAcquireLoad(&mHead) <= mMask;
+}
+
+template<typename TYPE>
+bool SpscQueue<TYPE>::tryPush(const TYPE& item) {
+    uint32_t tail = mTail;
+    if (tail - queueAcquireLoad(&mHead) > mMask) {
+        return false;
+    }
+    mSlots[tail & mMask] = item;
+    queueReleaseStore(tail + 1, &mTail);
+    mNotEmpty.wakeAll();
+    return true;
+}
+
+template<typename TYPE>
+void SpscQueue<TYPE>::push(const TYPE& item) {
+    while (!tryPush(item)) {
+        mNotFull.waitUntil(this, &SpscQueue::hasSpace);
+    }
+}
+
+template<typename TYPE>
+bool SpscQueue<TYPE>::tryPop(TYPE* outItem) {
+    uint32_t head = mHead;
+    if (queueAcquireLoad(&mTail) == head) {
+        return false;
+    }
+    TYPE& slot = mSlots[head & mMask];
+    *outItem = slot;
+    slot = TYPE();
+    queueReleaseStore(head + 1, &mHead);
+    mNotFull.wakeAll();
+    return true;
+}
+
+template<typename TYPE>
+void SpscQueue<TYPE>::pop(TYPE* outItem) {
+    while (!tryPop(outItem)) {
+        mNotEmpty.waitUntil(this, &SpscQueue::hasItems);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Each slot carries a sequence number saying whose turn it is: a producer
+ * claiming position 'pos' waits for seq == pos, publishes with seq = pos + 1,
+ * and the consumer hands the slot back for the next lap with
+ * seq = pos + capacity.  Producers only contend on the CAS of mTail.
+ */
+template<typename TYPE>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity);
+    ~MpscQueue();
+
+    // Producer side, any thread.
+    bool tryPush(const TYPE& item);
+    void push(const TYPE& item);
+
+    // Consumer side, one thread at a time.
+    bool tryPop(TYPE* outItem);
+    void pop(TYPE* outItem);
+
+    size_t capacity() const { return mMask + 1; }
+    // Approximate while producers are running.
+    size_t size() const {
+        uint32_t size = mTail - mHead;
+        return size > mMask + 1 ? mMask + 1 : size;
+    }
+    bool isEmpty() const { return !hasItems(); }
+
+private:
+    MpscQueue(const MpscQueue&);
+    MpscQueue& operator=(const MpscQueue&);
+
+    struct Slot {
+        volatile uint32_t seq;
+        TYPE item;
+    };
+
+    bool hasItems() const;
+    bool hasSpace() const;
+
+    const uint32_t mMask;
+    Slot* const mSlots;
+    volatile uint32_t mHead; // written only by the consumer
+    volatile uint32_t mTail; // next position to claim, CAS'ed by producers
+    QueueWaitList mNotEmpty;
+    QueueWaitList mNotFull;
+};
+
+template<typename TYPE>
+MpscQueue<TYPE>::MpscQueue(size_t capacity)
+    : mMask(queueCapacityFor(capacity) - 1), mSlots(new Slot[mMask + 1]),
+      mHead(0), mTail(0) {
+    for (uint32_t i = 0; i <= mMask; i++) {
+        mSlots[i].seq = i;
+    }
+}
+
+template<typename TYPE>
+MpscQueue<TYPE>::~MpscQueue() {
+    delete[] mSlots;
+}
+
+template<typename TYPE>
+bool MpscQueue<TYPE>::hasItems() const {
+    uint32_t head = mHead;
+    return queueAcquireLoad(&mSlots[head & mMask].seq) == head + 1;
+}
+
+template<typename TYPE>
+bool MpscQueue<TYPE>::hasSpace() const {
+    uint32_t tail = mTail;
+    // The slot is free once its sequence has caught up with 'tail'.
+    return int32_t(queueAcquireLoad(&mSlots[tail & mMask].seq) - tail) >= 0;
+}
+
+template<typename TYPE>
+bool MpscQueue<TYPE>::tryPush(const TYPE& item) {
+    uint32_t pos = mTail;
+    Slot* slot;
+    for (;;) {
+        slot = &mSlots[pos & mMask];
+        int32_t diff = int32_t(queueAcquireLoad(&slot->seq) - pos);
+        if (diff == 0) {
+            if (queueReleaseCas(pos, pos + 1, &mTail)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The consumer hasn't freed this slot from the previous lap.
+            return false;
+        }
+        pos = mTail;
+    }
+    slot->item = item;
+    queueReleaseStore(pos + 1, &slot->seq);
+    mNotEmpty.wakeAll();
+    return true;
+}
+
+template<typename TYPE>
+void MpscQueue<TYPE>::push(const TYPE& item) {
+    while (!tryPush(item)) {
+        mNotFull.waitUntil(this, &MpscQueue::hasSpace);
+    }
+}
+
+template<typename TYPE>
+bool MpscQueue<TYPE>::tryPop(TYPE* outItem) {
+    uint32_t head = mHead;
+    Slot& slot = mSlots[head & mMask];
+    if (queueAcquireLoad(&slot.seq) != head + 1) {
+        return false;
+    }
+    *outItem = slot.item;
+    slot.item = TYPE();
+    mHead = head + 1;
+    queueReleaseStore(head + mMask + 1, &slot.seq);
+    mNotFull.wakeAll();
+    return true;
+}
+
+template<typename TYPE>
+void MpscQueue<TYPE>::pop(TYPE* outItem) {
+    while (!tryPop(outItem)) {
+        mNotEmpty.waitUntil(this, &MpscQueue::hasItems);
+    }
+}
+
+}; // namespace android
+
+#endif // ANDROID_UTILS_CONCURRENT_QUEUE_H
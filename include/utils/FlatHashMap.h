@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FLAT_HASH_MAP_H
+#define ANDROID_FLAT_HASH_MAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/JenkinsHash.h>
+#include <utils/Log.h>
+#include <utils/TypeHelpers.h>
+
+namespace android {
+
+/*
+ * A hash map that stores its entries in place in a single array, for tables
+ * too large for KeyedVector's O(n) inserts and removals.
+ *
+ * Collisions are resolved by linear probing with Robin Hood ordering: an
+ * insert that has probed further than the entry it meets takes its slot and
+ * carries the displaced entry on.  This keeps probe sequences short and
+ * lets lookups of absent keys stop early.  Removal shifts the following run
+ * back by one slot, so there are no tombstones.  Each slot keeps the full
+ * hash code next to the entry, so probing rarely compares keys and a lookup
+ * usually touches a single cache line.
+ *
+ * Keys are hashed with hash_type() and then mixed with JenkinsHash, so
+ * hash_type() only needs to be unique, not well distributed.  TKey must
+ * provide operator==.
+ *
+ * The API follows KeyedVector, but an index is a slot number: it stays
+ * valid until the next add() or removeItem(), which may move entries.
+ * Iterate with next().  Unlike KeyedVector the storage is not shared
+ * copy-on-write; copying a FlatHashMap copies its entries.
+ */
+template <typename TKey, typename TValue>
+class FlatHashMap {
+public:
+    explicit FlatHashMap(size_t minimumCapacity = 0);
+    FlatHashMap(const FlatHashMap& other);
+    ~FlatHashMap();
+
+    FlatHashMap& operator=(const FlatHashMap& other);
+
+    inline size_t size() const { return mSize; }
+    inline bool isEmpty() const { return mSize == 0; }
+
+    /* Number of entries that fit before the table grows. */
+    inline size_t capacity() const { return maxSizeFor(mBucketCount); }
+
+    /* Grows the table so that it holds at least 'minimumCapacity' entries
+     * without rehashing.  Never shrinks it.
+     */
+    void setCapacity(size_t minimumCapacity);
+
+    void clear();
+
+    /* Returns the index of the entry for 'key', or NAME_NOT_FOUND. */
+    ssize_t indexOfKey(const TKey& key) const;
+
+    /* Returns the value for 'key', or a default-constructed value. */
+    const TValue& valueFor(const TKey& key) const;
+
+    inline const TKey& keyAt(size_t index) const { return mSlots[index].entry.key; }
+    inline const TValue& valueAt(size_t index) const { return mSlots[index].entry.value; }
+    inline TValue& editValueAt(size_t index) { return mSlots[index].entry.value; }
+
+    /* Returns the index of the first entry after 'index', or -1 when there
+     * are no more.  Pass -1 to get the first entry.
+     */
+    ssize_t next(ssize_t index) const;
+
+    /* Adds the entry, replacing the value if 'key' is already present.
+     * Returns the entry's index.
+     */
+    ssize_t add(const TKey& key, const TValue& value);
+
+    /* Replaces the value for 'key', adding the entry if necessary. */
+    inline ssize_t replaceValueFor(const TKey& key, const TValue& value) {
+        return add(key, value);
+    }
+
+    /* Removes the entry for 'key'.  Returns the index it had, or
+     * NAME_NOT_FOUND.
+     */
+    ssize_t removeItem(const TKey& key);
+
+    /* Removes the entry at 'index', which must hold one. */
+    void removeItemAt(size_t index);
+
+private:
+    typedef key_value_pair_t<TKey, TValue> Entry;
+
+    // Only ever used as raw storage; entries are constructed in place.
+    struct Slot {
+        hash_t hash;
+        Entry entry;
+    };
+
+    enum {
+        MIN_BUCKETS = 8,
+        // Hash value of an empty slot.
+        EMPTY = 0,
+    };
+
+    // Maximum load is 7/8.
+    static inline size_t maxSizeFor(size_t buckets) { return buckets - buckets / 8; }
+
+    static inline hash_t hashOf(const TKey& key) {
+        hash_t hash = JenkinsHashWhiten(JenkinsHashMix(0, hash_type(key)));
+        return hash != EMPTY ? hash : 1;
+    }
+
+    // How far the entry with this hash sits from its home slot.
+    inline size_t distanceAt(size_t index, hash_t hash) const {
+        return (index - hash) & (mBucketCount - 1);
+    }
+
+    ssize_t find(hash_t hash, const TKey& key) const;
+    void allocate(size_t bucketCount);
+    void release();
+    void rehash(size_t bucketCount);
+    size_t insert(hash_t hash, Entry* carry);
+    void copyFrom(const FlatHashMap& other);
+
+    size_t mSize;
+    size_t mBucketCount;  // a power of two, or 0
+    // mBucketCount slots, plus two whose entries are scratch space for
+    // swapping entries during insert.
+    Slot* mSlots;
+};
+
+// ---------------------------------------------------------------------------
+// No user serviceable parts below.
+
+template <typename TKey, typename TValue>
+FlatHashMap<TKey, TValue>::FlatHashMap(size_t minimumCapacity)
+    : mSize(0), mBucketCount(0), mSlots(NULL) {
+    if (minimumCapacity) {
+        setCapacity(minimumCapacity);
+    }
+}
+
+template <typename TKey, typename TValue>
+FlatHashMap<TKey, TValue>::FlatHashMap(const FlatHashMap& other)
+    : mSize(0), mBucketCount(0), mSlots(NULL) {
+    copyFrom(other);
+}
+
+template <typename TKey, typename TValue>
+FlatHashMap<TKey, TValue>::~FlatHashMap() {
+    release();
+}
+
+template <typename TKey, typename TValue>
+FlatHashMap<TKey, TValue>& FlatHashMap<TKey, TValue>::operator=(const FlatHashMap& other) {
+    if (&other != this) {
+        release();
+        copyFrom(other);
+    }
+    return *this;
+}
+
+template <typename TKey, typename TValue>
+void FlatHashMap<TKey, TValue>::allocate(size_t bucketCount) {
+    mSlots = static_cast<Slot*>(malloc((bucketCount + 2) * sizeof(Slot)));
+    LOG_ALWAYS_FATAL_IF(!mSlots, "Could not allocate %zu hash map slots", bucketCount);
+    for (size_t i = 0; i < bucketCount; i++) {
+        mSlots[i].hash = EMPTY;
+    }
+    mBucketCount = bucketCount;
+}
+
+template <typename TKey, typename TValue>
+void FlatHashMap<TKey, TValue>::release() {
+    clear();
+    free(mSlots);
+    mSlots = NULL;
+    mBucketCount = 0;
+}
+
+template <typename TKey, typename TValue>
+void FlatHashMap<TKey, TValue>::copyFrom(const FlatHashMap& other) {
+    if (other.mBucketCount == 0) {
+        return;
+    }
+    allocate(other.mBucketCount);
+    for (size_t i = 0; i < mBucketCount; i++) {
+        mSlots[i].hash = other.mSlots[i].hash;
+        if (mSlots[i].hash != EMPTY) {
+            copy_type(&mSlots[i].entry, &other.mSlots[i].entry, 1);
+        }
+    }
+    mSize = other.mSize;
+}
+
+template <typename TKey, typename TValue>
+void FlatHashMap<TKey, TValue>::clear() {
+    for (size_t i = 0; i < mBucketCount; i++) {
+        if (mSlots[i].hash != EMPTY) {
+            destroy_type(&mSlots[i].entry, 1);
+            mSlots[i].hash = EMPTY;
+        }
+    }
+    mSize = 0;
+}
+
+template <typename TKey, typename TValue>
+void FlatHashMap<TKey, TValue>::setCapacity(size_t minimumCapacity) {
+    size_t buckets = mBucketCount ? mBucketCount : size_t(MIN_BUCKETS);
+    while (maxSizeFor(buckets) < minimumCapacity) {
+        buckets *= 2;
+    }
+    if (buckets != mBucketCount) {
+        rehash(buckets);
+    }
+}
+
+template <typename TKey, typename TValue>
+void FlatHashMap<TKey, TValue>::rehash(size_t bucketCount) {
+    const size_t oldCount = mBucketCount;
+    Slot* const oldSlots = mSlots;
+
+    allocate(bucketCount);
+    for (size_t i = 0; i < oldCount; i++) {
+        if (oldSlots[i].hash != EMPTY) {
+            Entry* carry = &mSlots[mBucketCount].entry;
+            move_forward_type(carry, &oldSlots[i].entry);
+            insert(oldSlots[i].hash, carry);
+        }
+    }
+    free(oldSlots);
+}
+
+/*
+ * Places the entry held in the carry slot, which insert() leaves empty.
+ * The key must not be present and there must be a free slot.  Returns the
+ * slot the entry ended up in.
+ */
+template <typename TKey, typename TValue>
+size_t FlatHashMap<TKey, TValue>::insert(hash_t hash, Entry* carry) {
+    const size_t mask = mBucketCount - 1;
+    Entry* const spare = &mSlots[mBucketCount + 1].entry;
+    size_t index = hash & mask;
+    size_t distance = 0;
+    ssize_t placed = -1;
+    for (;;) {
+        Slot& slot = mSlots[index];
+        const hash_t slotHash = slot.hash;
+        if (slotHash == EMPTY) {
+            move_forward_type(&slot.entry, carry);
+            slot.hash = hash;
+            return placed >= 0 ? placed : index;
+        }
+        const size_t slotDistance = distanceAt(index, slotHash);
+        if (slotDistance < distance) {
+            // Take the slot from an entry closer to home and move it on.
+            move_forward_type(spare, &slot.entry);
+            move_forward_type(&slot.entry, carry);
+            move_forward_type(carry, spare);
+            slot.hash = hash;
+            hash = slotHash;
+            distance = slotDistance;
+            if (placed < 0) {
+                placed = index;
+            }
+        }
+        index = (index + 1) & mask;
+        distance++;
+    }
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::find(hash_t hash, const TKey& key) const {
+    if (mSize == 0) {
+        return NAME_NOT_FOUND;
+    }
+    const size_t mask = mBucketCount - 1;
+    size_t index = hash & mask;
+    for (size_t distance = 0; ; distance++) {
+        const Slot& slot = mSlots[index];
+        if (slot.hash == hash && slot.entry.key == key) {
+            return index;
+        }
+        if (slot.hash == EMPTY || distanceAt(index, slot.hash) < distance) {
+            // Robin Hood order: the key would have been placed by now.
+            return NAME_NOT_FOUND;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::indexOfKey(const TKey& key) const {
+    return find(hashOf(key), key);
+}
+
+template <typename TKey, typename TValue>
+const TValue& FlatHashMap<TKey, TValue>::valueFor(const TKey& key) const {
+    static const TValue sDefault = TValue();
+    ssize_t index = indexOfKey(key);
+    return index >= 0 ? mSlots[index].entry.value : sDefault;
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::next(ssize_t index) const {
+    for (size_t i = index + 1; i < mBucketCount; i++) {
+        if (mSlots[i].hash != EMPTY) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::add(const TKey& key, const TValue& value) {
+    const hash_t hash = hashOf(key);
+    ssize_t index = find(hash, key);
+    if (index >= 0) {
+        mSlots[index].entry.value = value;
+        return index;
+    }
+    if (mSize + 1 > capacity()) {
+        setCapacity(mSize + 1);
+    }
+    Entry* carry = &mSlots[mBucketCount].entry;
+    new (carry) Entry(key, value);
+    index = insert(hash, carry);
+    mSize++;
+    return index;
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::removeItem(const TKey& key) {
+    ssize_t index = indexOfKey(key);
+    if (index >= 0) {
+        removeItemAt(index);
+    }
+    return index;
+}
+
+template <typename TKey, typename TValue>
+void FlatHashMap<TKey, TValue>::removeItemAt(size_t index) {
+    const size_t mask = mBucketCount - 1;
+    destroy_type(&mSlots[index].entry, 1);
+    // Shift the rest of the run back so that no entry sits past a hole.
+    size_t nextIndex = (index + 1) & mask;
+    hash_t nextHash;
+    while ((nextHash = mSlots[nextIndex].hash) != EMPTY
+            && distanceAt(nextIndex, nextHash) != 0) {
+        move_forward_type(&mSlots[index].entry, &mSlots[nextIndex].entry);
+        mSlots[index].hash = nextHash;
+        index = nextIndex;
+        nextIndex = (nextIndex + 1) & mask;
+    }
+    mSlots[index].hash = EMPTY;
+    mSize--;
+}
+
+}; // namespace android
+
+#endif // ANDROID_FLAT_HASH_MAP_H
@@ -58,6 +58,7 @@ public:
     inline  size_t          capacity() const            { return mVector.capacity(); }
     //! sets the capacity. capacity can never be reduced less than size()
     inline ssize_t          setCapacity(size_t size)    { return mVector.setCapacity(size); }
+    inline void             setGrowthPolicy(uint32_t policy) { mVector.setGrowthPolicy(policy); }
 
     // returns true if the arguments is known to be identical to this vector
     inline bool isIdenticalTo(const KeyedVector& rhs) const;
@@ -83,6 +84,10 @@ public:
              */
              
             ssize_t         add(const KEY& key, const VALUE& item);
+            //! adds several pairs, in any order, in a single pass over the
+            //! vector; of pairs with equal keys, the last one given is kept
+            ssize_t         addAll(const key_value_pair_t<KEY, VALUE>* items, size_t count);
+            ssize_t         merge(const KeyedVector& other);
             ssize_t         replaceValueFor(const KEY& key, const VALUE& item);
             ssize_t         replaceValueAt(size_t index, const VALUE& item);
 
@@ -177,6 +182,17 @@ ssize_t KeyedVector<KEY,VALUE>::add(const KEY& key, const VALUE& value) {
     return mVector.add( key_value_pair_t<KEY,VALUE>(key, value) );
 }
 
+template<typename KEY, typename VALUE> inline
+ssize_t KeyedVector<KEY,VALUE>::addAll(const key_value_pair_t<KEY, VALUE>* items,
+        size_t count) {
+    return mVector.addAll(items, count);
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t KeyedVector<KEY,VALUE>::merge(const KeyedVector<KEY,VALUE>& other) {
+    return mVector.merge(other.mVector);
+}
+
 template<typename KEY, typename VALUE> inline
 ssize_t KeyedVector<KEY,VALUE>::replaceValueFor(const KEY& key, const VALUE& value) {
     key_value_pair_t<KEY,VALUE> pair(key, value);
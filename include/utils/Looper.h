@@ -328,7 +328,9 @@ public:
 
 private:
     struct Request {
-        int fd;
+        Request() : fd(-1), ident(0), data(NULL) { }
+
+        int fd; // -1 for an unused slot
         int ident;
         sp<LooperCallback> callback;
         void* data;
@@ -340,24 +342,42 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), seq(0) { }
+
+        MessageEnvelope(nsecs_t uptime, uint64_t seq, const sp<MessageHandler> handler,
+                const Message& message) : uptime(uptime), seq(seq), handler(handler),
+                message(message) {
+        }
 
-        MessageEnvelope(nsecs_t uptime, const sp<MessageHandler> handler,
-                const Message& message) : uptime(uptime), handler(handler), message(message) {
+        // Orders by uptime, then by enqueue order so that messages sent for the
+        // same time are delivered first-in first-out.
+        inline bool isBefore(const MessageEnvelope& other) const {
+            return uptime < other.uptime || (uptime == other.uptime && seq < other.seq);
         }
 
         nsecs_t uptime;
+        uint64_t seq;
         sp<MessageHandler> handler;
         Message message;
     };
 
     const bool mAllowNonCallbacks; // immutable
 
+    // Wake signal.  This is an eventfd where the kernel supports it, in which case
+    // both fields hold the same descriptor, otherwise the two ends of a pipe.
     int mWakeReadPipeFd;  // immutable
     int mWakeWritePipeFd; // immutable
+    bool mWakeIsEventFd;  // immutable
+
+    // Non-zero while a wake signal is outstanding, so that concurrent calls to
+    // wake() only signal the fd once until the looper has consumed it.
+    volatile int32_t mWakePending;
     Mutex mLock;
 
+    // Binary min-heap of pending messages ordered by MessageEnvelope::isBefore(),
+    // so the next message to deliver is always at index 0.
     Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    uint64_t mNextMessageSeq; // guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
     // Whether we are currently waiting for work.  Not protected by a lock,
@@ -366,8 +386,9 @@ private:
 
     int mEpollFd; // immutable
 
-    // Locked list of file descriptor monitoring requests.
-    KeyedVector<int, Request> mRequests;  // guarded by mLock
+    // Locked table of file descriptor monitoring requests, indexed directly by fd.
+    // Slots for fds that are not registered have Request::fd == -1.
+    Vector<Request> mRequests;  // guarded by mLock
 
     // This state is only used privately by pollOnce and does not require a lock since
     // it runs on a single thread.
@@ -378,6 +399,11 @@ private:
     int pollInner(int timeoutMillis);
     void awoken();
     void pushResponse(int events, const Request& request);
+    ssize_t indexOfRequestLocked(int fd) const;
+
+    void enqueueMessageLocked(const MessageEnvelope& messageEnvelope);
+    void dequeueMessageLocked();
+    void removeMessagesLocked(const sp<MessageHandler>& handler, bool matchWhat, int what);
 
     static void initTLSKey();
     static void threadDestructor(void *st);
@@ -32,6 +32,17 @@ public:
     virtual void operator()(EntryKey& key, EntryValue& value) = 0;
 }; // class OnEntryRemoved
 
+/**
+ * LruCache callback that reports how much of the cache's size budget an entry
+ * takes up, for instance the number of bytes it holds on to.
+ */
+template<typename EntryKey, typename EntryValue>
+class EntrySizer {
+public:
+    virtual ~EntrySizer() { };
+    virtual size_t operator()(const EntryKey& key, const EntryValue& value) = 0;
+}; // class EntrySizer
+
 template <typename TKey, typename TValue>
 class LruCache {
 public:
@@ -42,37 +53,67 @@ public:
     };
 
     void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener);
+
+    /**
+     * Bounds the total size of the entries, as reported by 'sizer', to
+     * maxSize, in addition to the bound on their number.  put() evicts the
+     * least recently used entries until the new one fits, and refuses entries
+     * larger than maxSize.  Call this while the cache is empty.
+     */
+    void setMaxSize(size_t maxSize, EntrySizer<TKey, TValue>* sizer);
+
     size_t size() const;
+    // Total size of the entries, or 0 unless setMaxSize was called.
+    size_t totalSize() const;
+
     const TValue& get(const TKey& key);
+    // Like get(), but returns NULL on a miss, so TValue needs no null value
+    // and a stored value is never mistaken for a miss.  The pointer is valid
+    // until the cache is next modified.
+    const TValue* getPtr(const TKey& key);
     bool put(const TKey& key, const TValue& value);
     bool remove(const TKey& key);
     bool removeOldest();
     void clear();
 
+    // Lookups through get()/getPtr() that found or missed their key, and
+    // entries removed to make room for others.  clear() leaves these alone.
+    size_t hitCount() const { return mHitCount; }
+    size_t missCount() const { return mMissCount; }
+    size_t evictionCount() const { return mEvictionCount; }
+
+private:
+    struct Entry;
+
+public:
+    // Visits the entries from the least to the most recently used one.
     class Iterator {
     public:
-        Iterator(const LruCache<TKey, TValue>& cache): mCache(cache), mIndex(-1) {
+        Iterator(const LruCache<TKey, TValue>& cache): mCache(cache), mEntry(NULL),
+                mStarted(false) {
         }
 
         bool next() {
-            mIndex = mCache.mTable->next(mIndex);
-            return mIndex != -1;
+            mEntry = mStarted ? mEntry->child : mCache.mOldest;
+            mStarted = true;
+            return mEntry != NULL;
         }
 
         size_t index() const {
-            return mIndex;
+            return mCache.mTable->find(-1, hash_type(mEntry->key), mEntry->key);
         }
 
         const TValue& value() const {
-            return mCache.mTable->entryAt(mIndex).value;
+            return mEntry->value;
         }
 
         const TKey& key() const {
-            return mCache.mTable->entryAt(mIndex).key;
+            return mEntry->key;
         }
     private:
         const LruCache<TKey, TValue>& mCache;
-        size_t mIndex;
+        const Entry* mEntry;
+        bool mStarted;
     };
 
 private:
@@ -83,21 +124,31 @@ private:
         TValue value;
         Entry* parent;
         Entry* child;
+        size_t size;
 
-        Entry(TKey key_, TValue value_) : key(key_), value(value_), parent(NULL), child(NULL) {
+        Entry(TKey key_, TValue value_, size_t size_) : key(key_), value(value_),
+                parent(NULL), child(NULL), size(size_) {
         }
         const TKey& getKey() const { return key; }
     };
 
+    Entry* find(const TKey& key);
+    void evictOldest();
     void attachToCache(Entry& entry);
     void detachFromCache(Entry& entry);
     void rehash(size_t newCapacity);
 
     UniquePtr<BasicHashtable<TKey, Entry> > mTable;
     OnEntryRemoved<TKey, TValue>* mListener;
+    EntrySizer<TKey, TValue>* mSizer;
     Entry* mOldest;
     Entry* mYoungest;
     uint32_t mMaxCapacity;
+    size_t mMaxSize;
+    size_t mTotalSize;
+    size_t mHitCount;
+    size_t mMissCount;
+    size_t mEvictionCount;
     TValue mNullValue;
 };
 
@@ -105,7 +156,8 @@ private:
 template <typename TKey, typename TValue>
 LruCache<TKey, TValue>::LruCache(uint32_t maxCapacity): mMaxCapacity(maxCapacity),
     mNullValue(NULL), mTable(new BasicHashtable<TKey, Entry>), mYoungest(NULL), mOldest(NULL),
-    mListener(NULL) {
+    mListener(NULL), mSizer(NULL), mMaxSize(0), mTotalSize(0), mHitCount(0), mMissCount(0),
+    mEvictionCount(0) {
 };
 
 template<typename K, typename V>
@@ -113,44 +165,80 @@ void LruCache<K, V>::setOnEntryRemovedListener(OnEntryRemoved<K, V>* listener) {
     mListener = listener;
 }
 
+template<typename K, typename V>
+void LruCache<K, V>::setMaxSize(size_t maxSize, EntrySizer<K, V>* sizer) {
+    mMaxSize = maxSize;
+    mSizer = sizer;
+}
+
 template <typename TKey, typename TValue>
 size_t LruCache<TKey, TValue>::size() const {
     return mTable->size();
 }
 
 template <typename TKey, typename TValue>
-const TValue& LruCache<TKey, TValue>::get(const TKey& key) {
+size_t LruCache<TKey, TValue>::totalSize() const {
+    return mTotalSize;
+}
+
+template <typename TKey, typename TValue>
+typename LruCache<TKey, TValue>::Entry* LruCache<TKey, TValue>::find(const TKey& key) {
     hash_t hash = hash_type(key);
     ssize_t index = mTable->find(-1, hash, key);
     if (index == -1) {
-        return mNullValue;
+        mMissCount++;
+        return NULL;
     }
+    mHitCount++;
     Entry& entry = mTable->editEntryAt(index);
     detachFromCache(entry);
     attachToCache(entry);
-    return entry.value;
+    return &entry;
 }
 
 template <typename TKey, typename TValue>
-bool LruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
-    if (mMaxCapacity != kUnlimitedCapacity && size() >= mMaxCapacity) {
-        removeOldest();
-    }
+const TValue& LruCache<TKey, TValue>::get(const TKey& key) {
+    Entry* entry = find(key);
+    return entry != NULL ? entry->value : mNullValue;
+}
+
+template <typename TKey, typename TValue>
+const TValue* LruCache<TKey, TValue>::getPtr(const TKey& key) {
+    Entry* entry = find(key);
+    return entry != NULL ? &entry->value : NULL;
+}
 
+template <typename TKey, typename TValue>
+bool LruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
     hash_t hash = hash_type(key);
     ssize_t index = mTable->find(-1, hash, key);
     if (index >= 0) {
         return false;
     }
+
+    size_t entrySize = 0;
+    if (mSizer != NULL) {
+        entrySize = (*mSizer)(key, value);
+        if (entrySize > mMaxSize) {
+            return false;
+        }
+        while (mTotalSize + entrySize > mMaxSize) {
+            evictOldest();
+        }
+    }
+    if (mMaxCapacity != kUnlimitedCapacity && size() >= mMaxCapacity) {
+        evictOldest();
+    }
     if (!mTable->hasMoreRoom()) {
         rehash(mTable->capacity() * 2);
     }
 
     // Would it be better to initialize a blank entry and assign key, value?
-    Entry initEntry(key, value);
+    Entry initEntry(key, value, entrySize);
     index = mTable->add(hash, initEntry);
     Entry& entry = mTable->editEntryAt(index);
     attachToCache(entry);
+    mTotalSize += entrySize;
     return true;
 }
 
@@ -166,6 +254,7 @@ bool LruCache<TKey, TValue>::remove(const TKey& key) {
         (*mListener)(entry.key, entry.value);
     }
     detachFromCache(entry);
+    mTotalSize -= entry.size;
     mTable->removeAt(index);
     return true;
 }
@@ -179,6 +268,13 @@ bool LruCache<TKey, TValue>::removeOldest() {
     return false;
 }
 
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::evictOldest() {
+    if (removeOldest()) {
+        mEvictionCount++;
+    }
+}
+
 template <typename TKey, typename TValue>
 void LruCache<TKey, TValue>::clear() {
     if (mListener) {
@@ -188,6 +284,7 @@ void LruCache<TKey, TValue>::clear() {
     }
     mYoungest = NULL;
     mOldest = NULL;
+    mTotalSize = 0;
     mTable->clear();
 }
 
@@ -228,7 +325,9 @@ void LruCache<TKey, TValue>::rehash(size_t newCapacity) {
     mYoungest = NULL;
     mTable.reset(new BasicHashtable<TKey, Entry>(newCapacity));
     for (Entry* p = oldest; p != NULL; p = p->child) {
-        put(p->key, p->value);
+        Entry initEntry(p->key, p->value, p->size);
+        ssize_t index = mTable->add(hash_type(p->key), initEntry);
+        attachToCache(mTable->editEntryAt(index));
     }
 }
 
@@ -18,6 +18,7 @@
 #define ANDROID_REF_BASE_H
 
 #include <cutils/atomic.h>
+#include <cutils/atomic-explicit.h>
 
 #include <stdint.h>
 #include <sys/types.h>
@@ -154,6 +155,9 @@ private:
                             RefBase(const RefBase& o);
             RefBase&        operator=(const RefBase& o);
 
+            weakref_impl*   inflateRefs() const;
+            void            removeInitialStrong() const;
+
 private:
     friend class ReferenceMover;
 
@@ -165,7 +169,10 @@ private:
     static void renameRefId(RefBase* ref,
             const void* old_id, const void* new_id);
 
-        weakref_impl* const mRefs;
+        // NULL until the object is first weakly referenced, the strong
+        // count lives in mState until then.
+        mutable weakref_impl* volatile mRefs;
+        mutable volatile int32_t mState;
 };
 
 // ---------------------------------------------------------------------------
@@ -176,10 +183,11 @@ class LightRefBase
 public:
     inline LightRefBase() : mCount(0) { }
     inline void incStrong(__attribute__((unused)) const void* id) const {
-        android_atomic_inc(&mCount);
+        android_atomic_add_explicit(1, &mCount, ANDROID_MEMORY_ORDER_RELAXED);
     }
     inline void decStrong(__attribute__((unused)) const void* id) const {
-        if (android_atomic_dec(&mCount) == 1) {
+        if (android_atomic_add_explicit(-1, &mCount, ANDROID_MEMORY_ORDER_RELEASE) == 1) {
+            android_atomic_fence(ANDROID_MEMORY_ORDER_ACQUIRE);
             delete static_cast<const T*>(this);
         }
     }
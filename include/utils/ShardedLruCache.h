@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_SHARDED_LRU_CACHE_H
+#define ANDROID_UTILS_SHARDED_LRU_CACHE_H
+
+#include <utils/JenkinsHash.h>
+#include <utils/LruCache.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+/**
+ * A thread-safe LruCache.  Keys are spread over a power-of-two number of
+ * shards by hash, each an LruCache with its own lock, so threads working on
+ * different keys rarely wait for each other.  The capacity and size budget
+ * are divided evenly between the shards, and each shard evicts its own least
+ * recently used entries, so eviction order is only approximately LRU.
+ *
+ * Values are copied out under the shard's lock, since a reference into the
+ * cache could be invalidated by another thread at any time.  Listeners and
+ * sizers are called with the shard's lock held and must not call back into
+ * the cache.
+ */
+template <typename TKey, typename TValue>
+class ShardedLruCache {
+public:
+    enum {
+        DEFAULT_SHARD_COUNT = 16,
+    };
+
+    // maxCapacity may be LruCache<TKey, TValue>::kUnlimitedCapacity.
+    // shardCount is rounded up to a power of two.
+    explicit ShardedLruCache(uint32_t maxCapacity,
+            size_t shardCount = DEFAULT_SHARD_COUNT);
+    ~ShardedLruCache();
+
+    void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener);
+    // See LruCache::setMaxSize.  No single entry may exceed maxSize divided
+    // by the number of shards.
+    void setMaxSize(size_t maxSize, EntrySizer<TKey, TValue>* sizer);
+
+    // Copies the value for key to outValue and returns true, or returns false
+    // if the key is not in the cache.
+    bool get(const TKey& key, TValue* outValue);
+    bool put(const TKey& key, const TValue& value);
+    bool remove(const TKey& key);
+    void clear();
+
+    // These add up the shards one at a time, so they are only a snapshot
+    // while other threads use the cache.
+    size_t size() const;
+    size_t totalSize() const;
+    size_t hitCount() const;
+    size_t missCount() const;
+    size_t evictionCount() const;
+
+private:
+    ShardedLruCache(const ShardedLruCache& that);  // disallow copy constructor
+    void operator=(const ShardedLruCache& that);
+
+    struct Shard {
+        mutable Mutex lock;
+        LruCache<TKey, TValue> cache;
+
+        explicit Shard(uint32_t maxCapacity) : cache(maxCapacity) { }
+    };
+
+    Shard& shardFor(const TKey& key) const {
+        hash_t hash = JenkinsHashWhiten(JenkinsHashMix(0, hash_type(key)));
+        return *mShards[hash & (mShardCount - 1)];
+    }
+
+    Shard** mShards;
+    size_t mShardCount;
+};
+
+// Implementation is here, because it's fully templated
+template <typename TKey, typename TValue>
+ShardedLruCache<TKey, TValue>::ShardedLruCache(uint32_t maxCapacity, size_t shardCount) {
+    mShardCount = 1;
+    while (mShardCount < shardCount) {
+        mShardCount <<= 1;
+    }
+    uint32_t shardCapacity = maxCapacity;
+    if (maxCapacity != LruCache<TKey, TValue>::kUnlimitedCapacity) {
+        shardCapacity = (maxCapacity + mShardCount - 1) / mShardCount;
+    }
+    mShards = new Shard*[mShardCount];
+    for (size_t i = 0; i < mShardCount; i++) {
+        mShards[i] = new Shard(shardCapacity);
+    }
+}
+
+template <typename TKey, typename TValue>
+ShardedLruCache<TKey, TValue>::~ShardedLruCache() {
+    for (size_t i = 0; i < mShardCount; i++) {
+        delete mShards[i];
+    }
+    delete[] mShards;
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::setOnEntryRemovedListener(
+        OnEntryRemoved<TKey, TValue>* listener) {
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        mShards[i]->cache.setOnEntryRemovedListener(listener);
+    }
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::setMaxSize(size_t maxSize,
+        EntrySizer<TKey, TValue>* sizer) {
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        mShards[i]->cache.setMaxSize(maxSize / mShardCount, sizer);
+    }
+}
+
+template <typename TKey, typename TValue>
+bool ShardedLruCache<TKey, TValue>::get(const TKey& key, TValue* outValue) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    const TValue* value = shard.cache.getPtr(key);
+    if (value == NULL) {
+        return false;
+    }
+    *outValue = *value;
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ShardedLruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    return shard.cache.put(key, value);
+}
+
+template <typename TKey, typename TValue>
+bool ShardedLruCache<TKey, TValue>::remove(const TKey& key) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    return shard.cache.remove(key);
+}
+
+template <typename TKey, typename TValue>
+void ShardedLruCache<TKey, TValue>::clear() {
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        mShards[i]->cache.clear();
+    }
+}
+
+template <typename TKey, typename TValue>
+size_t ShardedLruCache<TKey, TValue>::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        total += mShards[i]->cache.size();
+    }
+    return total;
+}
+
+template <typename TKey, typename TValue>
+size_t ShardedLruCache<TKey, TValue>::totalSize() const {
+    size_t total = 0;
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        total += mShards[i]->cache.totalSize();
+    }
+    return total;
+}
+
+template <typename TKey, typename TValue>
+size_t ShardedLruCache<TKey, TValue>::hitCount() const {
+    size_t total = 0;
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        total += mShards[i]->cache.hitCount();
+    }
+    return total;
+}
+
+template <typename TKey, typename TValue>
+size_t ShardedLruCache<TKey, TValue>::missCount() const {
+    size_t total = 0;
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        total += mShards[i]->cache.missCount();
+    }
+    return total;
+}
+
+template <typename TKey, typename TValue>
+size_t ShardedLruCache<TKey, TValue>::evictionCount() const {
+    size_t total = 0;
+    for (size_t i = 0; i < mShardCount; i++) {
+        Mutex::Autolock _l(mShards[i]->lock);
+        total += mShards[i]->cache.evictionCount();
+    }
+    return total;
+}
+
+}; // namespace android
+
+#endif // ANDROID_UTILS_SHARDED_LRU_CACHE_H
@@ -69,6 +69,8 @@ public:
     inline  size_t          capacity() const            { return VectorImpl::capacity(); }
     //! sets the capacity. capacity can never be reduced less than size()
     inline  ssize_t         setCapacity(size_t size)    { return VectorImpl::setCapacity(size); }
+    //! see VectorImpl::setGrowthPolicy()
+    inline  void            setGrowthPolicy(uint32_t policy) { VectorImpl::setGrowthPolicy(policy); }
 
     /*! 
      * C-style array access
@@ -111,6 +113,10 @@ public:
                 return *( static_cast<TYPE *>(VectorImpl::editItemLocation(index)) );
             }
 
+            //! adds several items, in any order, in a single pass over the
+            //! vector; of equal items, the last one given is kept
+            ssize_t         addAll(const TYPE* items, size_t count);
+
             //! merges a vector into this one
             ssize_t         merge(const Vector<TYPE>& vector);
             ssize_t         merge(const SortedVector<TYPE>& vector);
@@ -146,7 +152,8 @@ SortedVector<TYPE>::SortedVector()
     : SortedVectorImpl(sizeof(TYPE),
                 ((traits<TYPE>::has_trivial_ctor   ? HAS_TRIVIAL_CTOR   : 0)
                 |(traits<TYPE>::has_trivial_dtor   ? HAS_TRIVIAL_DTOR   : 0)
-                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0))
+                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0)
+                |(traits<TYPE>::has_trivial_move   ? HAS_TRIVIAL_MOVE   : 0))
                 )
 {
 }
@@ -217,6 +224,11 @@ size_t SortedVector<TYPE>::orderOf(const TYPE& item) const {
     return SortedVectorImpl::orderOf(&item);
 }
 
+template<class TYPE> inline
+ssize_t SortedVector<TYPE>::addAll(const TYPE* items, size_t count) {
+    return SortedVectorImpl::addAll(items, count);
+}
+
 template<class TYPE> inline
 ssize_t SortedVector<TYPE>::merge(const Vector<TYPE>& vector) {
     return SortedVectorImpl::merge(reinterpret_cast<const VectorImpl&>(vector));
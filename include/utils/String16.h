@@ -38,6 +38,10 @@ class String8;
 class TextOutput;
 
 //! This is a string holding UTF-16 characters.
+//
+// Strings of up to 7 characters are stored inside the object; longer strings
+// live in a SharedBuffer that copies of the string share until one of them is
+// edited.
 class String16
 {
 public:
@@ -49,9 +53,12 @@ public:
      */
     enum StaticLinkage { kEmptyString };
 
-                                String16();
+    inline                      String16();
     explicit                    String16(StaticLinkage);
                                 String16(const String16& o);
+#if __cplusplus >= 201103L
+                                String16(String16&& o);
+#endif
                                 String16(const String16& o,
                                          size_t len,
                                          size_t begin=0);
@@ -61,7 +68,7 @@ public:
     explicit                    String16(const char* o);
     explicit                    String16(const char* o, size_t len);
 
-                                ~String16();
+    inline                      ~String16();
     
     inline  const char16_t*     string() const;
     inline  size_t              size() const;
@@ -79,6 +86,9 @@ public:
             status_t            append(const char16_t* other, size_t len);
             
     inline  String16&           operator=(const String16& other);
+#if __cplusplus >= 201103L
+    inline  String16&           operator=(String16&& other);
+#endif
     
     inline  String16&           operator+=(const String16& other);
     inline  String16            operator+(const String16& other) const;
@@ -119,11 +129,31 @@ public:
     inline                      operator const char16_t*() const;
     
 private:
+    enum {
+        // Longest string, in characters, kept in mInline.
+        kInlineLength = 7,
+        // Last element of mInline when the string is in a SharedBuffer instead.
+        kSharedTag = 0xffff,
+    };
+
+    inline  bool                isInline() const;
+    inline  void                initEmpty();
+            void                makeEmpty();
+            void                moveFrom(String16& other);
+            char16_t*           editResize(size_t len);
+            status_t            setFromUTF8(const char* u8str, size_t u8len);
+
+    // The last element of mInline holds kInlineLength minus the length of an
+    // inline string, so it doubles as the terminator of a full-length one.
+    union {
             const char16_t*     mString;
+            char16_t            mInline[kInlineLength + 1];
+    };
 };
 
 // String16 can be trivially moved using memcpy() because moving does not
-// require any change to the underlying SharedBuffer contents or reference count.
+// require any change to the underlying SharedBuffer contents or reference
+// count, and inline strings do not point into themselves.
 ANDROID_TRIVIAL_MOVE_TRAIT(String16)
 
 // ---------------------------------------------------------------------------
@@ -139,19 +169,58 @@ inline int strictly_order_type(const String16& lhs, const String16& rhs)
     return compare_type(lhs, rhs) < 0;
 }
 
+inline bool String16::isInline() const
+{
+    return mInline[kInlineLength] != kSharedTag;
+}
+
+inline void String16::initEmpty()
+{
+    mInline[0] = 0;
+    mInline[kInlineLength] = kInlineLength;
+}
+
+inline String16::String16()
+{
+    initEmpty();
+}
+
+#if __cplusplus >= 201103L
+inline String16::String16(String16&& o)
+{
+    memcpy(mInline, o.mInline, sizeof(mInline));
+    o.initEmpty();
+}
+#endif
+
+inline String16::~String16()
+{
+    if (!isInline()) {
+        SharedBuffer::bufferFromData(mString)->release();
+    }
+}
+
 inline const char16_t* String16::string() const
 {
-    return mString;
+    return isInline() ? mInline : mString;
 }
 
 inline size_t String16::size() const
 {
-    return SharedBuffer::sizeFromData(mString)/sizeof(char16_t)-1;
+    return isInline() ? kInlineLength - mInline[kInlineLength]
+            : SharedBuffer::sizeFromData(mString)/sizeof(char16_t)-1;
 }
 
+// Returns NULL for strings of up to 7 characters, which are kept inside the
+// object instead of a SharedBuffer.  string() of such a string points into
+// the String16 itself, so it is invalidated whenever the object moves: by
+// move construction or assignment, and also when a Vector, SortedVector or
+// KeyedVector grows or shifts its items, which ANDROID_TRIVIAL_MOVE_TRAIT
+// lets it relocate with memmove().  Do not hold string() of a container
+// element across changes to that container.
 inline const SharedBuffer* String16::sharedBuffer() const
 {
-    return SharedBuffer::bufferFromData(mString);
+    return isInline() ? NULL : SharedBuffer::bufferFromData(mString);
 }
 
 inline String16& String16::operator=(const String16& other)
@@ -160,6 +229,14 @@ inline String16& String16::operator=(const String16& other)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+inline String16& String16::operator=(String16&& other)
+{
+    moveFrom(other);
+    return *this;
+}
+#endif
+
 inline String16& String16::operator+=(const String16& other)
 {
     append(other);
@@ -175,72 +252,72 @@ inline String16 String16::operator+(const String16& other) const
 
 inline int String16::compare(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size());
+    return strzcmp16(string(), size(), other.string(), other.size());
 }
 
 inline bool String16::operator<(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) < 0;
+    return strzcmp16(string(), size(), other.string(), other.size()) < 0;
 }
 
 inline bool String16::operator<=(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) <= 0;
+    return strzcmp16(string(), size(), other.string(), other.size()) <= 0;
 }
 
 inline bool String16::operator==(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) == 0;
+    return strzcmp16(string(), size(), other.string(), other.size()) == 0;
 }
 
 inline bool String16::operator!=(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) != 0;
+    return strzcmp16(string(), size(), other.string(), other.size()) != 0;
 }
 
 inline bool String16::operator>=(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) >= 0;
+    return strzcmp16(string(), size(), other.string(), other.size()) >= 0;
 }
 
 inline bool String16::operator>(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) > 0;
+    return strzcmp16(string(), size(), other.string(), other.size()) > 0;
 }
 
 inline bool String16::operator<(const char16_t* other) const
 {
-    return strcmp16(mString, other) < 0;
+    return strcmp16(string(), other) < 0;
 }
 
 inline bool String16::operator<=(const char16_t* other) const
 {
-    return strcmp16(mString, other) <= 0;
+    return strcmp16(string(), other) <= 0;
 }
 
 inline bool String16::operator==(const char16_t* other) const
 {
-    return strcmp16(mString, other) == 0;
+    return strcmp16(string(), other) == 0;
 }
 
 inline bool String16::operator!=(const char16_t* other) const
 {
-    return strcmp16(mString, other) != 0;
+    return strcmp16(string(), other) != 0;
 }
 
 inline bool String16::operator>=(const char16_t* other) const
 {
-    return strcmp16(mString, other) >= 0;
+    return strcmp16(string(), other) >= 0;
 }
 
 inline bool String16::operator>(const char16_t* other) const
 {
-    return strcmp16(mString, other) > 0;
+    return strcmp16(string(), other) > 0;
 }
 
 inline String16::operator const char16_t*() const
 {
-    return mString;
+    return string();
 }
 
 }; // namespace android
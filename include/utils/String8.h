@@ -34,6 +34,11 @@ class TextOutput;
 
 //! This is a string holding UTF-8 characters. Does not allow the value more
 // than 0x10FFFF, which is not valid unicode codepoint.
+//
+// Strings of up to 15 bytes are stored inside the object; longer strings live
+// in a SharedBuffer that copies of the string share until one of them is
+// edited.  Pointers returned by string() for short strings are only valid for
+// as long as the String8 itself is not moved or modified.
 class String8
 {
 public:
@@ -45,9 +50,12 @@ public:
      */
     enum StaticLinkage { kEmptyString };
 
-                                String8();
+    inline                      String8();
     explicit                    String8(StaticLinkage);
                                 String8(const String8& o);
+#if __cplusplus >= 201103L
+                                String8(String8&& o);
+#endif
     explicit                    String8(const char* o);
     explicit                    String8(const char* o, size_t numChars);
     
@@ -56,7 +64,7 @@ public:
     explicit                    String8(const char16_t* o, size_t numChars);
     explicit                    String8(const char32_t* o);
     explicit                    String8(const char32_t* o, size_t numChars);
-                                ~String8();
+    inline                      ~String8();
 
     static inline const String8 empty();
 
@@ -96,6 +104,9 @@ public:
             void                getUtf32(char32_t* dst) const;
 
     inline  String8&            operator=(const String8& other);
+#if __cplusplus >= 201103L
+    inline  String8&            operator=(String8&& other);
+#endif
     inline  String8&            operator=(const char* other);
     
     inline  String8&            operator+=(const String8& other);
@@ -223,14 +234,31 @@ public:
     String8& convertToResPath();
 
 private:
+    enum {
+        // Longest string, in bytes, kept in mInline.
+        kInlineLength = 15,
+        // Last byte of mInline when the string is in a SharedBuffer instead.
+        kSharedTag = 0xff,
+    };
+
+    inline  bool                isInline() const;
+    inline  void                initEmpty();
+            void                moveFrom(String8& other);
+            char*               editResize(size_t numChars);
             status_t            real_append(const char* other, size_t numChars);
             char*               find_extension(void) const;
 
-            const char* mString;
+    // The last byte of mInline holds kInlineLength minus the length of an
+    // inline string, so it doubles as the terminator of a full-length one.
+    union {
+            const char*         mString;
+            char                mInline[kInlineLength + 1];
+    };
 };
 
 // String8 can be trivially moved using memcpy() because moving does not
-// require any change to the underlying SharedBuffer contents or reference count.
+// require any change to the underlying SharedBuffer contents or reference
+// count, and inline strings do not point into themselves.
 ANDROID_TRIVIAL_MOVE_TRAIT(String8)
 
 // ---------------------------------------------------------------------------
@@ -246,18 +274,50 @@ inline int strictly_order_type(const String8& lhs, const String8& rhs)
     return compare_type(lhs, rhs) < 0;
 }
 
+inline bool String8::isInline() const
+{
+    return static_cast<unsigned char>(mInline[kInlineLength]) != kSharedTag;
+}
+
+inline void String8::initEmpty()
+{
+    mInline[0] = 0;
+    mInline[kInlineLength] = kInlineLength;
+}
+
+inline String8::String8()
+{
+    initEmpty();
+}
+
+#if __cplusplus >= 201103L
+inline String8::String8(String8&& o)
+{
+    memcpy(mInline, o.mInline, sizeof(mInline));
+    o.initEmpty();
+}
+#endif
+
+inline String8::~String8()
+{
+    if (!isInline()) {
+        SharedBuffer::bufferFromData(mString)->release();
+    }
+}
+
 inline const String8 String8::empty() {
     return String8();
 }
 
 inline const char* String8::string() const
 {
-    return mString;
+    return isInline() ? mInline : mString;
 }
 
 inline size_t String8::length() const
 {
-    return SharedBuffer::sizeFromData(mString)-1;
+    return isInline() ? kInlineLength - static_cast<unsigned char>(mInline[kInlineLength])
+            : SharedBuffer::sizeFromData(mString)-1;
 }
 
 inline size_t String8::size() const
@@ -272,12 +332,19 @@ inline bool String8::isEmpty() const
 
 inline size_t String8::bytes() const
 {
-    return SharedBuffer::sizeFromData(mString)-1;
+    return length();
 }
 
+// Returns NULL for strings of up to 15 bytes, which are kept inside the
+// object instead of a SharedBuffer.  string() of such a string points into
+// the String8 itself, so it is invalidated whenever the object moves: by
+// move construction or assignment, and also when a Vector, SortedVector or
+// KeyedVector grows or shifts its items, which ANDROID_TRIVIAL_MOVE_TRAIT
+// lets it relocate with memmove().  Do not hold string() of a container
+// element across changes to that container.
 inline const SharedBuffer* String8::sharedBuffer() const
 {
-    return SharedBuffer::bufferFromData(mString);
+    return isInline() ? NULL : SharedBuffer::bufferFromData(mString);
 }
 
 inline String8& String8::operator=(const String8& other)
@@ -286,6 +353,14 @@ inline String8& String8::operator=(const String8& other)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+inline String8& String8::operator=(String8&& other)
+{
+    moveFrom(other);
+    return *this;
+}
+#endif
+
 inline String8& String8::operator=(const char* other)
 {
     setTo(other);
@@ -320,72 +395,72 @@ inline String8 String8::operator+(const char* other) const
 
 inline int String8::compare(const String8& other) const
 {
-    return strcmp(mString, other.mString);
+    return strcmp(string(), other.string());
 }
 
 inline bool String8::operator<(const String8& other) const
 {
-    return strcmp(mString, other.mString) < 0;
+    return strcmp(string(), other.string()) < 0;
 }
 
 inline bool String8::operator<=(const String8& other) const
 {
-    return strcmp(mString, other.mString) <= 0;
+    return strcmp(string(), other.string()) <= 0;
 }
 
 inline bool String8::operator==(const String8& other) const
 {
-    return strcmp(mString, other.mString) == 0;
+    return strcmp(string(), other.string()) == 0;
 }
 
 inline bool String8::operator!=(const String8& other) const
 {
-    return strcmp(mString, other.mString) != 0;
+    return strcmp(string(), other.string()) != 0;
 }
 
 inline bool String8::operator>=(const String8& other) const
 {
-    return strcmp(mString, other.mString) >= 0;
+    return strcmp(string(), other.string()) >= 0;
 }
 
 inline bool String8::operator>(const String8& other) const
 {
-    return strcmp(mString, other.mString) > 0;
+    return strcmp(string(), other.string()) > 0;
 }
 
 inline bool String8::operator<(const char* other) const
 {
-    return strcmp(mString, other) < 0;
+    return strcmp(string(), other) < 0;
 }
 
 inline bool String8::operator<=(const char* other) const
 {
-    return strcmp(mString, other) <= 0;
+    return strcmp(string(), other) <= 0;
 }
 
 inline bool String8::operator==(const char* other) const
 {
-    return strcmp(mString, other) == 0;
+    return strcmp(string(), other) == 0;
 }
 
 inline bool String8::operator!=(const char* other) const
 {
-    return strcmp(mString, other) != 0;
+    return strcmp(string(), other) != 0;
 }
 
 inline bool String8::operator>=(const char* other) const
 {
-    return strcmp(mString, other) >= 0;
+    return strcmp(string(), other) >= 0;
 }
 
 inline bool String8::operator>(const char* other) const
 {
-    return strcmp(mString, other) > 0;
+    return strcmp(string(), other) > 0;
 }
 
 inline String8::operator const char*() const
 {
-    return mString;
+    return string();
 }
 
 }  // namespace android
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_THREAD_POOL_H
+#define ANDROID_UTILS_THREAD_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/ConcurrentQueue.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/ThreadDefs.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class ThreadPool;
+
+/*
+ * A unit of work for a ThreadPool.  Subclasses implement run() and keep any
+ * inputs and results in their own fields, so the task doubles as the future
+ * for its result: wait() returns once run() has returned, after which the
+ * results may be read.
+ *
+ * The pool keeps a strong reference to a task from submit() until it has
+ * completed.  A task may be submitted only once.
+ */
+class ThreadPoolTask : public virtual RefBase {
+public:
+    ThreadPoolTask();
+
+    // True once the task has run or has been cancelled.
+    bool isDone() const;
+
+    // Blocks until the task has completed.  Returns NO_ERROR if it ran, or
+    // DEAD_OBJECT if its pool was shut down without running it.
+    //
+    // When called from one of the pool's own threads, for example by a task
+    // waiting for subtasks it submitted, the calling thread runs other tasks
+    // of the pool while it waits, so fork/join style tasks do not tie up a
+    // thread each or deadlock a small pool.
+    status_t wait();
+
+protected:
+    virtual ~ThreadPoolTask();
+
+    virtual void run() = 0;
+
+    // Completion callback, called exactly once before wait() returns: on the
+    // thread that ran the task with NO_ERROR, or on the thread that shut the
+    // pool down with DEAD_OBJECT.  The default does nothing.
+    virtual void onCompleted(status_t status);
+
+private:
+    friend class ThreadPool;
+
+    ThreadPoolTask(const ThreadPoolTask&);
+    ThreadPoolTask& operator=(const ThreadPoolTask&);
+
+    void complete(status_t status);
+
+    volatile int32_t mDone;
+    status_t mStatus;
+    QueueWaitList mWaiters;
+};
+
+/*
+ * A fixed set of worker threads running ThreadPoolTasks, meant for many small
+ * tasks.  Each worker has its own deque of tasks: tasks submitted from a
+ * worker (typically subtasks) go on its own deque, which it works through
+ * newest first without taking any lock, and workers that run out of work
+ * steal the oldest tasks from the others.  Tasks submitted from other threads
+ * go through a shared queue, from which an idle worker takes a batch at a
+ * time.  There is no ordering between tasks.
+ *
+ * Workers run at the priority given to start(), which also picks their
+ * scheduling group as for any android thread.
+ *
+ * Like Looper, this is only built for the device and the Linux host.
+ */
+class ThreadPool {
+public:
+    enum {
+        // Tasks each worker's deque can hold; beyond that, tasks submitted
+        // from the worker go through the shared queue.
+        DEQUE_CAPACITY = 1024,
+    };
+
+    // threadCount 0 means one thread per online CPU.
+    explicit ThreadPool(size_t threadCount = 0);
+    // Shuts down the pool, running the tasks that are still queued first.
+    ~ThreadPool();
+
+    status_t start(const char* name = "ThreadPool",
+            int32_t priority = PRIORITY_DEFAULT);
+
+    // Changes the priority (and scheduling group) of every worker.  Only
+    // supported on the device; returns INVALID_OPERATION elsewhere.
+    status_t setPriority(int32_t priority);
+
+    // Queues a task.  Returns INVALID_OPERATION once shutdown() has been
+    // called, except from within a task that is being drained, so that it
+    // can still submit its subtasks.
+    status_t submit(const sp<ThreadPoolTask>& task);
+
+    // Stops accepting tasks from outside the pool and waits for the workers
+    // to exit.  With drain, every task queued so far is run first, along with
+    // any tasks those submit.  Without, only the tasks that are already
+    // running are finished and the rest are cancelled.  Returns WOULD_BLOCK
+    // if called from one of the pool's own threads.
+    status_t shutdown(bool drain = true);
+
+    size_t threadCount() const { return mThreadCount; }
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    class Worker;
+    friend class Worker;
+    friend class ThreadPoolTask;
+
+    enum {
+        RUNNING = 0,
+        DRAINING = 1,
+        CANCELLING = 2,
+    };
+
+    static Worker* currentWorker();
+
+    ThreadPoolTask* findTask(Worker* worker);
+    ThreadPoolTask* nextTask(Worker* worker);
+    ThreadPoolTask* takePending(Worker* worker);
+    void runTask(ThreadPoolTask* task);
+    void helpUntilDone(Worker* worker, ThreadPoolTask* task);
+    bool hasWorkOrStopping() const;
+    void cancelQueuedTasks();
+
+    const size_t mThreadCount;
+    Vector<sp<Worker> > mWorkers;
+    volatile int32_t mState;
+
+    // Tasks submitted from outside the pool, oldest first from mPendingHead.
+    Mutex mPendingLock;
+    Vector<ThreadPoolTask*> mPending;
+    size_t mPendingHead;
+    volatile int32_t mPendingCount;
+
+    QueueWaitList mIdle;
+};
+
+}; // namespace android
+
+#endif // ANDROID_UTILS_THREAD_POOL_H
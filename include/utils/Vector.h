@@ -79,6 +79,8 @@ public:
     inline  size_t          capacity() const            { return VectorImpl::capacity(); }
     //! sets the capacity. capacity can never be reduced less than size()
     inline  ssize_t         setCapacity(size_t size)    { return VectorImpl::setCapacity(size); }
+    //! see VectorImpl::setGrowthPolicy()
+    inline  void            setGrowthPolicy(uint32_t policy) { VectorImpl::setGrowthPolicy(policy); }
 
     /*!
      * set the size of the vector. items are appended with the default
@@ -220,7 +222,8 @@ Vector<TYPE>::Vector()
     : VectorImpl(sizeof(TYPE),
                 ((traits<TYPE>::has_trivial_ctor   ? HAS_TRIVIAL_CTOR   : 0)
                 |(traits<TYPE>::has_trivial_dtor   ? HAS_TRIVIAL_DTOR   : 0)
-                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0))
+                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0)
+                |(traits<TYPE>::has_trivial_move   ? HAS_TRIVIAL_MOVE   : 0))
                 )
 {
 }
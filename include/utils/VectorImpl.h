@@ -28,6 +28,8 @@
 
 namespace android {
 
+class SharedBuffer;
+
 /*!
  * Implementation of the guts of the vector<> class
  * this ensures backward binary compatibility and
@@ -44,6 +46,13 @@ public:
         HAS_TRIVIAL_CTOR    = 0x00000001,
         HAS_TRIVIAL_DTOR    = 0x00000002,
         HAS_TRIVIAL_COPY    = 0x00000004,
+        HAS_TRIVIAL_MOVE    = 0x00000008,
+    };
+
+    enum { // growth policies, see setGrowthPolicy()
+        GROW_BY_HALF        = 0x00000000,
+        GROW_BY_DOUBLING    = 0x00000010,
+        KEEP_CAPACITY       = 0x00000020,
     };
 
                             VectorImpl(size_t itemSize, uint32_t flags);
@@ -65,6 +74,10 @@ public:
             size_t          capacity() const;
             ssize_t         setCapacity(size_t size);
             ssize_t         resize(size_t size);
+            /*! how the capacity follows the size: GROW_BY_HALF (the default)
+             *  or GROW_BY_DOUBLING when the vector is full, optionally with
+             *  KEEP_CAPACITY to never give back memory when items are removed */
+            void            setGrowthPolicy(uint32_t policy);
 
             /*! append/insert another vector or array */
             ssize_t         insertVectorAt(const VectorImpl& vector, size_t index);
@@ -107,8 +120,11 @@ protected:
     virtual void            do_move_backward(void* dest, const void* from, size_t num) const = 0;
     
 private:
+    friend class SortedVectorImpl;
+
         void* _grow(size_t where, size_t amount);
         void  _shrink(size_t where, size_t amount);
+        bool  _can_resize_in_place(const SharedBuffer* sb) const;
 
         inline void _do_construct(void* storage, size_t num) const;
         inline void _do_destroy(void* storage, size_t num) const;
@@ -122,7 +138,7 @@ private:
             void *      mStorage;   // base address of the vector
             size_t      mCount;     // number of items
 
-    const   uint32_t    mFlags;
+            uint32_t    mFlags;
     const   size_t      mItemSize;
 };
 
@@ -146,6 +162,10 @@ public:
     //! add an item in the right place (or replaces it if there is one)
             ssize_t         add(const void* item);
 
+    //! adds 'count' items in any order, in a single pass over this vector;
+    //! of equal items, the last one given replaces the others
+            ssize_t         addAll(const void* array, size_t count);
+
     //! merges a vector into this one
             ssize_t         merge(const VectorImpl& vector);
             ssize_t         merge(const SortedVectorImpl& vector);
@@ -158,6 +178,8 @@ protected:
 
 private:
             ssize_t         _indexOrderOf(const void* item, size_t* order = 0) const;
+            void            _sort(const void** items, const void** scratch, size_t count) const;
+            ssize_t         _merge(const void* const* items, size_t count);
 
             // these are made private, because they can't be used on a SortedVector
             // (they don't have an implementation either)
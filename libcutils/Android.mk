@@ -23,8 +23,15 @@ else
 endif
 hostSmpFlag := -DANDROID_SMP=0
 
+# Build the android_atomic_* functions on the compiler's __atomic builtins
+# instead of the per-architecture assembly in cutils/atomic-<arch>.h.
+ifeq ($(TARGET_ATOMIC_USE_BUILTINS),true)
+    targetSmpFlag += -DANDROID_ATOMIC_USE_BUILTINS=1
+endif
+
 commonSources := \
 	hashmap.c \
+	concurrent_hashmap.c \
 	atomic.c.arm \
 	native_handle.c \
 	socket_inaddr_any_server.c \
@@ -0,0 +1,466 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/concurrent_hashmap.h>
+#include <assert.h>
+#include <errno.h>
+#include <cutils/threads.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Number of stripes, a power of 2. The low bits of a key's hash pick its
+// stripe, the bits above them its bucket within the stripe.
+#define STRIPE_BITS 4
+#define STRIPE_COUNT (1 << STRIPE_BITS)
+
+// Buckets of the old table moved over by each put or remove while a stripe
+// is resizing. A resize starts at a load factor of 0.75 in the new table and
+// the next one at 1.5, so any step of 2 or more finishes in time.
+#define MIGRATE_STEP 4
+
+// Entries are allocated in chunks that double from the first size up to the
+// last, so small maps stay small.
+#define FIRST_CHUNK_ENTRIES 4
+#define MAX_CHUNK_ENTRIES 256
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct Entry Entry;
+struct Entry {
+    void* key;
+    int hash;
+    void* value;
+    Entry* next;
+};
+
+typedef struct EntryChunk EntryChunk;
+struct EntryChunk {
+    EntryChunk* next;
+    Entry entries[];
+};
+
+typedef struct {
+    mutex_t lock;
+    Entry** buckets;
+    size_t bucketCount;
+    // While resizing, the previous table, whose buckets below 'migrated'
+    // have been moved to 'buckets'. NULL otherwise.
+    Entry** oldBuckets;
+    size_t oldBucketCount;
+    size_t migrated;
+    volatile size_t size;
+    Entry* freeEntries;
+    EntryChunk* chunks;
+    size_t nextChunkEntries;
+} Stripe;
+
+// Keeps each stripe, and so its lock, on cache lines of its own.
+typedef union {
+    Stripe stripe;
+    char padding[(sizeof(Stripe) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1)];
+} PaddedStripe;
+
+struct ConcurrentHashmap {
+    PaddedStripe* stripes;
+    void* stripeMemory;
+    int (*hash)(void* key);
+    bool (*equals)(void* keyA, void* keyB);
+};
+
+static void freeStripe(Stripe* stripe) {
+    EntryChunk* chunk = stripe->chunks;
+    while (chunk != NULL) {
+        EntryChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(stripe->buckets);
+    free(stripe->oldBuckets);
+    mutex_destroy(&stripe->lock);
+}
+
+ConcurrentHashmap* concurrentHashmapCreate(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+    assert(hash != NULL);
+    assert(equals != NULL);
+
+    ConcurrentHashmap* map = malloc(sizeof(ConcurrentHashmap));
+    if (map == NULL) {
+        return NULL;
+    }
+    map->stripeMemory = calloc(1, STRIPE_COUNT * sizeof(PaddedStripe) + CACHE_LINE_SIZE - 1);
+    if (map->stripeMemory == NULL) {
+        free(map);
+        return NULL;
+    }
+    map->stripes = (PaddedStripe*) (((uintptr_t) map->stripeMemory + CACHE_LINE_SIZE - 1)
+            & ~(uintptr_t) (CACHE_LINE_SIZE - 1));
+
+    // 0.75 load factor, with the expected entries spread evenly.
+    size_t perStripe = (initialCapacity + STRIPE_COUNT - 1) / STRIPE_COUNT;
+    size_t minimumBucketCount = perStripe * 4 / 3;
+    size_t bucketCount = 1;
+    while (bucketCount <= minimumBucketCount) {
+        // Bucket count must be power of 2.
+        bucketCount <<= 1;
+    }
+
+    size_t i;
+    for (i = 0; i < STRIPE_COUNT; i++) {
+        Stripe* stripe = &map->stripes[i].stripe;
+        stripe->buckets = calloc(bucketCount, sizeof(Entry*));
+        if (stripe->buckets == NULL) {
+            while (i-- > 0) {
+                freeStripe(&map->stripes[i].stripe);
+            }
+            free(map->stripeMemory);
+            free(map);
+            return NULL;
+        }
+        stripe->bucketCount = bucketCount;
+        stripe->nextChunkEntries = FIRST_CHUNK_ENTRIES;
+        mutex_init(&stripe->lock);
+    }
+
+    map->hash = hash;
+    map->equals = equals;
+
+    return map;
+}
+
+void concurrentHashmapFree(ConcurrentHashmap* map) {
+    size_t i;
+    for (i = 0; i < STRIPE_COUNT; i++) {
+        freeStripe(&map->stripes[i].stripe);
+    }
+    free(map->stripeMemory);
+    free(map);
+}
+
+/**
+ * Hashes the given key, as Hashmap does.
+ */
+static inline int hashKey(ConcurrentHashmap* map, void* key) {
+    int h = map->hash(key);
+
+    // We apply this secondary hashing discovered by Doug Lea to defend
+    // against bad hashes.
+    h += ~(h << 9);
+    h ^= (((unsigned int) h) >> 14);
+    h += (h << 4);
+    h ^= (((unsigned int) h) >> 10);
+
+    return h;
+}
+
+static inline Stripe* stripeFor(ConcurrentHashmap* map, int hash) {
+    return &map->stripes[((unsigned int) hash) & (STRIPE_COUNT - 1)].stripe;
+}
+
+static inline size_t calculateIndex(size_t bucketCount, int hash) {
+    return (((unsigned int) hash) >> STRIPE_BITS) & (bucketCount - 1);
+}
+
+static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
+        bool (*equals)(void*, void*)) {
+    if (keyA == keyB) {
+        return true;
+    }
+    if (hashA != hashB) {
+        return false;
+    }
+    return equals(keyA, keyB);
+}
+
+static Entry* allocEntry(Stripe* stripe) {
+    Entry* entry = stripe->freeEntries;
+    if (entry == NULL) {
+        size_t count = stripe->nextChunkEntries;
+        EntryChunk* chunk = malloc(sizeof(EntryChunk) + count * sizeof(Entry));
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = stripe->chunks;
+        stripe->chunks = chunk;
+        if (count < MAX_CHUNK_ENTRIES) {
+            stripe->nextChunkEntries = count * 2;
+        }
+
+        // Hand out the first entry and put the others on the free list.
+        size_t i;
+        for (i = 1; i < count - 1; i++) {
+            chunk->entries[i].next = &chunk->entries[i + 1];
+        }
+        chunk->entries[count - 1].next = NULL;
+        stripe->freeEntries = &chunk->entries[1];
+        return &chunk->entries[0];
+    }
+    stripe->freeEntries = entry->next;
+    return entry;
+}
+
+static inline void freeEntry(Stripe* stripe, Entry* entry) {
+    entry->next = stripe->freeEntries;
+    stripe->freeEntries = entry;
+}
+
+/**
+ * Moves up to 'count' buckets of the old table over, and drops the old
+ * table once it is empty.
+ */
+static void migrateBuckets(Stripe* stripe, size_t count) {
+    while (count-- > 0 && stripe->migrated < stripe->oldBucketCount) {
+        Entry* entry = stripe->oldBuckets[stripe->migrated++];
+        while (entry != NULL) {
+            Entry* next = entry->next;
+            size_t index = calculateIndex(stripe->bucketCount, entry->hash);
+            entry->next = stripe->buckets[index];
+            stripe->buckets[index] = entry;
+            entry = next;
+        }
+    }
+    if (stripe->migrated == stripe->oldBucketCount) {
+        free(stripe->oldBuckets);
+        stripe->oldBuckets = NULL;
+        stripe->oldBucketCount = 0;
+        stripe->migrated = 0;
+    }
+}
+
+static void expandIfNecessary(Stripe* stripe) {
+    // If the load factor exceeds 0.75 and no resize is under way...
+    if (stripe->size > (stripe->bucketCount * 3 / 4) && stripe->oldBuckets == NULL) {
+        // Start off with a 0.375 load factor.
+        size_t newBucketCount = stripe->bucketCount << 1;
+        Entry** newBuckets = calloc(newBucketCount, sizeof(Entry*));
+        if (newBuckets == NULL) {
+            // Abort expansion.
+            return;
+        }
+
+        // Existing entries move over bit by bit, in later puts and removes.
+        stripe->oldBuckets = stripe->buckets;
+        stripe->oldBucketCount = stripe->bucketCount;
+        stripe->migrated = 0;
+        stripe->buckets = newBuckets;
+        stripe->bucketCount = newBucketCount;
+    }
+}
+
+/**
+ * Returns the link pointing to the entry for the given key, or NULL.
+ */
+static Entry** findEntry(ConcurrentHashmap* map, Stripe* stripe, void* key, int hash) {
+    Entry** p = &stripe->buckets[calculateIndex(stripe->bucketCount, hash)];
+    Entry* current;
+    while ((current = *p) != NULL) {
+        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
+            return p;
+        }
+        p = &current->next;
+    }
+
+    if (stripe->oldBuckets != NULL) {
+        size_t index = calculateIndex(stripe->oldBucketCount, hash);
+        if (index >= stripe->migrated) {
+            p = &stripe->oldBuckets[index];
+            while ((current = *p) != NULL) {
+                if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
+                    return p;
+                }
+                p = &current->next;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Adds a new entry, returning NULL if memory allocation fails.
+ */
+static Entry* addEntry(Stripe* stripe, void* key, int hash, void* value) {
+    Entry* entry = allocEntry(stripe);
+    if (entry == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t index = calculateIndex(stripe->bucketCount, hash);
+    entry->key = key;
+    entry->hash = hash;
+    entry->value = value;
+    entry->next = stripe->buckets[index];
+    stripe->buckets[index] = entry;
+    stripe->size++;
+    expandIfNecessary(stripe);
+    return entry;
+}
+
+void* concurrentHashmapPut(ConcurrentHashmap* map, void* key, void* value) {
+    int hash = hashKey(map, key);
+    Stripe* stripe = stripeFor(map, hash);
+    void* oldValue = NULL;
+
+    mutex_lock(&stripe->lock);
+    if (stripe->oldBuckets != NULL) {
+        migrateBuckets(stripe, MIGRATE_STEP);
+    }
+    Entry** p = findEntry(map, stripe, key, hash);
+    if (p != NULL) {
+        // Replace existing entry.
+        oldValue = (*p)->value;
+        (*p)->value = value;
+    } else {
+        addEntry(stripe, key, hash, value);
+    }
+    mutex_unlock(&stripe->lock);
+
+    return oldValue;
+}
+
+void* concurrentHashmapGet(ConcurrentHashmap* map, void* key) {
+    int hash = hashKey(map, key);
+    Stripe* stripe = stripeFor(map, hash);
+    void* value = NULL;
+
+    mutex_lock(&stripe->lock);
+    Entry** p = findEntry(map, stripe, key, hash);
+    if (p != NULL) {
+        value = (*p)->value;
+    }
+    mutex_unlock(&stripe->lock);
+
+    return value;
+}
+
+bool concurrentHashmapContainsKey(ConcurrentHashmap* map, void* key) {
+    int hash = hashKey(map, key);
+    Stripe* stripe = stripeFor(map, hash);
+
+    mutex_lock(&stripe->lock);
+    bool found = findEntry(map, stripe, key, hash) != NULL;
+    mutex_unlock(&stripe->lock);
+
+    return found;
+}
+
+void* concurrentHashmapMemoize(ConcurrentHashmap* map, void* key,
+        void* (*initialValue)(void* key, void* context), void* context) {
+    int hash = hashKey(map, key);
+    Stripe* stripe = stripeFor(map, hash);
+    void* value = NULL;
+
+    mutex_lock(&stripe->lock);
+    if (stripe->oldBuckets != NULL) {
+        migrateBuckets(stripe, MIGRATE_STEP);
+    }
+    Entry** p = findEntry(map, stripe, key, hash);
+    if (p != NULL) {
+        // Return existing value.
+        value = (*p)->value;
+    } else {
+        Entry* entry = addEntry(stripe, key, hash, NULL);
+        if (entry != NULL) {
+            value = initialValue(key, context);
+            entry->value = value;
+        }
+    }
+    mutex_unlock(&stripe->lock);
+
+    return value;
+}
+
+void* concurrentHashmapRemove(ConcurrentHashmap* map, void* key) {
+    int hash = hashKey(map, key);
+    Stripe* stripe = stripeFor(map, hash);
+    void* value = NULL;
+
+    mutex_lock(&stripe->lock);
+    if (stripe->oldBuckets != NULL) {
+        migrateBuckets(stripe, MIGRATE_STEP);
+    }
+    Entry** p = findEntry(map, stripe, key, hash);
+    if (p != NULL) {
+        Entry* current = *p;
+        value = current->value;
+        *p = current->next;
+        freeEntry(stripe, current);
+        stripe->size--;
+    }
+    mutex_unlock(&stripe->lock);
+
+    return value;
+}
+
+size_t concurrentHashmapSize(ConcurrentHashmap* map) {
+    size_t size = 0;
+    size_t i;
+    for (i = 0; i < STRIPE_COUNT; i++) {
+        size += map->stripes[i].stripe.size;
+    }
+    return size;
+}
+
+static bool forEachInBuckets(Entry** buckets, size_t from, size_t to,
+        bool (*callback)(void* key, void* value, void* context),
+        void* context) {
+    size_t i;
+    for (i = from; i < to; i++) {
+        Entry* entry = buckets[i];
+        while (entry != NULL) {
+            if (!callback(entry->key, entry->value, context)) {
+                return false;
+            }
+            entry = entry->next;
+        }
+    }
+    return true;
+}
+
+void concurrentHashmapForEach(ConcurrentHashmap* map,
+        bool (*callback)(void* key, void* value, void* context),
+        void* context) {
+    size_t i;
+    for (i = 0; i < STRIPE_COUNT; i++) {
+        Stripe* stripe = &map->stripes[i].stripe;
+        mutex_lock(&stripe->lock);
+        bool more = forEachInBuckets(stripe->buckets, 0, stripe->bucketCount,
+                callback, context);
+        if (more && stripe->oldBuckets != NULL) {
+            more = forEachInBuckets(stripe->oldBuckets, stripe->migrated,
+                    stripe->oldBucketCount, callback, context);
+        }
+        mutex_unlock(&stripe->lock);
+        if (!more) {
+            return;
+        }
+    }
+}
+
+size_t concurrentHashmapCurrentCapacity(ConcurrentHashmap* map) {
+    size_t capacity = 0;
+    size_t i;
+    for (i = 0; i < STRIPE_COUNT; i++) {
+        Stripe* stripe = &map->stripes[i].stripe;
+        mutex_lock(&stripe->lock);
+        capacity += stripe->bucketCount * 3 / 4;
+        mutex_unlock(&stripe->lock);
+    }
+    return capacity;
+}
@@ -26,6 +26,34 @@
 #include <cutils/properties.h>
 #include "loghack.h"
 
+/* Never a real serial: the value length in its top byte is below
+ * PROPERTY_VALUE_MAX.  PROPERTY_HANDLE_INITIALIZER uses the same value. */
+#define PROPERTY_HANDLE_NO_SERIAL 0xffffffffU
+
+void property_handle_init(struct property_handle *handle, const char *key)
+{
+    handle->key = key;
+    handle->pi = NULL;
+    handle->serial = PROPERTY_HANDLE_NO_SERIAL;
+    handle->len = -1;
+    handle->value[0] = '\0';
+}
+
+static int property_handle_copy(const struct property_handle *handle,
+                                char *value, const char *default_value)
+{
+    int len = handle->len;
+
+    if(len > 0 || !default_value) {
+        memcpy(value, handle->value, len + 1);
+        return len;
+    }
+
+    len = strlen(default_value);
+    memcpy(value, default_value, len + 1);
+    return len;
+}
+
 #ifdef HAVE_LIBC_SYSTEM_PROPERTIES
 
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
@@ -76,6 +104,45 @@ int property_list(
     return __system_property_foreach(property_list_callback, &data);
 }
 
+static const prop_info *property_handle_find(struct property_handle *handle)
+{
+    if(handle->pi == NULL) {
+        handle->pi = __system_property_find(handle->key);
+    }
+    return handle->pi;
+}
+
+int property_handle_changed(struct property_handle *handle)
+{
+    const prop_info *pi = property_handle_find(handle);
+
+    if(pi == NULL) {
+        return handle->len < 0;
+    }
+    return __system_property_serial(pi) != handle->serial;
+}
+
+int property_handle_get(struct property_handle *handle, char *value,
+                        const char *default_value)
+{
+    if(property_handle_changed(handle)) {
+        const prop_info *pi = handle->pi;
+        char name[PROP_NAME_MAX];
+
+        if(pi != NULL) {
+            /* Take the serial first: if the value changes while it is read,
+             * the next check sees a newer serial and reads it again. */
+            handle->serial = __system_property_serial(pi);
+            handle->len = __system_property_read(pi, name, handle->value);
+        } else {
+            handle->serial = PROPERTY_HANDLE_NO_SERIAL;
+            handle->len = 0;
+            handle->value[0] = '\0';
+        }
+    }
+    return property_handle_copy(handle, value, default_value);
+}
+
 #elif defined(HAVE_SYSTEM_PROPERTY_SERVER)
 
 /*
@@ -337,3 +404,27 @@ int property_list(void (*propfn)(const char *key, const char *value, void *cooki
 }
 
 #endif
+
+#ifndef HAVE_LIBC_SYSTEM_PROPERTIES
+
+/* Without a shared property area there is no serial to check, so every
+ * check reports a change and every read goes to property_get. */
+
+int property_handle_changed(struct property_handle *handle)
+{
+    return 1;
+}
+
+int property_handle_get(struct property_handle *handle, char *value,
+                        const char *default_value)
+{
+    int len = property_get(handle->key, handle->value, NULL);
+
+    if(len < 0) {
+        return len;
+    }
+    handle->len = len;
+    return property_handle_copy(handle, value, default_value);
+}
+
+#endif
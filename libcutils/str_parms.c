@@ -278,43 +278,107 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
         return -ENOENT;
 
     out = strtof(value, &end);
-    if (*value != '\0' && *end == '\0')
+    if (*value != '\0' && *end == '\0') {
+        *val = out;
         return 0;
+    }
 
     return -EINVAL;
 }
 
-static bool combine_strings(void *key, void *value, void *context)
+static int writer_append(struct str_parms_writer *writer,
+                         const char *key, size_t key_len,
+                         const char *value, size_t value_len)
 {
-    char **old_str = context;
-    char *new_str;
+    size_t sep = writer->len ? 1 : 0;
+    size_t len = writer->len + sep + key_len + 1 + value_len;
+    char *p;
+
+    if (len >= writer->size)
+        return -ENOSPC;
+
+    p = writer->buf + writer->len;
+    if (sep)
+        *p++ = ';';
+    memcpy(p, key, key_len);
+    p += key_len;
+    *p++ = '=';
+    memcpy(p, value, value_len);
+    p += value_len;
+    *p = '\0';
+    writer->len = len;
+    return 0;
+}
+
+void str_parms_writer_init(struct str_parms_writer *writer, char *buf,
+                           size_t size)
+{
+    writer->buf = buf;
+    writer->size = size;
+    writer->len = 0;
+    if (size)
+        buf[0] = '\0';
+}
+
+int str_parms_writer_add_str(struct str_parms_writer *writer, const char *key,
+                             const char *value)
+{
+    return writer_append(writer, key, strlen(key), value, strlen(value));
+}
+
+int str_parms_writer_add_int(struct str_parms_writer *writer, const char *key,
+                             int value)
+{
+    char val_str[12];
     int ret;
 
-    ret = asprintf(&new_str, "%s%s%s=%s",
-                   *old_str ? *old_str : "",
-                   *old_str ? ";" : "",
-                   (char *)key,
-                   (char *)value);
-    if (*old_str)
-        free(*old_str);
-
-    if (ret >= 0) {
-        *old_str = new_str;
-        return true;
-    }
+    ret = snprintf(val_str, sizeof(val_str), "%d", value);
+    if (ret < 0)
+        return -EINVAL;
+
+    return writer_append(writer, key, strlen(key), val_str, ret);
+}
+
+int str_parms_writer_add_float(struct str_parms_writer *writer,
+                               const char *key, float value)
+{
+    char val_str[64];
+    int ret;
 
-    *old_str = NULL;
-    return false;
+    ret = snprintf(val_str, sizeof(val_str), "%.10f", value);
+    if (ret < 0 || ret >= (int)sizeof(val_str))
+        return -EINVAL;
+
+    return writer_append(writer, key, strlen(key), val_str, ret);
+}
+
+static bool measure_pair(void *key, void *value, void *context)
+{
+    size_t *size = context;
+
+    *size += strlen((char *)key) + strlen((char *)value) + 2;
+    return true;
+}
+
+static bool combine_strings(void *key, void *value, void *context)
+{
+    return str_parms_writer_add_str(context, key, value) == 0;
 }
 
 char *str_parms_to_str(struct str_parms *str_parms)
 {
-    char *str = NULL;
+    struct str_parms_writer writer;
+    size_t size = 1;
+    char *str;
 
-    if (hashmapSize(str_parms->map) > 0)
-        hashmapForEach(str_parms->map, combine_strings, &str);
-    else
-        str = strdup("");
+    /* size the string first, so that it is built in one buffer */
+    hashmapForEach(str_parms->map, measure_pair, &size);
+    str = malloc(size);
+    if (!str)
+        return NULL;
+
+    str_parms_writer_init(&writer, str, size);
+    hashmapForEach(str_parms->map, combine_strings, &writer);
     return str;
 }
 
@@ -329,6 +393,154 @@ void str_parms_dump(struct str_parms *str_parms)
     hashmapForEach(str_parms->map, dump_entry, str_parms);
 }
 
+int str_parms_view_parse(struct str_parms_view *view,
+                         struct str_parms_pair *pairs, size_t capacity,
+                         const char *str)
+{
+    const char *p = str;
+
+    view->pairs = pairs;
+    view->count = 0;
+
+    while (*p) {
+        const char *kvpair = p;
+        const char *eq = NULL;
+        struct str_parms_pair *pair;
+
+        for (; *p && *p != ';'; p++) {
+            if (!eq && *p == '=')
+                eq = p;
+        }
+
+        /* skip empty pairs and empty keys, as str_parms_create_str() does */
+        if (p != kvpair && eq != kvpair) {
+            if (view->count == capacity)
+                return -ENOSPC;
+
+            pair = &pairs[view->count++];
+            pair->key = kvpair;
+            if (eq) {
+                pair->key_len = eq - kvpair;
+                pair->value = eq + 1;
+                pair->value_len = p - (eq + 1);
+            } else {
+                pair->key_len = p - kvpair;
+                pair->value = p;
+                pair->value_len = 0;
+            }
+        }
+
+        if (*p)
+            p++;
+    }
+
+    return 0;
+}
+
+static const struct str_parms_pair *find_pair(const struct str_parms_view *view,
+                                              const char *key, size_t key_len,
+                                              size_t end)
+{
+    const struct str_parms_pair *pair;
+
+    while (end-- > 0) {
+        pair = &view->pairs[end];
+        if (pair->key_len == key_len && !memcmp(pair->key, key, key_len))
+            return pair;
+    }
+    return NULL;
+}
+
+const struct str_parms_pair *str_parms_view_find(
+        const struct str_parms_view *view, const char *key)
+{
+    return find_pair(view, key, strlen(key), view->count);
+}
+
+int str_parms_view_get_str(const struct str_parms_view *view, const char *key,
+                           char *val, int len)
+{
+    const struct str_parms_pair *pair;
+    size_t n;
+
+    pair = str_parms_view_find(view, key);
+    if (!pair)
+        return -ENOENT;
+
+    if (len > 0) {
+        n = pair->value_len < (size_t)len - 1 ? pair->value_len : (size_t)len - 1;
+        memcpy(val, pair->value, n);
+        val[n] = '\0';
+    }
+    return pair->value_len;
+}
+
+/*
+ * The number parsers below run on values in place: a value always ends at
+ * a ';' or the terminating NUL, neither of which continues a number, so
+ * parsing stops at the end of the value and a complete parse ends there.
+ */
+int str_parms_view_get_int(const struct str_parms_view *view, const char *key,
+                           int *val)
+{
+    const struct str_parms_pair *pair;
+    char *end;
+
+    pair = str_parms_view_find(view, key);
+    if (!pair)
+        return -ENOENT;
+
+    *val = (int)strtol(pair->value, &end, 0);
+    if (pair->value_len && end == pair->value + pair->value_len)
+        return 0;
+
+    return -EINVAL;
+}
+
+int str_parms_view_get_float(const struct str_parms_view *view,
+                             const char *key, float *val)
+{
+    const struct str_parms_pair *pair;
+    float out;
+    char *end;
+
+    pair = str_parms_view_find(view, key);
+    if (!pair)
+        return -ENOENT;
+
+    out = strtof(pair->value, &end);
+    if (pair->value_len && end == pair->value + pair->value_len) {
+        *val = out;
+        return 0;
+    }
+
+    return -EINVAL;
+}
+
+int str_parms_view_to_str(const struct str_parms_view *view, char *buf,
+                          size_t size)
+{
+    struct str_parms_writer writer;
+    const struct str_parms_pair *pair;
+    size_t i;
+
+    str_parms_writer_init(&writer, buf, size);
+    for (i = 0; i < view->count; i++) {
+        pair = &view->pairs[i];
+
+        /* a later pair with the same key replaces this one */
+        if (find_pair(view, pair->key, pair->key_len, view->count) != pair)
+            continue;
+
+        if (writer_append(&writer, pair->key, pair->key_len,
+                          pair->value, pair->value_len)) {
+            str_parms_writer_init(&writer, buf, size);
+            return -ENOSPC;
+        }
+    }
+    return writer.len;
+}
+
 #ifdef TEST_STR_PARMS
 static void test_str_parms_str(const char *str)
 {
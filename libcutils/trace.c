@@ -38,6 +38,16 @@ static volatile int32_t atrace_is_enabled    = 1;
 static pthread_once_t   atrace_once_control  = PTHREAD_ONCE_INIT;
 static pthread_mutex_t  atrace_tags_mutex    = PTHREAD_MUTEX_INITIALIZER;
 
+// The properties read by atrace_get_property(), which may run for each
+// property change in the system.  Used during initialization and then with
+// atrace_tags_mutex held.
+static struct property_handle atrace_app_cmdlines_property =
+        PROPERTY_HANDLE_INITIALIZER("debug.atrace.app_cmdlines");
+static struct property_handle atrace_debuggable_property =
+        PROPERTY_HANDLE_INITIALIZER("ro.debuggable");
+static struct property_handle atrace_tags_property =
+        PROPERTY_HANDLE_INITIALIZER("debug.atrace.tags.enableflags");
+
 // Set whether this process is debuggable, which determines whether
 // application-level tracing is allowed when the ro.debuggable system property
 // is not set to '1'.
@@ -62,7 +72,7 @@ static bool atrace_is_cmdline_match(const char* cmdline)
     char value[PROPERTY_VALUE_MAX];
     char* start = value;
 
-    property_get("debug.atrace.app_cmdlines", value, "");
+    property_handle_get(&atrace_app_cmdlines_property, value, "");
 
     while (start != NULL) {
         char* end = strchr(start, ',');
@@ -91,7 +101,7 @@ static bool atrace_is_app_tracing_enabled()
     bool result = false;
 
     // Check whether the system is debuggable.
-    property_get("ro.debuggable", value, "0");
+    property_handle_get(&atrace_debuggable_property, value, "0");
     if (value[0] == '1') {
         sys_debuggable = true;
     }
@@ -123,7 +133,7 @@ static uint64_t atrace_get_property()
     char *endptr;
     uint64_t tags;
 
-    property_get("debug.atrace.tags.enableflags", value, "0");
+    property_handle_get(&atrace_tags_property, value, "0");
     errno = 0;
     tags = strtoull(value, &endptr, 0);
     if (value[0] == '\0' || *endptr != '\0') {
@@ -148,20 +158,16 @@ static uint64_t atrace_get_property()
 // Update tags if tracing is ready. Useful as a sysprop change callback.
 void atrace_update_tags()
 {
-    uint64_t tags;
     if (CC_UNLIKELY(android_atomic_acquire_load(&atrace_is_ready))) {
+        pthread_mutex_lock(&atrace_tags_mutex);
         if (android_atomic_acquire_load(&atrace_is_enabled)) {
-            tags = atrace_get_property();
-            pthread_mutex_lock(&atrace_tags_mutex);
-            atrace_enabled_tags = tags;
-            pthread_mutex_unlock(&atrace_tags_mutex);
+            atrace_enabled_tags = atrace_get_property();
         } else {
             // Tracing is disabled for this process, so we simply don't
             // initialize the tags.
-            pthread_mutex_lock(&atrace_tags_mutex);
             atrace_enabled_tags = ATRACE_TAG_NOT_READY;
-            pthread_mutex_unlock(&atrace_tags_mutex);
         }
+        pthread_mutex_unlock(&atrace_tags_mutex);
     }
 }
 
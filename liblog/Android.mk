@@ -78,4 +78,30 @@ include $(BUILD_STATIC_LIBRARY)
 include $(CLEAR_VARS)
 LOCAL_MODULE := liblog
 LOCAL_WHOLE_STATIC_LIBRARIES := liblog
+LOCAL_REQUIRED_MODULES := event-log-tags.idx
 include $(BUILD_SHARED_LIBRARY)
+
+
+# Precompiled index of /system/etc/event-log-tags
+# ========================================================
+ifndef WITH_MINGW
+include $(CLEAR_VARS)
+LOCAL_MODULE := event-log-tags-index
+LOCAL_SRC_FILES := event_tag_index.c
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+endif
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := event-log-tags.idx
+LOCAL_MODULE_CLASS := ETC
+include $(BUILD_SYSTEM)/base_rules.mk
+
+# The map itself is generated by build/core/Makefile.
+event_log_tags_index_tool := $(HOST_OUT_EXECUTABLES)/event-log-tags-index$(HOST_EXECUTABLE_SUFFIX)
+$(LOCAL_BUILT_MODULE): PRIVATE_TOOL := $(event_log_tags_index_tool)
+$(LOCAL_BUILT_MODULE): $(TARGET_OUT)/etc/event-log-tags $(event_log_tags_index_tool)
+	@echo "Index: $< -> $@"
+	@mkdir -p $(dir $@)
+	$(hide) $(PRIVATE_TOOL) $< $@
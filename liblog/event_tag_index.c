@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Build-time tool that writes the precompiled index android_openEventTagMap()
+ * maps instead of parsing event-log-tags.
+ */
+
+#include <log/event_tag_map.h>
+
+#include <stdio.h>
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <event-log-tags> <index file>\n", argv[0]);
+        return 2;
+    }
+    if (android_writeEventTagIndex(argv[1], argv[2]) != 0) {
+        fprintf(stderr, "%s: unable to index '%s'\n", argv[0], argv[1]);
+        return 1;
+    }
+    return 0;
+}
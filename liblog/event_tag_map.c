@@ -13,18 +13,56 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+
+#define _GNU_SOURCE /* for asprintf */
+
 #include <log/event_tag_map.h>
 #include <log/log.h>
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <assert.h>
 
 #define OUT_TAG "EventTagMap"
 
+/*
+ * Precompiled index.  When "<map file>.idx" exists and was built from the
+ * current map file, it is mapped read-only and searched in place, so
+ * opening the map costs no parsing, sorting or allocation.  The index is
+ * generated at build time by android_writeEventTagIndex(); if it is missing
+ * or was built from different contents, the text file is parsed as before.
+ * Opening a map never writes anything.
+ *
+ * Layout, in native byte order:
+ *   EventTagIndexHeader
+ *   EventTagIndexEntry[numTags], sorted by tagIndex
+ *   NUL-terminated tag strings, referenced by offset from the file start
+ */
+#define EVENT_TAG_INDEX_SUFFIX  ".idx"
+#define EVENT_TAG_INDEX_MAGIC   0x494d5445      /* "ETMI" */
+#define EVENT_TAG_INDEX_VERSION 2
+
+typedef struct EventTagIndexHeader {
+    uint32_t        magic;
+    uint32_t        version;
+    uint64_t        srcSize;
+    uint64_t        srcHash;        /* hashContents() of the map file */
+    uint32_t        numTags;
+    uint32_t        reserved;
+} EventTagIndexHeader;
+
+typedef struct EventTagIndexEntry {
+    uint32_t        tagIndex;
+    uint32_t        strOffset;
+} EventTagIndexEntry;
+
 /*
  * Single entry.
  */
@@ -44,6 +82,12 @@ struct EventTagMap {
     /* array of event tags, sorted numerically by tag index */
     EventTag*       tagArray;
     int             numTags;
+
+    /* set instead of tagArray when mapAddr is a precompiled index */
+    const EventTagIndexEntry* indexArray;
+
+    /* hash of the text as read, before parsing wrote into it */
+    uint64_t        srcHash;
 };
 
 /* fwd */
@@ -53,17 +97,50 @@ static int parseMapLines(EventTagMap* map);
 static int scanTagLine(char** pData, EventTag* tag, int lineNum);
 static int sortTags(EventTagMap* map);
 static void dumpTags(const EventTagMap* map);
+static EventTagMap* openMap(const char* fileName, int useIndex);
+static uint64_t hashContents(const void* data, size_t len);
+static int openIndex(EventTagMap* map, const char* fileName,
+    uint64_t srcSize, uint64_t srcHash);
+static int writeIndex(const EventTagMap* map, const char* indexName);
 
 
 /*
  * Open the map file and allocate a structure to manage it.
+ */
+EventTagMap* android_openEventTagMap(const char* fileName)
+{
+    return openMap(fileName, 1);
+}
+
+/*
+ * Parse the map file and write a precompiled index of it.
+ *
+ * Returns 0 on success.
+ */
+int android_writeEventTagIndex(const char* fileName, const char* indexName)
+{
+    EventTagMap* map;
+    int result;
+
+    map = openMap(fileName, 0);
+    if (map == NULL)
+        return -1;
+
+    result = writeIndex(map, indexName);
+    android_closeEventTagMap(map);
+    return result;
+}
+
+/*
+ * Map the file, then use its index if allowed and current, or parse it.
  *
  * We create a private mapping because we want to terminate the log tag
  * strings with '\0'.
  */
-EventTagMap* android_openEventTagMap(const char* fileName)
+static EventTagMap* openMap(const char* fileName, int useIndex)
 {
     EventTagMap* newTagMap;
+    void* textAddr;
     off_t end;
     int fd = -1;
 
@@ -85,18 +162,29 @@ EventTagMap* android_openEventTagMap(const char* fileName)
         goto fail;
     }
 
-    newTagMap->mapAddr = mmap(NULL, end, PROT_READ | PROT_WRITE, MAP_PRIVATE,
-                                fd, 0);
-    if (newTagMap->mapAddr == MAP_FAILED) {
+    textAddr = mmap(NULL, end, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (textAddr == MAP_FAILED) {
         fprintf(stderr, "%s: mmap(%s) failed: %s\n",
             OUT_TAG, fileName, strerror(errno));
         goto fail;
     }
+    newTagMap->srcHash = hashContents(textAddr, end);
+
+    if (useIndex
+            && openIndex(newTagMap, fileName, end, newTagMap->srcHash) == 0) {
+        munmap(textAddr, end);
+        close(fd);
+        return newTagMap;
+    }
+
+    newTagMap->mapAddr = textAddr;
     newTagMap->mapLen = end;
 
     if (processFile(newTagMap) != 0)
         goto fail;
 
+    close(fd);
+
     return newTagMap;
 
 fail:
@@ -114,7 +202,9 @@ void android_closeEventTagMap(EventTagMap* map)
     if (map == NULL)
         return;
 
-    munmap(map->mapAddr, map->mapLen);
+    if (map->mapAddr != NULL)
+        munmap(map->mapAddr, map->mapLen);
+    free(map->tagArray);
     free(map);
 }
 
@@ -130,6 +220,22 @@ const char* android_lookupEventTag(const EventTagMap* map, int tag)
     lo = 0;
     hi = map->numTags-1;
 
+    if (map->indexArray != NULL) {
+        const EventTagIndexEntry* entries = map->indexArray;
+
+        while (lo <= hi) {
+            mid = (lo+hi)/2;
+            if (entries[mid].tagIndex < (unsigned int) tag) {
+                lo = mid + 1;
+            } else if (entries[mid].tagIndex > (unsigned int) tag) {
+                hi = mid - 1;
+            } else {
+                return (const char*) map->mapAddr + entries[mid].strOffset;
+            }
+        }
+        return NULL;
+    }
+
     while (lo <= hi) {
         int cmp;
 
@@ -436,3 +542,158 @@ static void dumpTags(const EventTagMap* map)
     }
 }
 
+/*
+ * FNV-1a over 64-bit words, to tell whether an index was built from these
+ * contents.  Word at a time keeps hashing the text well below parsing it.
+ */
+static uint64_t hashContents(const void* data, size_t len)
+{
+    const unsigned char* p = (const unsigned char*) data;
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t word;
+
+    for (; len >= sizeof(word); p += sizeof(word), len -= sizeof(word)) {
+        memcpy(&word, p, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    while (len--) {
+        hash = (hash ^ *p++) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Map "<fileName>.idx", if there is one and it was built from a map file
+ * with the same size and contents.
+ *
+ * Returns 0 on success.
+ */
+static int openIndex(EventTagMap* map, const char* fileName,
+    uint64_t srcSize, uint64_t srcHash)
+{
+    const EventTagIndexHeader* hdr;
+    const EventTagIndexEntry* entries;
+    size_t stringsStart;
+    struct stat st;
+    char* indexName;
+    void* addr;
+    uint32_t i;
+    int fd;
+
+    if (asprintf(&indexName, "%s" EVENT_TAG_INDEX_SUFFIX, fileName) < 0)
+        return -1;
+    fd = open(indexName, O_RDONLY);
+    free(indexName);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(*hdr)) {
+        close(fd);
+        return -1;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return -1;
+
+    /* check everything we'll trust later, so lookups need no checks */
+    hdr = (const EventTagIndexHeader*) addr;
+    entries = (const EventTagIndexEntry*) (hdr + 1);
+    stringsStart = sizeof(*hdr) + (size_t) hdr->numTags * sizeof(*entries);
+    if (hdr->magic != EVENT_TAG_INDEX_MAGIC
+            || hdr->version != EVENT_TAG_INDEX_VERSION
+            || hdr->srcSize != srcSize
+            || hdr->srcHash != srcHash
+            || hdr->numTags > (uint32_t) (st.st_size / sizeof(*entries))
+            || stringsStart > (size_t) st.st_size
+            || ((const char*) addr)[st.st_size - 1] != '\0') {
+        goto stale;
+    }
+    for (i = 0; i < hdr->numTags; i++) {
+        if (entries[i].strOffset < stringsStart
+                || entries[i].strOffset >= (size_t) st.st_size
+                || (i > 0 && entries[i].tagIndex <= entries[i-1].tagIndex)) {
+            goto stale;
+        }
+    }
+
+    map->mapAddr = addr;
+    map->mapLen = st.st_size;
+    map->numTags = hdr->numTags;
+    map->indexArray = entries;
+    return 0;
+
+stale:
+    munmap(addr, st.st_size);
+    return -1;
+}
+
+/*
+ * Write out the index for a map we just parsed.  The file is written under
+ * a private name and renamed, so readers never see half of it.
+ *
+ * Returns 0 on success.
+ */
+static int writeIndex(const EventTagMap* map, const char* indexName)
+{
+    EventTagIndexHeader* hdr;
+    EventTagIndexEntry* entries;
+    char* tmpName = NULL;
+    char* buf;
+    char* strp;
+    size_t size;
+    ssize_t written = -1;
+    int i, fd;
+
+    size = sizeof(*hdr) + map->numTags * sizeof(*entries);
+    for (i = 0; i < map->numTags; i++)
+        size += strlen(map->tagArray[i].tagStr) + 1;
+
+    buf = calloc(1, size);
+    if (buf == NULL)
+        return -1;
+
+    hdr = (EventTagIndexHeader*) buf;
+    hdr->magic = EVENT_TAG_INDEX_MAGIC;
+    hdr->version = EVENT_TAG_INDEX_VERSION;
+    hdr->srcSize = map->mapLen;
+    hdr->srcHash = map->srcHash;
+    hdr->numTags = map->numTags;
+
+    entries = (EventTagIndexEntry*) (hdr + 1);
+    strp = (char*) (entries + map->numTags);
+    for (i = 0; i < map->numTags; i++) {
+        size_t len = strlen(map->tagArray[i].tagStr) + 1;
+
+        entries[i].tagIndex = map->tagArray[i].tagIndex;
+        entries[i].strOffset = strp - buf;
+        memcpy(strp, map->tagArray[i].tagStr, len);
+        strp += len;
+    }
+
+    if (asprintf(&tmpName, "%s.%d", indexName, getpid()) < 0) {
+        free(buf);
+        return -1;
+    }
+    fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        do {
+            written = write(fd, buf, size);
+        } while (written < 0 && errno == EINTR);
+        close(fd);
+
+        if (written != (ssize_t) size || rename(tmpName, indexName) != 0) {
+            unlink(tmpName);
+            written = -1;
+        }
+    }
+    if (written < 0) {
+        fprintf(stderr, "%s: unable to write index '%s': %s\n",
+            OUT_TAG, indexName, strerror(errno));
+    }
+
+    free(tmpName);
+    free(buf);
+    return written < 0 ? -1 : 0;
+}
@@ -33,6 +33,9 @@
 
 #define LOG_BUF_SIZE	1024
 
+#define LOG_BATCH_SIZE	(16 * 1024)
+#define LOG_BATCH_HIGH_WATER	(LOG_BATCH_SIZE / 2)
+
 #if FAKE_LOG_DEVICE
 // This will be defined when building for the host.
 #define log_open(pathname, flags) fakeLogOpen(pathname, flags)
@@ -132,6 +135,375 @@ static int __write_to_log_init(log_id_t log_id, struct iovec *vec, size_t nr)
     return write_to_log(log_id, vec, nr);
 }
 
+#ifdef HAVE_PTHREADS
+
+/*
+ * Per-thread batching.  Records are stored back to back in the batch buffer
+ * as a log_record header followed by the bytes the iovecs would have
+ * carried.  Draining rebuilds the same iovecs and does one write per record.
+ *
+ * 'lock' guards the fill buffer and is only ever contended by a drain
+ * swapping buffers.  'write_lock' is held while a drained buffer is being
+ * written out, which keeps a thread's records in order no matter who is
+ * draining.
+ */
+#define LOG_RECORD_MAX_IOVS 3
+
+struct log_record {
+    uint16_t iov_len[LOG_RECORD_MAX_IOVS];
+    uint8_t nr;
+    uint8_t log_id;
+};
+
+struct log_batch {
+    pthread_mutex_t lock;
+    pthread_mutex_t write_lock;
+    char *buf;
+    char *spare;
+    size_t len;
+    int64_t oldest_ms;
+    int flush_prio;
+    int flush_interval_ms;
+    int detached;
+    struct log_batch *next;
+    struct log_batch *next_due;     /* writer-private */
+};
+
+static pthread_once_t log_batch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_batch_key;
+static pthread_mutex_t log_batch_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_batch_cond = PTHREAD_COND_INITIALIZER;
+static struct log_batch *log_batch_list = NULL;
+static int log_batch_writer_started = 0;
+static int log_batch_wakeup = 0;
+
+static int64_t log_batch_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void log_batch_drain(struct log_batch *batch)
+{
+    char *out;
+    size_t len, pos;
+
+    pthread_mutex_lock(&batch->write_lock);
+
+    pthread_mutex_lock(&batch->lock);
+    out = batch->buf;
+    len = batch->len;
+    batch->buf = batch->spare;
+    batch->spare = out;
+    batch->len = 0;
+    pthread_mutex_unlock(&batch->lock);
+
+    for (pos = 0; pos < len; ) {
+        struct log_record *rec = (struct log_record *) (out + pos);
+        struct iovec vec[LOG_RECORD_MAX_IOVS];
+        char *p = (char *) (rec + 1);
+        size_t i;
+
+        for (i = 0; i < rec->nr; i++) {
+            vec[i].iov_base = p;
+            vec[i].iov_len = rec->iov_len[i];
+            p += rec->iov_len[i];
+        }
+        write_to_log((log_id_t) rec->log_id, vec, rec->nr);
+
+        pos += (p - (out + pos) + 3) & ~3;
+    }
+
+    pthread_mutex_unlock(&batch->write_lock);
+}
+
+static void *log_batch_writer(void *arg)
+{
+    pthread_mutex_lock(&log_batch_list_lock);
+    for (;;) {
+        struct log_batch **pb = &log_batch_list;
+        struct log_batch *due_list = NULL;
+        struct log_batch *dead_list = NULL;
+        struct timespec ts;
+        int64_t now = log_batch_now_ms();
+        int64_t wake = now + 1000;
+
+        /*
+         * Pick out the batches to drain, then write them with the list lock
+         * dropped so that producers, __android_log_batch_begin() and exiting
+         * threads never wait on the driver.  Only this thread unlinks or
+         * frees batches, so the ones picked out stay valid meanwhile.
+         */
+        log_batch_wakeup = 0;
+        while (*pb != NULL) {
+            struct log_batch *batch = *pb;
+            int64_t due;
+            size_t len;
+
+            if (batch->detached) {
+                *pb = batch->next;
+                batch->next = dead_list;
+                dead_list = batch;
+                continue;
+            }
+
+            pthread_mutex_lock(&batch->lock);
+            len = batch->len;
+            due = batch->oldest_ms + batch->flush_interval_ms;
+            pthread_mutex_unlock(&batch->lock);
+
+            if (len > 0 && (len >= LOG_BATCH_HIGH_WATER || now >= due)) {
+                batch->next_due = due_list;
+                due_list = batch;
+            } else if (len > 0 && due < wake) {
+                wake = due;
+            }
+            pb = &batch->next;
+        }
+        pthread_mutex_unlock(&log_batch_list_lock);
+
+        while (due_list != NULL) {
+            struct log_batch *batch = due_list;
+            due_list = batch->next_due;
+            log_batch_drain(batch);
+        }
+        while (dead_list != NULL) {
+            struct log_batch *batch = dead_list;
+            dead_list = batch->next;
+            log_batch_drain(batch);
+            pthread_mutex_destroy(&batch->lock);
+            pthread_mutex_destroy(&batch->write_lock);
+            free(batch->buf);
+            free(batch->spare);
+            free(batch);
+        }
+
+        pthread_mutex_lock(&log_batch_list_lock);
+        if (log_batch_wakeup) {
+            /* signalled while the lock was dropped */
+            continue;
+        }
+        clock_gettime(CLOCK_REALTIME, &ts);
+        wake -= log_batch_now_ms();
+        if (wake < 0) {
+            wake = 0;
+        }
+        ts.tv_sec += wake / 1000;
+        ts.tv_nsec += (wake % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&log_batch_cond, &log_batch_list_lock, &ts);
+    }
+    return NULL;
+}
+
+static void log_batch_detach(void *arg)
+{
+    struct log_batch *batch = (struct log_batch *) arg;
+
+    /* the writer flushes what is left and frees it */
+    pthread_mutex_lock(&log_batch_list_lock);
+    batch->detached = 1;
+    log_batch_wakeup = 1;
+    pthread_cond_signal(&log_batch_cond);
+    pthread_mutex_unlock(&log_batch_list_lock);
+}
+
+static void log_batch_init(void)
+{
+    pthread_key_create(&log_batch_key, log_batch_detach);
+}
+
+/*
+ * Returns 0 if batching is off for this thread and the caller should write
+ * the record itself.  Otherwise returns 1 with the result of the write, or
+ * the number of bytes queued, stored in *ret.
+ */
+static int log_batch_write(log_id_t log_id, int prio, struct iovec *vec,
+        size_t nr, int *ret)
+{
+    struct log_batch *batch;
+    struct log_record *rec;
+    size_t i, len = 0, size;
+    int wake;
+    char *p;
+
+    pthread_once(&log_batch_once, log_batch_init);
+    batch = (struct log_batch *) pthread_getspecific(log_batch_key);
+    if (batch == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < nr; i++) {
+        len += vec[i].iov_len;
+    }
+    size = (sizeof(*rec) + len + 3) & ~3;
+
+    if (prio >= batch->flush_prio || size > LOG_BATCH_SIZE - LOG_BATCH_HIGH_WATER) {
+        log_batch_drain(batch);
+        *ret = write_to_log(log_id, vec, nr);
+        return 1;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    if (batch->len + size > LOG_BATCH_SIZE) {
+        /* the writer has fallen behind; push back on the producer */
+        pthread_mutex_unlock(&batch->lock);
+        log_batch_drain(batch);
+        pthread_mutex_lock(&batch->lock);
+    }
+    if (batch->len == 0) {
+        batch->oldest_ms = log_batch_now_ms();
+    }
+    rec = (struct log_record *) (batch->buf + batch->len);
+    rec->nr = nr;
+    rec->log_id = log_id;
+    p = (char *) (rec + 1);
+    for (i = 0; i < nr; i++) {
+        rec->iov_len[i] = vec[i].iov_len;
+        memcpy(p, vec[i].iov_base, vec[i].iov_len);
+        p += vec[i].iov_len;
+    }
+    batch->len += size;
+    wake = batch->len >= LOG_BATCH_HIGH_WATER
+            && batch->len - size < LOG_BATCH_HIGH_WATER;
+    pthread_mutex_unlock(&batch->lock);
+
+    if (wake) {
+        pthread_mutex_lock(&log_batch_list_lock);
+        log_batch_wakeup = 1;
+        pthread_cond_signal(&log_batch_cond);
+        pthread_mutex_unlock(&log_batch_list_lock);
+    }
+    *ret = len;
+    return 1;
+}
+
+int __android_log_batch_begin(int flushPrio, int flushIntervalMs)
+{
+    struct log_batch *batch;
+
+    pthread_once(&log_batch_once, log_batch_init);
+
+    batch = (struct log_batch *) pthread_getspecific(log_batch_key);
+    if (batch != NULL) {
+        /* already batching; just update the policy */
+        batch->flush_prio = flushPrio;
+        batch->flush_interval_ms = flushIntervalMs;
+        return 0;
+    }
+
+    batch = (struct log_batch *) calloc(1, sizeof(*batch));
+    if (batch == NULL) {
+        return -ENOMEM;
+    }
+    batch->buf = (char *) malloc(LOG_BATCH_SIZE);
+    batch->spare = (char *) malloc(LOG_BATCH_SIZE);
+    if (batch->buf == NULL || batch->spare == NULL) {
+        free(batch->buf);
+        free(batch->spare);
+        free(batch);
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_mutex_init(&batch->write_lock, NULL);
+    batch->flush_prio = flushPrio;
+    batch->flush_interval_ms = flushIntervalMs;
+
+    pthread_mutex_lock(&log_batch_list_lock);
+    if (!log_batch_writer_started) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        int err;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        err = pthread_create(&thread, &attr, log_batch_writer, NULL);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            pthread_mutex_unlock(&log_batch_list_lock);
+            pthread_mutex_destroy(&batch->lock);
+            pthread_mutex_destroy(&batch->write_lock);
+            free(batch->buf);
+            free(batch->spare);
+            free(batch);
+            return -err;
+        }
+        log_batch_writer_started = 1;
+    }
+    batch->next = log_batch_list;
+    log_batch_list = batch;
+    pthread_mutex_unlock(&log_batch_list_lock);
+
+    pthread_setspecific(log_batch_key, batch);
+    return 0;
+}
+
+int __android_log_batch_flush(void)
+{
+    struct log_batch *batch;
+
+    pthread_once(&log_batch_once, log_batch_init);
+    batch = (struct log_batch *) pthread_getspecific(log_batch_key);
+    if (batch != NULL) {
+        log_batch_drain(batch);
+    }
+    return 0;
+}
+
+int __android_log_batch_end(void)
+{
+    struct log_batch *batch;
+
+    pthread_once(&log_batch_once, log_batch_init);
+    batch = (struct log_batch *) pthread_getspecific(log_batch_key);
+    if (batch != NULL) {
+        pthread_setspecific(log_batch_key, NULL);
+        log_batch_drain(batch);
+        log_batch_detach(batch);
+    }
+    return 0;
+}
+
+#else /* !HAVE_PTHREADS */
+
+static int log_batch_write(log_id_t log_id, int prio, struct iovec *vec,
+        size_t nr, int *ret)
+{
+    return 0;
+}
+
+int __android_log_batch_begin(int flushPrio, int flushIntervalMs)
+{
+    return -ENOSYS;
+}
+
+int __android_log_batch_flush(void)
+{
+    return 0;
+}
+
+int __android_log_batch_end(void)
+{
+    return 0;
+}
+
+#endif /* HAVE_PTHREADS */
+
+static int write_to_log_batched(log_id_t log_id, int prio, struct iovec *vec,
+        size_t nr)
+{
+    int ret;
+
+    if (!log_batch_write(log_id, prio, vec, nr, &ret)) {
+        ret = write_to_log(log_id, vec, nr);
+    }
+    return ret;
+}
+
 int __android_log_write(int prio, const char *tag, const char *msg)
 {
     struct iovec vec[3];
@@ -164,7 +536,7 @@ int __android_log_write(int prio, const char *tag, const char *msg)
     vec[2].iov_base   = (void *) msg;
     vec[2].iov_len    = strlen(msg) + 1;
 
-    return write_to_log(log_id, vec, 3);
+    return write_to_log_batched(log_id, prio, vec, 3);
 }
 
 int __android_log_buf_write(int bufID, int prio, const char *tag, const char *msg)
@@ -199,7 +571,7 @@ int __android_log_buf_write(int bufID, int prio, const char *tag, const char *ms
     vec[2].iov_base   = (void *) msg;
     vec[2].iov_len    = strlen(msg) + 1;
 
-    return write_to_log(bufID, vec, 3);
+    return write_to_log_batched(bufID, prio, vec, 3);
 }
 
 int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap)
@@ -270,7 +642,7 @@ int __android_log_bwrite(int32_t tag, const void *payload, size_t len)
     vec[1].iov_base = (void*)payload;
     vec[1].iov_len = len;
 
-    return write_to_log(LOG_ID_EVENTS, vec, 2);
+    return write_to_log_batched(LOG_ID_EVENTS, ANDROID_LOG_INFO, vec, 2);
 }
 
 /*
@@ -290,5 +662,5 @@ int __android_log_btwrite(int32_t tag, char type, const void *payload,
     vec[2].iov_base = (void*)payload;
     vec[2].iov_len = len;
 
-    return write_to_log(LOG_ID_EVENTS, vec, 3);
+    return write_to_log_batched(LOG_ID_EVENTS, ANDROID_LOG_INFO, vec, 3);
 }
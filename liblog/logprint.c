@@ -24,6 +24,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 
 #include <log/logd.h>
@@ -31,6 +33,7 @@
 
 typedef struct FilterInfo_t {
     char *mTag;
+    uint32_t mHash;
     android_LogPriority mPri;
     struct FilterInfo_t *p_next;
 } FilterInfo;
@@ -39,14 +42,40 @@ struct AndroidLogFormat_t {
     android_LogPriority global_pri;
     FilterInfo *filters;
     AndroidLogPrintFormat format;
+
+    /*
+     * Open-addressed index over 'filters', keyed by tag, so that the
+     * per-line filter decision doesn't have to walk the list.  Each slot
+     * points at the most recently added rule for its tag, which is the
+     * one the list walk would have found first.  The size is a power of
+     * two and the table is kept at most half full.
+     */
+    FilterInfo **filterTable;
+    size_t filterTableSize;
+    size_t filterTableCount;
 };
 
+#define FILTER_TABLE_MIN_SIZE 16
+
+/* FNV-1a; tags are short and this is cheap to compute inline */
+static uint32_t hashTag(const char *tag)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*tag) {
+        hash ^= (unsigned char) *tag++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 static FilterInfo * filterinfo_new(const char * tag, android_LogPriority pri)
 {
     FilterInfo *p_ret;
 
     p_ret = (FilterInfo *)calloc(1, sizeof(FilterInfo));
     p_ret->mTag = strdup(tag);
+    p_ret->mHash = hashTag(tag);
     p_ret->mPri = pri;
 
     return p_ret;
@@ -118,10 +147,89 @@ static char filterPriToChar (android_LogPriority pri)
     }
 }
 
+/*
+ * Stores p_fi in the slot for its tag, replacing any older rule for the
+ * same tag.  Returns 1 if a new slot was used.
+ */
+static int filterTablePut(FilterInfo **table, size_t size, FilterInfo *p_fi)
+{
+    size_t mask = size - 1;
+    size_t i = p_fi->mHash & mask;
+
+    while (table[i] != NULL) {
+        if (table[i]->mHash == p_fi->mHash
+                && 0 == strcmp(table[i]->mTag, p_fi->mTag)) {
+            table[i] = p_fi;
+            return 0;
+        }
+        i = (i + 1) & mask;
+    }
+    table[i] = p_fi;
+    return 1;
+}
+
+static int filterTableAdd(AndroidLogFormat *p_format, FilterInfo *p_fi)
+{
+    if ((p_format->filterTableCount + 1) * 2 > p_format->filterTableSize) {
+        size_t newSize = p_format->filterTableSize
+                ? p_format->filterTableSize * 2 : FILTER_TABLE_MIN_SIZE;
+        FilterInfo **newTable;
+        size_t i;
+
+        newTable = (FilterInfo **)calloc(newSize, sizeof(FilterInfo *));
+        if (newTable == NULL) {
+            return -1;
+        }
+        for (i = 0; i < p_format->filterTableSize; i++) {
+            if (p_format->filterTable[i] != NULL) {
+                filterTablePut(newTable, newSize, p_format->filterTable[i]);
+            }
+        }
+        free(p_format->filterTable);
+        p_format->filterTable = newTable;
+        p_format->filterTableSize = newSize;
+    }
+
+    p_format->filterTableCount += filterTablePut(p_format->filterTable,
+            p_format->filterTableSize, p_fi);
+    return 0;
+}
+
 static android_LogPriority filterPriForTag(
         AndroidLogFormat *p_format, const char *tag)
 {
     FilterInfo *p_curFilter;
+    uint32_t hash;
+    size_t mask, i;
+
+    if (p_format->filterTableCount == 0) {
+        return p_format->global_pri;
+    }
+
+    hash = hashTag(tag);
+    mask = p_format->filterTableSize - 1;
+
+    for (i = hash & mask
+            ; (p_curFilter = p_format->filterTable[i]) != NULL
+            ; i = (i + 1) & mask
+    ) {
+        if (p_curFilter->mHash == hash && 0 == strcmp(tag, p_curFilter->mTag)) {
+            if (p_curFilter->mPri == ANDROID_LOG_DEFAULT) {
+                return p_format->global_pri;
+            } else {
+                return p_curFilter->mPri;
+            }
+        }
+    }
+
+    return p_format->global_pri;
+}
+
+/** reference implementation of filterPriForTag(), for the tests */
+static android_LogPriority filterPriForTagLinear(
+        AndroidLogFormat *p_format, const char *tag)
+{
+    FilterInfo *p_curFilter;
 
     for (p_curFilter = p_format->filters
             ; p_curFilter != NULL
@@ -188,9 +296,11 @@ void android_log_format_free(AndroidLogFormat *p_format)
         p_info_old = p_info;
         p_info = p_info->p_next;
 
+        filterinfo_free(p_info_old);
         free(p_info_old);
     }
 
+    free(p_format->filterTable);
     free(p_format);
 }
 
@@ -283,6 +393,12 @@ int android_log_addFilterRule(AndroidLogFormat *p_format,
         FilterInfo *p_fi = filterinfo_new(tagName, pri);
         free(tagName);
 
+        if (filterTableAdd(p_format, p_fi) < 0) {
+            filterinfo_free(p_fi);
+            free(p_fi);
+            goto error;
+        }
+
         p_fi->p_next = p_format->filters;
         p_format->filters = p_fi;
     }
@@ -1000,6 +1116,165 @@ void logprint_run_tests()
     err = android_log_addFilterString(p_format, "*:s random:z");
     assert(err < 0);
 
+    android_log_format_free(p_format);
+
+    // Many rules: the indexed lookup must agree with a walk of the list,
+    // including for tags that were overridden and tags with no rule.
+    {
+        enum { kRules = 64, kLookups = 1000000 };
+        static const char priChars[] = "vdiwefs";
+        char tags[kRules * 2][16];
+        struct timespec start, end;
+        long long hashedNs, linearNs;
+        int i, printed;
+
+        p_format = android_log_format_new();
+        android_log_addFilterRule(p_format, "*:w");
+
+        for (i = 0; i < kRules * 2; i++) {
+            snprintf(tags[i], sizeof(tags[i]), "Tag%d", i);
+        }
+        for (i = 0; i < kRules; i++) {
+            char rule[24];
+            snprintf(rule, sizeof(rule), "%s:%c", tags[i], priChars[i % 7]);
+            err = android_log_addFilterRule(p_format, rule);
+            assert(err == 0);
+        }
+        // override a few, the newest rule wins
+        android_log_addFilterRule(p_format, "Tag3:s");
+        android_log_addFilterRule(p_format, "Tag40");
+
+        for (i = 0; i < kRules * 2; i++) {
+            assert(filterPriForTag(p_format, tags[i])
+                    == filterPriForTagLinear(p_format, tags[i]));
+        }
+        assert(ANDROID_LOG_SILENT == filterPriForTag(p_format, "Tag3"));
+        assert(ANDROID_LOG_VERBOSE == filterPriForTag(p_format, "Tag40"));
+        assert(ANDROID_LOG_WARN == filterPriForTag(p_format, "Tag100"));
+
+        // microbenchmark: a mix of filtered and unfiltered tags
+        printed = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < kLookups; i++) {
+            printed += android_log_shouldPrintLine(p_format,
+                    tags[i % (kRules * 2)], ANDROID_LOG_INFO);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        hashedNs = (end.tv_sec - start.tv_sec) * 1000000000LL
+                + (end.tv_nsec - start.tv_nsec);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < kLookups; i++) {
+            printed -= ANDROID_LOG_INFO >= filterPriForTagLinear(p_format,
+                    tags[i % (kRules * 2)]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        linearNs = (end.tv_sec - start.tv_sec) * 1000000000LL
+                + (end.tv_nsec - start.tv_nsec);
+        assert(printed == 0);
+
+        fprintf(stderr, "filter lookup, %d rules: %lld ns/line indexed, "
+                "%lld ns/line linear\n", kRules,
+                hashedNs / kLookups, linearNs / kLookups);
+
+        android_log_format_free(p_format);
+    }
+
+    // Event tag map: opening parses the text and writes nothing; once the
+    // build-time index exists, opens map it.  Both must resolve identically,
+    // and an index built from other contents must be ignored.
+    {
+        enum { kTags = 2000, kOpens = 100, kTagLookups = 1000000 };
+        const char *tmpDir = getenv("TMPDIR");
+        char mapName[256], indexName[256];
+        struct timespec start, end;
+        long long parseNs, indexNs, lookupNs;
+        EventTagMap *textMap, *indexMap;
+        FILE *fp;
+        int i, found;
+
+        if (tmpDir == NULL)
+            tmpDir = "/data/local/tmp";
+        snprintf(mapName, sizeof(mapName), "%s/logprint-tags.%d",
+                tmpDir, getpid());
+        snprintf(indexName, sizeof(indexName), "%s.idx", mapName);
+
+        fp = fopen(mapName, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "skipping event tag map test: can't write %s\n",
+                    mapName);
+            goto tagmap_done;
+        }
+        fprintf(fp, "# generated by logprint_run_tests\n");
+        for (i = kTags - 1; i >= 0; i--) {
+            fprintf(fp, "%d event_tag_%d (value|1)\n", i * 3, i);
+        }
+        fclose(fp);
+        unlink(indexName);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        textMap = android_openEventTagMap(mapName);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        parseNs = (end.tv_sec - start.tv_sec) * 1000000000LL
+                + (end.tv_nsec - start.tv_nsec);
+        assert(textMap != NULL);
+        assert(access(indexName, F_OK) != 0);
+        assert(android_writeEventTagIndex(mapName, indexName) == 0);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < kOpens; i++) {
+            indexMap = android_openEventTagMap(mapName);
+            assert(indexMap != NULL);
+            if (i != kOpens - 1)
+                android_closeEventTagMap(indexMap);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        indexNs = (end.tv_sec - start.tv_sec) * 1000000000LL
+                + (end.tv_nsec - start.tv_nsec);
+
+        for (i = 0; i < kTags * 3; i++) {
+            const char *a = android_lookupEventTag(textMap, i);
+            const char *b = android_lookupEventTag(indexMap, i);
+            assert((a == NULL) == (b == NULL));
+            assert(a == NULL || strcmp(a, b) == 0);
+            assert((a != NULL) == (i % 3 == 0));
+        }
+
+        found = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < kTagLookups; i++) {
+            found += android_lookupEventTag(indexMap, i % (kTags * 3)) != NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        lookupNs = (end.tv_sec - start.tv_sec) * 1000000000LL
+                + (end.tv_nsec - start.tv_nsec);
+        assert(found > 0);
+
+        fprintf(stderr, "event tag map, %d tags: %lld us parsed open, "
+                "%lld us indexed open, %lld ns/lookup\n", kTags,
+                parseNs / 1000, indexNs / kOpens / 1000,
+                lookupNs / kTagLookups);
+
+        android_closeEventTagMap(textMap);
+        android_closeEventTagMap(indexMap);
+
+        // Same size, one tag renamed: the index no longer applies.
+        fp = fopen(mapName, "r+");
+        assert(fp != NULL);
+        fprintf(fp, "# generated by logprint_run_tests\n%d event_tag_XXXX",
+                (kTags - 1) * 3);
+        fclose(fp);
+        textMap = android_openEventTagMap(mapName);
+        assert(textMap != NULL);
+        assert(strcmp(android_lookupEventTag(textMap, (kTags - 1) * 3),
+                "event_tag_XXXX") == 0);
+        android_closeEventTagMap(textMap);
+
+        unlink(indexName);
+        unlink(mapName);
+    }
+tagmap_done:
+
 
 #if 0
     char *ret;
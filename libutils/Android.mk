@@ -64,7 +64,7 @@ endif
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= $(commonSources)
 ifeq ($(HOST_OS), linux)
-LOCAL_SRC_FILES += Looper.cpp
+LOCAL_SRC_FILES += Looper.cpp ThreadPool.cpp
 endif
 LOCAL_MODULE:= libutils
 LOCAL_STATIC_LIBRARIES := liblog
@@ -78,7 +78,7 @@ include $(BUILD_HOST_STATIC_LIBRARY)
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= $(commonSources)
 ifeq ($(HOST_OS), linux)
-LOCAL_SRC_FILES += Looper.cpp
+LOCAL_SRC_FILES += Looper.cpp ThreadPool.cpp
 endif
 LOCAL_MODULE:= lib64utils
 LOCAL_STATIC_LIBRARIES := liblog
@@ -96,6 +96,7 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
 	$(commonSources) \
 	Looper.cpp \
+	ThreadPool.cpp \
 	Trace.cpp
 
 ifeq ($(TARGET_OS),linux)
@@ -22,6 +22,7 @@
 
 #include <utils/BlobCache.h>
 #include <utils/Errors.h>
+#include <utils/JenkinsHash.h>
 #include <utils/Log.h>
 
 namespace android {
@@ -39,16 +40,8 @@ BlobCache::BlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize
         mMaxKeySize(maxKeySize),
         mMaxValueSize(maxValueSize),
         mMaxTotalSize(maxTotalSize),
-        mTotalSize(0) {
-    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-#ifdef _WIN32
-    srand(now);
-#else
-    mRandState[0] = (now >> 0) & 0xFFFF;
-    mRandState[1] = (now >> 16) & 0xFFFF;
-    mRandState[2] = (now >> 32) & 0xFFFF;
-#endif
-    ALOGV("initializing random seed using %lld", now);
+        mCacheEntries(LruCache<Key, sp<Blob> >::kUnlimitedCapacity) {
+    mCacheEntries.setMaxSize(maxTotalSize, &mSizer);
 }
 
 void BlobCache::set(const void* key, size_t keySize, const void* value,
@@ -77,57 +70,15 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
         return;
     }
 
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
-
-    while (true) {
-        ssize_t index = mCacheEntries.indexOf(dummyEntry);
-        if (index < 0) {
-            // Create a new cache entry.
-            sp<Blob> keyBlob(new Blob(key, keySize, true));
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
-            size_t newTotalSize = mTotalSize + keySize + valueSize;
-            if (mMaxTotalSize < newTotalSize) {
-                if (isCleanable()) {
-                    // Clean the cache and try again.
-                    clean();
-                    continue;
-                } else {
-                    ALOGV("set: not caching new key/value pair because the "
-                            "total cache size limit would be exceeded: %d "
-                            "(limit: %d)",
-                            keySize + valueSize, mMaxTotalSize);
-                    break;
-                }
-            }
-            mCacheEntries.add(CacheEntry(keyBlob, valueBlob));
-            mTotalSize = newTotalSize;
-            ALOGV("set: created new cache entry with %d byte key and %d byte value",
-                    keySize, valueSize);
-        } else {
-            // Update the existing cache entry.
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
-            sp<Blob> oldValueBlob(mCacheEntries[index].getValue());
-            size_t newTotalSize = mTotalSize + valueSize - oldValueBlob->getSize();
-            if (mMaxTotalSize < newTotalSize) {
-                if (isCleanable()) {
-                    // Clean the cache and try again.
-                    clean();
-                    continue;
-                } else {
-                    ALOGV("set: not caching new value because the total cache "
-                            "size limit would be exceeded: %d (limit: %d)",
-                            keySize + valueSize, mMaxTotalSize);
-                    break;
-                }
-            }
-            mCacheEntries.editItemAt(index).setValue(valueBlob);
-            mTotalSize = newTotalSize;
-            ALOGV("set: updated existing cache entry with %d byte key and %d byte "
-                    "value", keySize, valueSize);
-        }
-        break;
-    }
+    // Drop any previous value first so that its space counts as free.  The
+    // new pair always fits once enough older entries have been evicted, since
+    // it is no larger than mMaxTotalSize.
+    bool replaced = mCacheEntries.remove(Key(key, keySize));
+    sp<Blob> keyBlob(new Blob(key, keySize, true));
+    sp<Blob> valueBlob(new Blob(value, valueSize, true));
+    mCacheEntries.put(Key(keyBlob), valueBlob);
+    ALOGV("set: %s cache entry with %d byte key and %d byte value",
+            replaced ? "updated existing" : "created new", keySize, valueSize);
 }
 
 size_t BlobCache::get(const void* key, size_t keySize, void* value,
@@ -137,17 +88,14 @@ size_t BlobCache::get(const void* key, size_t keySize, void* value,
                 keySize, mMaxKeySize);
         return 0;
     }
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
-    ssize_t index = mCacheEntries.indexOf(dummyEntry);
-    if (index < 0) {
+    const sp<Blob>& valueBlob = mCacheEntries.get(Key(key, keySize));
+    if (valueBlob == NULL) {
         ALOGV("get: no cache entry found for key of size %d", keySize);
         return 0;
     }
 
     // The key was found. Return the value if the caller's buffer is large
     // enough.
-    sp<Blob> valueBlob(mCacheEntries[index].getValue());
     size_t valueBlobSize = valueBlob->getSize();
     if (valueBlobSize <= valueSize) {
         ALOGV("get: copying %d bytes to caller's buffer", valueBlobSize);
@@ -165,13 +113,11 @@ static inline size_t align4(size_t size) {
 
 size_t BlobCache::getFlattenedSize() const {
     size_t size = sizeof(Header);
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
-        sp<Blob> valueBlob = e.getValue();
+    LruCache<Key, sp<Blob> >::Iterator it(mCacheEntries);
+    while (it.next()) {
         size = align4(size);
-        size += sizeof(EntryHeader) + keyBlob->getSize() +
-                valueBlob->getSize();
+        size += sizeof(EntryHeader) + it.key().getSize() +
+                it.value()->getSize();
     }
     return size;
 }
@@ -188,14 +134,15 @@ status_t BlobCache::flatten(void* buffer, size_t size) const {
     header->mDeviceVersion = blobCacheDeviceVersion;
     header->mNumEntries = mCacheEntries.size();
 
-    // Write cache entries
+    // Write cache entries oldest first, so that unflatten() re-inserting them
+    // in order rebuilds the same LRU order.
     uint8_t* byteBuffer = reinterpret_cast<uint8_t*>(buffer);
     off_t byteOffset = align4(sizeof(Header));
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
-        sp<Blob> valueBlob = e.getValue();
-        size_t keySize = keyBlob->getSize();
+    LruCache<Key, sp<Blob> >::Iterator it(mCacheEntries);
+    while (it.next()) {
+        const Key& key(it.key());
+        const sp<Blob>& valueBlob(it.value());
+        size_t keySize = key.getSize();
         size_t valueSize = valueBlob->getSize();
 
         size_t entrySize = sizeof(EntryHeader) + keySize + valueSize;
@@ -209,7 +156,7 @@ status_t BlobCache::flatten(void* buffer, size_t size) const {
         eheader->mKeySize = keySize;
         eheader->mValueSize = valueSize;
 
-        memcpy(eheader->mData, keyBlob->getData(), keySize);
+        memcpy(eheader->mData, key.getData(), keySize);
         memcpy(eheader->mData + keySize, valueBlob->getData(), valueSize);
 
         byteOffset += align4(entrySize);
@@ -270,27 +217,8 @@ status_t BlobCache::unflatten(void const* buffer, size_t size) {
     return OK;
 }
 
-long int BlobCache::blob_random() {
-#ifdef _WIN32
-    return rand();
-#else
-    return nrand48(mRandState);
-#endif
-}
-
-void BlobCache::clean() {
-    // Remove a random cache entry until the total cache size gets below half
-    // the maximum total cache size.
-    while (mTotalSize > mMaxTotalSize / 2) {
-        size_t i = size_t(blob_random() % (mCacheEntries.size()));
-        const CacheEntry& entry(mCacheEntries[i]);
-        mTotalSize -= entry.getKey()->getSize() + entry.getValue()->getSize();
-        mCacheEntries.removeAt(i);
-    }
-}
-
-bool BlobCache::isCleanable() const {
-    return mTotalSize > mMaxTotalSize / 2;
+size_t BlobCache::Sizer::operator()(const Key& key, const sp<Blob>& value) {
+    return key.getSize() + value->getSize();
 }
 
 BlobCache::Blob::Blob(const void* data, size_t size, bool copyData):
@@ -308,14 +236,6 @@ BlobCache::Blob::~Blob() {
     }
 }
 
-bool BlobCache::Blob::operator<(const Blob& rhs) const {
-    if (mSize == rhs.mSize) {
-        return memcmp(mData, rhs.mData, mSize) < 0;
-    } else {
-        return mSize < rhs.mSize;
-    }
-}
-
 const void* BlobCache::Blob::getData() const {
     return mData;
 }
@@ -324,39 +244,24 @@ size_t BlobCache::Blob::getSize() const {
     return mSize;
 }
 
-BlobCache::CacheEntry::CacheEntry() {
-}
-
-BlobCache::CacheEntry::CacheEntry(const sp<Blob>& key, const sp<Blob>& value):
-        mKey(key),
-        mValue(value) {
-}
-
-BlobCache::CacheEntry::CacheEntry(const CacheEntry& ce):
-        mKey(ce.mKey),
-        mValue(ce.mValue) {
-}
-
-bool BlobCache::CacheEntry::operator<(const CacheEntry& rhs) const {
-    return *mKey < *rhs.mKey;
-}
-
-const BlobCache::CacheEntry& BlobCache::CacheEntry::operator=(const CacheEntry& rhs) {
-    mKey = rhs.mKey;
-    mValue = rhs.mValue;
-    return *this;
-}
-
-sp<BlobCache::Blob> BlobCache::CacheEntry::getKey() const {
-    return mKey;
+BlobCache::Key::Key(const void* data, size_t size):
+        mData(data),
+        mSize(size),
+        mHash(JenkinsHashWhiten(JenkinsHashMixBytes(0,
+                static_cast<const uint8_t*>(data), size))) {
 }
 
-sp<BlobCache::Blob> BlobCache::CacheEntry::getValue() const {
-    return mValue;
+BlobCache::Key::Key(const sp<Blob>& blob):
+        mBlob(blob),
+        mData(blob->getData()),
+        mSize(blob->getSize()),
+        mHash(JenkinsHashWhiten(JenkinsHashMixBytes(0,
+                static_cast<const uint8_t*>(mData), mSize))) {
 }
 
-void BlobCache::CacheEntry::setValue(const sp<Blob>& value) {
-    mValue = value;
+bool BlobCache::Key::operator==(const Key& rhs) const {
+    return mHash == rhs.mHash && mSize == rhs.mSize &&
+            memcmp(mData, rhs.mData, mSize) == 0;
 }
 
 } // namespace android
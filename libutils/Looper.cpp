@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/eventfd.h>
 
 
 namespace android {
@@ -67,22 +68,34 @@ static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
 Looper::Looper(bool allowNonCallbacks) :
-        mAllowNonCallbacks(allowNonCallbacks), mSendingMessage(false),
+        mAllowNonCallbacks(allowNonCallbacks), mNextMessageSeq(0), mSendingMessage(false),
         mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
-    int wakeFds[2];
-    int result = pipe(wakeFds);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not create wake pipe.  errno=%d", errno);
+    int result;
+    mWakePending = 0;
+
+    // Prefer an eventfd: it is a single descriptor and a single read clears it.
+    int wakeFd = eventfd(0, EFD_NONBLOCK);
+    if (wakeFd >= 0) {
+        mWakeReadPipeFd = wakeFd;
+        mWakeWritePipeFd = wakeFd;
+        mWakeIsEventFd = true;
+    } else {
+        int wakeFds[2];
+        result = pipe(wakeFds);
+        LOG_ALWAYS_FATAL_IF(result != 0, "Could not create wake pipe.  errno=%d", errno);
 
-    mWakeReadPipeFd = wakeFds[0];
-    mWakeWritePipeFd = wakeFds[1];
+        mWakeReadPipeFd = wakeFds[0];
+        mWakeWritePipeFd = wakeFds[1];
+        mWakeIsEventFd = false;
 
-    result = fcntl(mWakeReadPipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake read pipe non-blocking.  errno=%d",
-            errno);
+        result = fcntl(mWakeReadPipeFd, F_SETFL, O_NONBLOCK);
+        LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake read pipe non-blocking.  errno=%d",
+                errno);
 
-    result = fcntl(mWakeWritePipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake write pipe non-blocking.  errno=%d",
-            errno);
+        result = fcntl(mWakeWritePipeFd, F_SETFL, O_NONBLOCK);
+        LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake write pipe non-blocking.  errno=%d",
+                errno);
+    }
 
     mIdling = false;
 
@@ -101,7 +114,9 @@ Looper::Looper(bool allowNonCallbacks) :
 
 Looper::~Looper() {
     close(mWakeReadPipeFd);
-    close(mWakeWritePipeFd);
+    if (!mWakeIsEventFd) {
+        close(mWakeWritePipeFd);
+    }
     close(mEpollFd);
 }
 
@@ -262,14 +277,14 @@ int Looper::pollInner(int timeoutMillis) {
                 ALOGW("Ignoring unexpected epoll events 0x%x on wake read pipe.", epollEvents);
             }
         } else {
-            ssize_t requestIndex = mRequests.indexOfKey(fd);
+            ssize_t requestIndex = indexOfRequestLocked(fd);
             if (requestIndex >= 0) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= ALOOPER_EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= ALOOPER_EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= ALOOPER_EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= ALOOPER_EVENT_HANGUP;
-                pushResponse(events, mRequests.valueAt(requestIndex));
+                pushResponse(events, mRequests.itemAt(requestIndex));
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
@@ -291,7 +306,7 @@ Done: ;
             { // obtain handler
                 sp<MessageHandler> handler = messageEnvelope.handler;
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                dequeueMessageLocked();
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -370,14 +385,29 @@ void Looper::wake() {
     ALOGD("%p ~ wake", this);
 #endif
 
+    // Only the first caller since the looper last woke up needs to signal.
+    if (android_atomic_release_cas(0, 1, &mWakePending) != 0) {
+        return;
+    }
+
     ssize_t nWrite;
-    do {
-        nWrite = write(mWakeWritePipeFd, "W", 1);
-    } while (nWrite == -1 && errno == EINTR);
+    if (mWakeIsEventFd) {
+        uint64_t inc = 1;
+        do {
+            nWrite = write(mWakeWritePipeFd, &inc, sizeof(inc));
+        } while (nWrite == -1 && errno == EINTR);
+        nWrite = nWrite == sizeof(inc) ? 1 : -1;
+    } else {
+        do {
+            nWrite = write(mWakeWritePipeFd, "W", 1);
+        } while (nWrite == -1 && errno == EINTR);
+    }
 
     if (nWrite != 1) {
         if (errno != EAGAIN) {
             ALOGW("Could not write wake signal, errno=%d", errno);
+            // Nothing was signalled, so don't make later callers skip it.
+            android_atomic_release_store(0, &mWakePending);
         }
     }
 }
@@ -387,11 +417,23 @@ void Looper::awoken() {
     ALOGD("%p ~ awoken", this);
 #endif
 
-    char buffer[16];
     ssize_t nRead;
-    do {
-        nRead = read(mWakeReadPipeFd, buffer, sizeof(buffer));
-    } while ((nRead == -1 && errno == EINTR) || nRead == sizeof(buffer));
+    if (mWakeIsEventFd) {
+        uint64_t counter;
+        do {
+            nRead = read(mWakeReadPipeFd, &counter, sizeof(counter));
+        } while (nRead == -1 && errno == EINTR);
+    } else {
+        char buffer[16];
+        do {
+            nRead = read(mWakeReadPipeFd, buffer, sizeof(buffer));
+        } while ((nRead == -1 && errno == EINTR) || nRead == sizeof(buffer));
+    }
+
+    // Clear the flag only after draining the fd.  A wake() that races with us
+    // either sees the flag still set, in which case whatever it posted will be
+    // picked up by the rest of this poll, or signals the fd anew.
+    android_atomic_release_store(0, &mWakePending);
 }
 
 void Looper::pushResponse(int events, const Request& request) {
@@ -401,6 +443,13 @@ void Looper::pushResponse(int events, const Request& request) {
     mResponses.push(response);
 }
 
+ssize_t Looper::indexOfRequestLocked(int fd) const {
+    if (fd >= 0 && size_t(fd) < mRequests.size() && mRequests.itemAt(fd).fd == fd) {
+        return fd;
+    }
+    return NAME_NOT_FOUND;
+}
+
 int Looper::addFd(int fd, int ident, int events, ALooper_callbackFunc callback, void* data) {
     return addFd(fd, ident, events, callback ? new SimpleLooperCallback(callback) : NULL, data);
 }
@@ -443,21 +492,34 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
         eventItem.events = epollEvents;
         eventItem.data.fd = fd;
 
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
+        ssize_t requestIndex = indexOfRequestLocked(fd);
         if (requestIndex < 0) {
+            if (fd < 0) {
+                ALOGE("Invalid attempt to add negative fd %d.", fd);
+                return -1;
+            }
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
             if (epollResult < 0) {
                 ALOGE("Error adding epoll events for fd %d, errno=%d", fd, errno);
                 return -1;
             }
-            mRequests.add(fd, request);
+            if (size_t(fd) >= mRequests.size()) {
+                mRequests.insertAt(Request(), mRequests.size(), fd + 1 - mRequests.size());
+            }
+            mRequests.editItemAt(fd) = request;
         } else {
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, & eventItem);
+            if (epollResult < 0 && errno == ENOENT) {
+                // The fd was closed without removeFd(), which dropped it from the
+                // epoll set, and the same number has since been reused.
+                ALOGW("Re-adding fd %d, which was closed without removeFd().", fd);
+                epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
+            }
             if (epollResult < 0) {
                 ALOGE("Error modifying epoll events for fd %d, errno=%d", fd, errno);
                 return -1;
             }
-            mRequests.replaceValueAt(requestIndex, request);
+            mRequests.editItemAt(requestIndex) = request;
         }
     } // release lock
     return 1;
@@ -470,7 +532,7 @@ int Looper::removeFd(int fd) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
+        ssize_t requestIndex = indexOfRequestLocked(fd);
         if (requestIndex < 0) {
             return 0;
         }
@@ -481,7 +543,7 @@ int Looper::removeFd(int fd) {
             return -1;
         }
 
-        mRequests.removeItemsAt(requestIndex);
+        mRequests.editItemAt(requestIndex) = Request();
     } // release lock
     return 1;
 }
@@ -504,17 +566,13 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
+    bool atHead;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        MessageEnvelope messageEnvelope(uptime, mNextMessageSeq++, handler, message);
+        enqueueMessageLocked(messageEnvelope);
+        atHead = mMessageEnvelopes.itemAt(0).seq == messageEnvelope.seq;
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -526,11 +584,103 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     } // release lock
 
     // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    if (atHead) {
         wake();
     }
 }
 
+void Looper::enqueueMessageLocked(const MessageEnvelope& messageEnvelope) {
+    // Append, then sift the new element up into place.
+    size_t i = mMessageEnvelopes.add(messageEnvelope);
+    MessageEnvelope* heap = mMessageEnvelopes.editArray();
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!messageEnvelope.isBefore(heap[parent])) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = messageEnvelope;
+}
+
+void Looper::dequeueMessageLocked() {
+    // Move the last element into the hole at the root and sift it down.
+    size_t size = mMessageEnvelopes.size() - 1;
+    if (size == 0) {
+        mMessageEnvelopes.clear();
+        return;
+    }
+
+    MessageEnvelope* heap = mMessageEnvelopes.editArray();
+    MessageEnvelope last = heap[size];
+    mMessageEnvelopes.removeAt(size);
+    heap = mMessageEnvelopes.editArray();
+
+    size_t i = 0;
+    for (;;) {
+        size_t child = i * 2 + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && heap[child + 1].isBefore(heap[child])) {
+            child += 1;
+        }
+        if (!heap[child].isBefore(last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+}
+
+void Looper::removeMessagesLocked(const sp<MessageHandler>& handler, bool matchWhat, int what) {
+    // Compact the survivors in one pass, then restore the heap property bottom-up.
+    // This is linear no matter how many messages are removed.
+    size_t size = mMessageEnvelopes.size();
+    if (size == 0) {
+        return;
+    }
+
+    MessageEnvelope* heap = mMessageEnvelopes.editArray();
+    size_t kept = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (heap[i].handler == handler && (!matchWhat || heap[i].message.what == what)) {
+            continue;
+        }
+        if (kept != i) {
+            heap[kept] = heap[i];
+        }
+        kept += 1;
+    }
+    if (kept == size) {
+        return;
+    }
+    mMessageEnvelopes.removeItemsAt(kept, size - kept);
+    heap = mMessageEnvelopes.editArray();
+
+    for (size_t start = kept / 2; start-- > 0; ) {
+        MessageEnvelope item = heap[start];
+        size_t i = start;
+        for (;;) {
+            size_t child = i * 2 + 1;
+            if (child >= kept) {
+                break;
+            }
+            if (child + 1 < kept && heap[child + 1].isBefore(heap[child])) {
+                child += 1;
+            }
+            if (!heap[child].isBefore(item)) {
+                break;
+            }
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = item;
+    }
+}
+
 void Looper::removeMessages(const sp<MessageHandler>& handler) {
 #if DEBUG_CALLBACKS
     ALOGD("%p ~ removeMessages - handler=%p", this, handler.get());
@@ -538,13 +688,7 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        removeMessagesLocked(handler, false, 0);
     } // release lock
 }
 
@@ -555,14 +699,7 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        removeMessagesLocked(handler, true, what);
     } // release lock
 }
 
@@ -110,9 +110,7 @@ bool PropertyMap::tryGetProperty(const String8& key, float& outValue) const {
 }
 
 void PropertyMap::addAll(const PropertyMap* map) {
-    for (size_t i = 0; i < map->mProperties.size(); i++) {
-        mProperties.add(map->mProperties.keyAt(i), map->mProperties.valueAt(i));
-    }
+    mProperties.merge(map->mProperties);
 }
 
 status_t PropertyMap::load(const String8& filename, PropertyMap** outMap) {
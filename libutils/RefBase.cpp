@@ -32,6 +32,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#if defined(HAVE_PTHREADS)
+# include <sched.h>
+#endif
+
 // compile with refcounting debugging enabled
 #define DEBUG_REFS                      0
 
@@ -55,6 +59,17 @@ namespace android {
 
 #define INITIAL_STRONG_VALUE (1<<28)
 
+// Most objects are never weakly referenced, so RefBase only creates its
+// weakref_impl on demand.  Until then RefBase::mState holds the strong count
+// (counting from INITIAL_STRONG_VALUE, like weakref_impl::mStrong) and each
+// strong reference stands for the weak reference it would otherwise hold.
+// inflateRefs() sets REFS_INFLATING, which stops the count from changing,
+// copies the counts into a new weakref_impl and then sets REFS_INFLATED;
+// from then on mState is no longer used.
+#define REFS_INFLATING      (1<<29)
+#define REFS_INFLATED       (1<<30)
+#define STRONG_COUNT_MASK   (REFS_INFLATING - 1)
+
 // ---------------------------------------------------------------------------
 
 class RefBase::weakref_impl : public RefBase::weakref_type
@@ -315,13 +330,82 @@ private:
 
 // ---------------------------------------------------------------------------
 
+RefBase::weakref_impl* RefBase::inflateRefs() const
+{
+    for (;;) {
+        const int32_t state = android_atomic_acquire_load(&mState);
+        if (state & REFS_INFLATED) {
+            return mRefs;
+        }
+        if (state & REFS_INFLATING) {
+            // another thread is inflating, it only has to allocate.
+#if defined(HAVE_PTHREADS)
+            sched_yield();
+#endif
+            continue;
+        }
+        if (android_atomic_acquire_cas(state, state | REFS_INFLATING, &mState) != 0) {
+            continue;
+        }
+
+        weakref_impl* const refs = new weakref_impl(const_cast<RefBase*>(this));
+        refs->mStrong = state;
+        if (state >= INITIAL_STRONG_VALUE) {
+            // never had a strong reference, or the first one is on its way
+            // in and will fix up mStrong itself.
+            refs->mWeak = state - INITIAL_STRONG_VALUE;
+        } else if (state == 0) {
+            // the last strong reference is being released and still holds
+            // its weak reference.
+            refs->mWeak = 1;
+        } else {
+            refs->mWeak = state;
+        }
+        mRefs = refs;
+        android_atomic_release_store(REFS_INFLATED, &mState);
+        return refs;
+    }
+}
+
+void RefBase::removeInitialStrong() const
+{
+    for (;;) {
+        const int32_t state = mState;
+        if (state & (REFS_INFLATING | REFS_INFLATED)) {
+            android_atomic_add(-INITIAL_STRONG_VALUE, &inflateRefs()->mStrong);
+            return;
+        }
+        if (android_atomic_release_cas(state, state - INITIAL_STRONG_VALUE, &mState) == 0) {
+            return;
+        }
+    }
+}
+
 void RefBase::incStrong(const void* id) const
 {
-    weakref_impl* const refs = mRefs;
+    int32_t state = mState;
+    while (!(state & (REFS_INFLATING | REFS_INFLATED))) {
+        if (android_atomic_cas_explicit(state, state + 1, &mState,
+                ANDROID_MEMORY_ORDER_RELAXED) == 0) {
+            ALOG_ASSERT(state > 0, "incStrong() called on %p after last strong ref", this);
+#if PRINT_REFS
+            ALOGD("incStrong of %p from %p: cnt=%d\n", this, id, state);
+#endif
+            if (state == INITIAL_STRONG_VALUE) {
+                removeInitialStrong();
+                const_cast<RefBase*>(this)->onFirstRef();
+            }
+            return;
+        }
+        state = mState;
+    }
+
+    weakref_impl* const refs = inflateRefs();
     refs->incWeak(id);
     
     refs->addStrongRef(id);
-    const int32_t c = android_atomic_inc(&refs->mStrong);
+    const int32_t c = android_atomic_add_explicit(1, &refs->mStrong,
+            ANDROID_MEMORY_ORDER_RELAXED);
     ALOG_ASSERT(c > 0, "incStrong() called on %p after last strong ref", refs);
 #if PRINT_REFS
     ALOGD("incStrong of %p from %p: cnt=%d\n", this, id, c);
@@ -336,14 +420,45 @@ void RefBase::incStrong(const void* id) const
 
 void RefBase::decStrong(const void* id) const
 {
-    weakref_impl* const refs = mRefs;
+    int32_t state = mState;
+    while (!(state & (REFS_INFLATING | REFS_INFLATED))) {
+        if (android_atomic_cas_explicit(state, state - 1, &mState,
+                ANDROID_MEMORY_ORDER_RELEASE) == 0) {
+#if PRINT_REFS
+            ALOGD("decStrong of %p from %p: cnt=%d\n", this, id, state);
+#endif
+            ALOG_ASSERT(state >= 1, "decStrong() called on %p too many times", this);
+            if (state != 1) {
+                return;
+            }
+            android_atomic_fence(ANDROID_MEMORY_ORDER_ACQUIRE);
+            const_cast<RefBase*>(this)->onLastStrongRef(id);
+            if (!(android_atomic_acquire_load(&mState) & REFS_INFLATED)) {
+                delete this;
+                return;
+            }
+            // onLastStrongRef() took a weak reference; finish below like an
+            // inflated object would.
+            weakref_impl* const refs = mRefs;
+            if ((refs->mFlags&OBJECT_LIFETIME_MASK) == OBJECT_LIFETIME_STRONG) {
+                delete this;
+            }
+            refs->decWeak(id);
+            return;
+        }
+        state = mState;
+    }
+
+    weakref_impl* const refs = inflateRefs();
     refs->removeStrongRef(id);
-    const int32_t c = android_atomic_dec(&refs->mStrong);
+    const int32_t c = android_atomic_add_explicit(-1, &refs->mStrong,
+            ANDROID_MEMORY_ORDER_RELEASE);
 #if PRINT_REFS
     ALOGD("decStrong of %p from %p: cnt=%d\n", this, id, c);
 #endif
     ALOG_ASSERT(c >= 1, "decStrong() called on %p too many times", refs);
     if (c == 1) {
+        android_atomic_fence(ANDROID_MEMORY_ORDER_ACQUIRE);
         refs->mBase->onLastStrongRef(id);
         if ((refs->mFlags&OBJECT_LIFETIME_MASK) == OBJECT_LIFETIME_STRONG) {
             delete this;
@@ -354,11 +469,30 @@ void RefBase::decStrong(const void* id) const
 
 void RefBase::forceIncStrong(const void* id) const
 {
-    weakref_impl* const refs = mRefs;
+    int32_t state = mState;
+    while (!(state & (REFS_INFLATING | REFS_INFLATED))) {
+        if (android_atomic_cas_explicit(state, state + 1, &mState,
+                ANDROID_MEMORY_ORDER_RELAXED) == 0) {
+            ALOG_ASSERT(state >= 0, "forceIncStrong called on %p after ref count underflow",
+                    this);
+#if PRINT_REFS
+            ALOGD("forceIncStrong of %p from %p: cnt=%d\n", this, id, state);
+#endif
+            if (state == INITIAL_STRONG_VALUE) {
+                removeInitialStrong();
+                const_cast<RefBase*>(this)->onFirstRef();
+            }
+            return;
+        }
+        state = mState;
+    }
+
+    weakref_impl* const refs = inflateRefs();
     refs->incWeak(id);
     
     refs->addStrongRef(id);
-    const int32_t c = android_atomic_inc(&refs->mStrong);
+    const int32_t c = android_atomic_add_explicit(1, &refs->mStrong,
+            ANDROID_MEMORY_ORDER_RELAXED);
     ALOG_ASSERT(c >= 0, "forceIncStrong called on %p after ref count underflow",
                refs);
 #if PRINT_REFS
@@ -376,7 +510,11 @@ void RefBase::forceIncStrong(const void* id) const
 
 int32_t RefBase::getStrongCount() const
 {
-    return mRefs->mStrong;
+    const int32_t state = android_atomic_acquire_load(&mState);
+    if (state & REFS_INFLATED) {
+        return mRefs->mStrong;
+    }
+    return state & STRONG_COUNT_MASK;
 }
 
 RefBase* RefBase::weakref_type::refBase() const
@@ -388,7 +526,8 @@ void RefBase::weakref_type::incWeak(const void* id)
 {
     weakref_impl* const impl = static_cast<weakref_impl*>(this);
     impl->addWeakRef(id);
-    const int32_t c = android_atomic_inc(&impl->mWeak);
+    const int32_t c = android_atomic_add_explicit(1, &impl->mWeak,
+            ANDROID_MEMORY_ORDER_RELAXED);
     ALOG_ASSERT(c >= 0, "incWeak called on %p after last weak ref", this);
 }
 
@@ -397,9 +536,11 @@ void RefBase::weakref_type::decWeak(const void* id)
 {
     weakref_impl* const impl = static_cast<weakref_impl*>(this);
     impl->removeWeakRef(id);
-    const int32_t c = android_atomic_dec(&impl->mWeak);
+    const int32_t c = android_atomic_add_explicit(-1, &impl->mWeak,
+            ANDROID_MEMORY_ORDER_RELEASE);
     ALOG_ASSERT(c >= 1, "decWeak called on %p too many times", this);
     if (c != 1) return;
+    android_atomic_fence(ANDROID_MEMORY_ORDER_ACQUIRE);
 
     if ((impl->mFlags&OBJECT_LIFETIME_WEAK) == OBJECT_LIFETIME_STRONG) {
         // This is the regular lifetime case. The object is destroyed
@@ -567,23 +708,31 @@ void RefBase::weakref_type::trackMe(bool enable, bool retain)
 
 RefBase::weakref_type* RefBase::createWeak(const void* id) const
 {
-    mRefs->incWeak(id);
-    return mRefs;
+    weakref_impl* const refs = inflateRefs();
+    refs->incWeak(id);
+    return refs;
 }
 
 RefBase::weakref_type* RefBase::getWeakRefs() const
 {
-    return mRefs;
+    return inflateRefs();
 }
 
 RefBase::RefBase()
-    : mRefs(new weakref_impl(this))
+    : mRefs(NULL)
+    , mState(INITIAL_STRONG_VALUE)
 {
+#if DEBUG_REFS
+    // tracking needs the weakref_impl from the start.
+    inflateRefs();
+#endif
 }
 
 RefBase::~RefBase()
 {
-    if (mRefs->mStrong == INITIAL_STRONG_VALUE) {
+    if (!(mState & REFS_INFLATED)) {
+        // never weakly referenced, there is nothing else to free.
+    } else if (mRefs->mStrong == INITIAL_STRONG_VALUE) {
         // we never acquired a strong (and/or weak) reference on this object.
         delete mRefs;
     } else {
@@ -599,12 +748,12 @@ RefBase::~RefBase()
         }
     }
     // for debugging purposes, clear this.
-    const_cast<weakref_impl*&>(mRefs) = NULL;
+    mRefs = NULL;
 }
 
 void RefBase::extendObjectLifetime(int32_t mode)
 {
-    android_atomic_or(mode, &mRefs->mFlags);
+    android_atomic_or(mode, &inflateRefs()->mFlags);
 }
 
 void RefBase::onFirstRef()
@@ -643,8 +792,10 @@ void RefBase::renameRefId(weakref_type* ref,
 
 void RefBase::renameRefId(RefBase* ref,
         const void* old_id, const void* new_id) {
-    ref->mRefs->renameStrongRefId(old_id, new_id);
-    ref->mRefs->renameWeakRefId(old_id, new_id);
+    if (ref->mState & REFS_INFLATED) {
+        ref->mRefs->renameStrongRefId(old_id, new_id);
+        ref->mRefs->renameWeakRefId(old_id, new_id);
+    }
 }
 
 }; // namespace android
@@ -29,158 +29,160 @@
 
 namespace android {
 
-static SharedBuffer* gEmptyStringBuf = NULL;
-static char16_t* gEmptyString = NULL;
-
-static inline char16_t* getEmptyString()
-{
-    gEmptyStringBuf->acquire();
-   return gEmptyString;
-}
-
 void initialize_string16()
 {
-    SharedBuffer* buf = SharedBuffer::alloc(sizeof(char16_t));
-    char16_t* str = (char16_t*)buf->data();
-    *str = 0;
-    gEmptyStringBuf = buf;
-    gEmptyString = str;
 }
 
 void terminate_string16()
 {
-    SharedBuffer::bufferFromData(gEmptyString)->release();
-    gEmptyStringBuf = NULL;
-    gEmptyString = NULL;
-}
-
-// ---------------------------------------------------------------------------
-
-static char16_t* allocFromUTF8(const char* u8str, size_t u8len)
-{
-    if (u8len == 0) return getEmptyString();
-
-    const uint8_t* u8cur = (const uint8_t*) u8str;
-
-    const ssize_t u16len = utf8_to_utf16_length(u8cur, u8len);
-    if (u16len < 0) {
-        return getEmptyString();
-    }
-
-    const uint8_t* const u8end = u8cur + u8len;
-
-    SharedBuffer* buf = SharedBuffer::alloc(sizeof(char16_t)*(u16len+1));
-    if (buf) {
-        u8cur = (const uint8_t*) u8str;
-        char16_t* u16str = (char16_t*)buf->data();
-
-        utf8_to_utf16(u8cur, u8len, u16str);
-
-        //printf("Created UTF-16 string from UTF-8 \"%s\":", in);
-        //printHexData(1, str, buf->size(), 16, 1);
-        //printf("\n");
-        
-        return u16str;
-    }
-
-    return getEmptyString();
 }
 
 // ---------------------------------------------------------------------------
 
-String16::String16()
-    : mString(getEmptyString())
-{
-}
-
 String16::String16(StaticLinkage)
-    : mString(0)
 {
-    // this constructor is used when we can't rely on the static-initializers
-    // having run. In this case we always allocate an empty string. It's less
-    // efficient than using getEmptyString(), but we assume it's uncommon.
-
-    char16_t* data = static_cast<char16_t*>(
-            SharedBuffer::alloc(sizeof(char16_t))->data());
-    data[0] = 0;
-    mString = data;
+    // Empty strings need no SharedBuffer, so there is nothing here that
+    // depends on the static initializers having run.
+    initEmpty();
 }
 
 String16::String16(const String16& o)
-    : mString(o.mString)
 {
-    SharedBuffer::bufferFromData(mString)->acquire();
+    memcpy(mInline, o.mInline, sizeof(mInline));
+    if (!isInline()) {
+        SharedBuffer::bufferFromData(mString)->acquire();
+    }
 }
 
 String16::String16(const String16& o, size_t len, size_t begin)
-    : mString(getEmptyString())
 {
+    initEmpty();
     setTo(o, len, begin);
 }
 
 String16::String16(const char16_t* o)
 {
-    size_t len = strlen16(o);
-    SharedBuffer* buf = SharedBuffer::alloc((len+1)*sizeof(char16_t));
-    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
-        strcpy16(str, o);
-        mString = str;
-        return;
-    }
-    
-    mString = getEmptyString();
+    initEmpty();
+    setTo(o, strlen16(o));
 }
 
 String16::String16(const char16_t* o, size_t len)
 {
-    SharedBuffer* buf = SharedBuffer::alloc((len+1)*sizeof(char16_t));
-    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
-        memcpy(str, o, len*sizeof(char16_t));
-        str[len] = 0;
-        mString = str;
-        return;
-    }
-    
-    mString = getEmptyString();
+    initEmpty();
+    setTo(o, len);
 }
 
 String16::String16(const String8& o)
-    : mString(allocFromUTF8(o.string(), o.size()))
 {
+    initEmpty();
+    setFromUTF8(o.string(), o.size());
 }
 
 String16::String16(const char* o)
-    : mString(allocFromUTF8(o, strlen(o)))
 {
+    initEmpty();
+    setFromUTF8(o, strlen(o));
 }
 
 String16::String16(const char* o, size_t len)
-    : mString(allocFromUTF8(o, len))
 {
+    initEmpty();
+    setFromUTF8(o, len);
 }
 
-String16::~String16()
+void String16::makeEmpty()
 {
-    SharedBuffer::bufferFromData(mString)->release();
+    if (!isInline()) {
+        SharedBuffer::bufferFromData(mString)->release();
+    }
+    initEmpty();
+}
+
+void String16::moveFrom(String16& other)
+{
+    if (&other != this) {
+        makeEmpty();
+        memcpy(mInline, other.mInline, sizeof(mInline));
+        other.initEmpty();
+    }
+}
+
+/*
+ * Makes the string len characters long and returns a writable pointer to it,
+ * keeping as much of the old contents as fits and terminating it.  Moves the
+ * string between the inline storage and a SharedBuffer as needed and gives
+ * us our own copy of a shared buffer.  Returns NULL, leaving the string
+ * alone, if memory runs out.
+ */
+char16_t* String16::editResize(size_t len)
+{
+    char16_t* str;
+    if (len <= kInlineLength) {
+        if (!isInline()) {
+            const char16_t* old = mString;
+            memcpy(mInline, old, len*sizeof(char16_t));
+            SharedBuffer::bufferFromData(old)->release();
+        }
+        str = mInline;
+        mInline[kInlineLength] = kInlineLength - len;
+    } else if (isInline()) {
+        SharedBuffer* buf = SharedBuffer::alloc((len+1)*sizeof(char16_t));
+        ALOG_ASSERT(buf, "Unable to allocate shared buffer");
+        if (!buf) {
+            return NULL;
+        }
+        str = (char16_t*)buf->data();
+        memcpy(str, mInline, size()*sizeof(char16_t));
+        mString = str;
+        mInline[kInlineLength] = kSharedTag;
+    } else {
+        SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
+            ->editResize((len+1)*sizeof(char16_t));
+        if (!buf) {
+            return NULL;
+        }
+        str = (char16_t*)buf->data();
+        mString = str;
+    }
+    str[len] = 0;
+    return str;
+}
+
+status_t String16::setFromUTF8(const char* u8str, size_t u8len)
+{
+    const uint8_t* u8cur = (const uint8_t*) u8str;
+    const ssize_t u16len = u8len > 0 ? utf8_to_utf16_length(u8cur, u8len) : 0;
+    if (u16len <= 0) {
+        makeEmpty();
+        return NO_ERROR;
+    }
+
+    char16_t* u16str = editResize(u16len);
+    if (!u16str) {
+        makeEmpty();
+        return NO_MEMORY;
+    }
+    utf8_to_utf16(u8cur, u8len, u16str);
+    return NO_ERROR;
 }
 
 void String16::setTo(const String16& other)
 {
-    SharedBuffer::bufferFromData(other.mString)->acquire();
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = other.mString;
+    if (&other == this) {
+        return;
+    }
+    if (!other.isInline()) {
+        SharedBuffer::bufferFromData(other.mString)->acquire();
+    }
+    makeEmpty();
+    memcpy(mInline, other.mInline, sizeof(mInline));
 }
 
 status_t String16::setTo(const String16& other, size_t len, size_t begin)
 {
     const size_t N = other.size();
     if (begin >= N) {
-        SharedBuffer::bufferFromData(mString)->release();
-        mString = getEmptyString();
+        makeEmpty();
         return NO_ERROR;
     }
     if ((begin+len) > N) len = N-begin;
@@ -189,10 +191,6 @@ status_t String16::setTo(const String16& other, size_t len, size_t begin)
         return NO_ERROR;
     }
 
-    if (&other == this) {
-        LOG_ALWAYS_FATAL("Not implemented");
-    }
-
     return setTo(other.string()+begin, len);
 }
 
@@ -203,16 +201,15 @@ status_t String16::setTo(const char16_t* other)
 
 status_t String16::setTo(const char16_t* other, size_t len)
 {
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize((len+1)*sizeof(char16_t));
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
-        memmove(str, other, len*sizeof(char16_t));
-        str[len] = 0;
-        mString = str;
-        return NO_ERROR;
+    // Build the new value on the side: 'other' may point into this string.
+    String16 tmp;
+    char16_t* str = tmp.editResize(len);
+    if (!str) {
+        return NO_MEMORY;
     }
-    return NO_MEMORY;
+    memcpy(str, other, len*sizeof(char16_t));
+    moveFrom(tmp);
+    return NO_ERROR;
 }
 
 status_t String16::append(const String16& other)
@@ -225,13 +222,11 @@ status_t String16::append(const String16& other)
     } else if (otherLen == 0) {
         return NO_ERROR;
     }
-    
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize((myLen+otherLen+1)*sizeof(char16_t));
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
-        memcpy(str+myLen, other, (otherLen+1)*sizeof(char16_t));
-        mString = str;
+
+    char16_t* str = editResize(myLen+otherLen);
+    if (str) {
+        // Only look at other now, in case it is this string.
+        memcpy(str+myLen, other.string(), otherLen*sizeof(char16_t));
         return NO_ERROR;
     }
     return NO_MEMORY;
@@ -246,14 +241,17 @@ status_t String16::append(const char16_t* chrs, size_t otherLen)
     } else if (otherLen == 0) {
         return NO_ERROR;
     }
-    
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize((myLen+otherLen+1)*sizeof(char16_t));
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
+
+    const char16_t* myStr = string();
+    if (chrs >= myStr && chrs <= myStr + myLen) {
+        // Appending part of ourselves; resizing may move or clobber it.
+        String16 copy(chrs, otherLen);
+        return append(copy);
+    }
+
+    char16_t* str = editResize(myLen+otherLen);
+    if (str) {
         memcpy(str+myLen, chrs, otherLen*sizeof(char16_t));
-        str[myLen+otherLen] = 0;
-        mString = str;
         return NO_ERROR;
     }
     return NO_MEMORY;
@@ -282,16 +280,12 @@ status_t String16::insert(size_t pos, const char16_t* chrs, size_t len)
            len, myLen, String8(chrs, len).string());
     #endif
 
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize((myLen+len+1)*sizeof(char16_t));
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
+    char16_t* str = editResize(myLen+len);
+    if (str) {
         if (pos < myLen) {
             memmove(str+pos+len, str+pos, (myLen-pos)*sizeof(char16_t));
         }
         memcpy(str+pos, chrs, len*sizeof(char16_t));
-        str[myLen+len] = 0;
-        mString = str;
         #if 0
         printf("Result (%d chrs): %s\n", size(), String8(*this).string());
         #endif
@@ -332,14 +326,14 @@ bool String16::startsWith(const String16& prefix) const
 {
     const size_t ps = prefix.size();
     if (ps > size()) return false;
-    return strzcmp16(mString, ps, prefix.string(), ps) == 0;
+    return strzcmp16(string(), ps, prefix.string(), ps) == 0;
 }
 
 bool String16::startsWith(const char16_t* prefix) const
 {
     const size_t ps = strlen16(prefix);
     if (ps > size()) return false;
-    return strncmp16(mString, prefix, ps) == 0;
+    return strncmp16(string(), prefix, ps) == 0;
 }
 
 status_t String16::makeLower()
@@ -351,12 +345,11 @@ status_t String16::makeLower()
         const char16_t v = str[i];
         if (v >= 'A' && v <= 'Z') {
             if (!edit) {
-                SharedBuffer* buf = SharedBuffer::bufferFromData(mString)->edit();
-                if (!buf) {
+                edit = editResize(N);
+                if (!edit) {
                     return NO_MEMORY;
                 }
-                edit = (char16_t*)buf->data();
-                mString = str = edit;
+                str = edit;
             }
             edit[i] = tolower((char)v);
         }
@@ -372,12 +365,11 @@ status_t String16::replaceAll(char16_t replaceThis, char16_t withThis)
     for (size_t i=0; i<N; i++) {
         if (str[i] == replaceThis) {
             if (!edit) {
-                SharedBuffer* buf = SharedBuffer::bufferFromData(mString)->edit();
-                if (!buf) {
+                edit = editResize(N);
+                if (!edit) {
                     return NO_MEMORY;
                 }
-                edit = (char16_t*)buf->data();
-                mString = str = edit;
+                str = edit;
             }
             edit[i] = withThis;
         }
@@ -389,8 +381,7 @@ status_t String16::remove(size_t len, size_t begin)
 {
     const size_t N = size();
     if (begin >= N) {
-        SharedBuffer::bufferFromData(mString)->release();
-        mString = getEmptyString();
+        makeEmpty();
         return NO_ERROR;
     }
     if ((begin+len) > N) len = N-begin;
@@ -399,24 +390,16 @@ status_t String16::remove(size_t len, size_t begin)
     }
 
     if (begin > 0) {
-        SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-            ->editResize((N+1)*sizeof(char16_t));
-        if (!buf) {
+        char16_t* str = editResize(N);
+        if (!str) {
             return NO_MEMORY;
         }
-        char16_t* str = (char16_t*)buf->data();
-        memmove(str, str+begin, (N-begin+1)*sizeof(char16_t));
-        mString = str;
+        memmove(str, str+begin, (N-begin)*sizeof(char16_t));
     }
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize((len+1)*sizeof(char16_t));
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
-        str[len] = 0;
-        mString = str;
-        return NO_ERROR;
+    if (!editResize(len)) {
+        return NO_MEMORY;
     }
-    return NO_MEMORY;
+    return NO_ERROR;
 }
 
 }; // namespace android
@@ -37,20 +37,11 @@ namespace android {
 // to OS_PATH_SEPARATOR.
 #define RES_PATH_SEPARATOR '/'
 
-static SharedBuffer* gEmptyStringBuf = NULL;
-static char* gEmptyString = NULL;
-
 extern int gDarwinCantLoadAllObjects;
 int gDarwinIsReallyAnnoying;
 
 void initialize_string8();
 
-static inline char* getEmptyString()
-{
-    gEmptyStringBuf->acquire();
-    return gEmptyString;
-}
-
 void initialize_string8()
 {
     // HACK: This dummy dependency forces linking libutils Static.cpp,
@@ -58,153 +49,76 @@ void initialize_string8()
     // These variables are named for Darwin, but are needed elsewhere too,
     // including static linking on any platform.
     gDarwinIsReallyAnnoying = gDarwinCantLoadAllObjects;
-
-    SharedBuffer* buf = SharedBuffer::alloc(1);
-    char* str = (char*)buf->data();
-    *str = 0;
-    gEmptyStringBuf = buf;
-    gEmptyString = str;
 }
 
 void terminate_string8()
 {
-    SharedBuffer::bufferFromData(gEmptyString)->release();
-    gEmptyStringBuf = NULL;
-    gEmptyString = NULL;
-}
-
-// ---------------------------------------------------------------------------
-
-static char* allocFromUTF8(const char* in, size_t len)
-{
-    if (len > 0) {
-        SharedBuffer* buf = SharedBuffer::alloc(len+1);
-        ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-        if (buf) {
-            char* str = (char*)buf->data();
-            memcpy(str, in, len);
-            str[len] = 0;
-            return str;
-        }
-        return NULL;
-    }
-
-    return getEmptyString();
-}
-
-static char* allocFromUTF16(const char16_t* in, size_t len)
-{
-    if (len == 0) return getEmptyString();
-
-    const ssize_t bytes = utf16_to_utf8_length(in, len);
-    if (bytes < 0) {
-        return getEmptyString();
-    }
-
-    SharedBuffer* buf = SharedBuffer::alloc(bytes+1);
-    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-    if (!buf) {
-        return getEmptyString();
-    }
-
-    char* str = (char*)buf->data();
-    utf16_to_utf8(in, len, str);
-    return str;
-}
-
-static char* allocFromUTF32(const char32_t* in, size_t len)
-{
-    if (len == 0) {
-        return getEmptyString();
-    }
-
-    const ssize_t bytes = utf32_to_utf8_length(in, len);
-    if (bytes < 0) {
-        return getEmptyString();
-    }
-
-    SharedBuffer* buf = SharedBuffer::alloc(bytes+1);
-    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-    if (!buf) {
-        return getEmptyString();
-    }
-
-    char* str = (char*) buf->data();
-    utf32_to_utf8(in, len, str);
-
-    return str;
 }
 
 // ---------------------------------------------------------------------------
 
-String8::String8()
-    : mString(getEmptyString())
-{
-}
-
 String8::String8(StaticLinkage)
-    : mString(0)
 {
-    // this constructor is used when we can't rely on the static-initializers
-    // having run. In this case we always allocate an empty string. It's less
-    // efficient than using getEmptyString(), but we assume it's uncommon.
-
-    char* data = static_cast<char*>(
-            SharedBuffer::alloc(sizeof(char))->data());
-    data[0] = 0;
-    mString = data;
+    // Empty strings need no SharedBuffer, so there is nothing here that
+    // depends on the static initializers having run.
+    initEmpty();
 }
 
 String8::String8(const String8& o)
-    : mString(o.mString)
 {
-    SharedBuffer::bufferFromData(mString)->acquire();
+    memcpy(mInline, o.mInline, sizeof(mInline));
+    if (!isInline()) {
+        SharedBuffer::bufferFromData(mString)->acquire();
+    }
 }
 
 String8::String8(const char* o)
-    : mString(allocFromUTF8(o, strlen(o)))
 {
-    if (mString == NULL) {
-        mString = getEmptyString();
+    initEmpty();
+    const size_t len = strlen(o);
+    char* str = editResize(len);
+    if (str) {
+        memcpy(str, o, len);
     }
 }
 
 String8::String8(const char* o, size_t len)
-    : mString(allocFromUTF8(o, len))
 {
-    if (mString == NULL) {
-        mString = getEmptyString();
+    initEmpty();
+    char* str = editResize(len);
+    if (str) {
+        memcpy(str, o, len);
     }
 }
 
 String8::String8(const String16& o)
-    : mString(allocFromUTF16(o.string(), o.size()))
 {
+    initEmpty();
+    setTo(o.string(), o.size());
 }
 
 String8::String8(const char16_t* o)
-    : mString(allocFromUTF16(o, strlen16(o)))
 {
+    initEmpty();
+    setTo(o, strlen16(o));
 }
 
 String8::String8(const char16_t* o, size_t len)
-    : mString(allocFromUTF16(o, len))
 {
+    initEmpty();
+    setTo(o, len);
 }
 
 String8::String8(const char32_t* o)
-    : mString(allocFromUTF32(o, strlen32(o)))
 {
+    initEmpty();
+    setTo(o, strlen32(o));
 }
 
 String8::String8(const char32_t* o, size_t len)
-    : mString(allocFromUTF32(o, len))
 {
-}
-
-String8::~String8()
-{
-    SharedBuffer::bufferFromData(mString)->release();
+    initEmpty();
+    setTo(o, len);
 }
 
 String8 String8::format(const char* fmt, ...)
@@ -226,59 +140,123 @@ String8 String8::formatV(const char* fmt, va_list args)
 }
 
 void String8::clear() {
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = getEmptyString();
+    if (!isInline()) {
+        SharedBuffer::bufferFromData(mString)->release();
+    }
+    initEmpty();
+}
+
+void String8::moveFrom(String8& other)
+{
+    if (&other != this) {
+        clear();
+        memcpy(mInline, other.mInline, sizeof(mInline));
+        other.initEmpty();
+    }
+}
+
+/*
+ * Makes the string numChars bytes long and returns a writable pointer to it,
+ * keeping as much of the old contents as fits and terminating it.  Moves the
+ * string between the inline storage and a SharedBuffer as needed and gives
+ * us our own copy of a shared buffer.  Returns NULL, leaving the string
+ * alone, if memory runs out.
+ */
+char* String8::editResize(size_t numChars)
+{
+    char* str;
+    if (numChars <= kInlineLength) {
+        if (!isInline()) {
+            const char* old = string();
+            memcpy(mInline, old, numChars);
+            SharedBuffer::bufferFromData(old)->release();
+        }
+        str = mInline;
+        mInline[kInlineLength] = kInlineLength - numChars;
+    } else if (isInline()) {
+        SharedBuffer* buf = SharedBuffer::alloc(numChars+1);
+        ALOG_ASSERT(buf, "Unable to allocate shared buffer");
+        if (!buf) {
+            return NULL;
+        }
+        str = (char*)buf->data();
+        memcpy(str, mInline, length());
+        mString = str;
+        mInline[kInlineLength] = kSharedTag;
+    } else {
+        SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
+            ->editResize(numChars+1);
+        if (!buf) {
+            return NULL;
+        }
+        str = (char*)buf->data();
+        mString = str;
+    }
+    str[numChars] = 0;
+    return str;
 }
 
 void String8::setTo(const String8& other)
 {
-    SharedBuffer::bufferFromData(other.mString)->acquire();
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = other.mString;
+    if (&other == this) {
+        return;
+    }
+    if (!other.isInline()) {
+        SharedBuffer::bufferFromData(other.mString)->acquire();
+    }
+    clear();
+    memcpy(mInline, other.mInline, sizeof(mInline));
 }
 
 status_t String8::setTo(const char* other)
 {
-    const char *newString = allocFromUTF8(other, strlen(other));
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    return setTo(other, strlen(other));
 }
 
 status_t String8::setTo(const char* other, size_t len)
 {
-    const char *newString = allocFromUTF8(other, len);
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    // Build the new value on the side: 'other' may point into this string.
+    String8 tmp;
+    char* str = tmp.editResize(len);
+    if (!str) {
+        clear();
+        return NO_MEMORY;
+    }
+    memcpy(str, other, len);
+    moveFrom(tmp);
+    return NO_ERROR;
 }
 
 status_t String8::setTo(const char16_t* other, size_t len)
 {
-    const char *newString = allocFromUTF16(other, len);
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    const ssize_t bytes = len > 0 ? utf16_to_utf8_length(other, len) : 0;
+    String8 tmp;
+    if (bytes > 0) {
+        char* str = tmp.editResize(bytes);
+        if (!str) {
+            clear();
+            return NO_MEMORY;
+        }
+        utf16_to_utf8(other, len, str);
+    }
+    moveFrom(tmp);
+    return NO_ERROR;
 }
 
 status_t String8::setTo(const char32_t* other, size_t len)
 {
-    const char *newString = allocFromUTF32(other, len);
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    const ssize_t bytes = len > 0 ? utf32_to_utf8_length(other, len) : 0;
+    String8 tmp;
+    if (bytes > 0) {
+        char* str = tmp.editResize(bytes);
+        if (!str) {
+            clear();
+            return NO_MEMORY;
+        }
+        utf32_to_utf8(other, len, str);
+    }
+    moveFrom(tmp);
+    return NO_ERROR;
 }
 
 status_t String8::append(const String8& other)
@@ -324,7 +302,13 @@ status_t String8::appendFormat(const char* fmt, ...)
 status_t String8::appendFormatV(const char* fmt, va_list args)
 {
     int result = NO_ERROR;
-    int n = vsnprintf(NULL, 0, fmt, args);
+    va_list tmp_args;
+
+    // args is walked twice, once to measure and once to print.
+    va_copy(tmp_args, args);
+    int n = vsnprintf(NULL, 0, fmt, tmp_args);
+    va_end(tmp_args);
+
     if (n != 0) {
         size_t oldLength = length();
         char* buf = lockBuffer(oldLength + n);
@@ -340,15 +324,16 @@ status_t String8::appendFormatV(const char* fmt, va_list args)
 status_t String8::real_append(const char* other, size_t otherLen)
 {
     const size_t myLen = bytes();
-    
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize(myLen+otherLen+1);
-    if (buf) {
-        char* str = (char*)buf->data();
-        mString = str;
-        str += myLen;
-        memcpy(str, other, otherLen);
-        str[otherLen] = '\0';
+    const char* myStr = string();
+    if (other >= myStr && other <= myStr + myLen) {
+        // Appending part of ourselves; resizing may move or clobber it.
+        String8 copy(other, otherLen);
+        return real_append(copy.string(), otherLen);
+    }
+
+    char* str = editResize(myLen+otherLen);
+    if (str) {
+        memcpy(str+myLen, other, otherLen);
         return NO_ERROR;
     }
     return NO_MEMORY;
@@ -356,33 +341,20 @@ status_t String8::real_append(const char* other, size_t otherLen)
 
 char* String8::lockBuffer(size_t size)
 {
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize(size+1);
-    if (buf) {
-        char* str = (char*)buf->data();
-        mString = str;
-        return str;
-    }
-    return NULL;
+    return editResize(size);
 }
 
 void String8::unlockBuffer()
 {
-    unlockBuffer(strlen(mString));
+    unlockBuffer(strlen(string()));
 }
 
 status_t String8::unlockBuffer(size_t size)
 {
     if (size != this->size()) {
-        SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-            ->editResize(size+1);
-        if (! buf) {
+        if (!editResize(size)) {
             return NO_MEMORY;
         }
-
-        char* str = (char*)buf->data();
-        str[size] = 0;
-        mString = str;
     }
 
     return NO_ERROR;
@@ -394,9 +366,9 @@ ssize_t String8::find(const char* other, size_t start) const
     if (start >= len) {
         return -1;
     }
-    const char* s = mString+start;
-    const char* p = strstr(s, other);
-    return p ? p-mString : -1;
+    const char* str = string();
+    const char* p = strstr(str+start, other);
+    return p ? p-str : -1;
 }
 
 void String8::toLower()
@@ -449,17 +421,17 @@ void String8::toUpper(size_t start, size_t length)
 
 size_t String8::getUtf32Length() const
 {
-    return utf8_to_utf32_length(mString, length());
+    return utf8_to_utf32_length(string(), length());
 }
 
 int32_t String8::getUtf32At(size_t index, size_t *next_index) const
 {
-    return utf32_from_utf8_at(mString, length(), index, next_index);
+    return utf32_from_utf8_at(string(), length(), index, next_index);
 }
 
 void String8::getUtf32(char32_t* dst) const
 {
-    utf8_to_utf32(mString, length(), dst);
+    utf8_to_utf32(string(), length(), dst);
 }
 
 // ---------------------------------------------------------------------------
@@ -488,7 +460,7 @@ void String8::setPathName(const char* name, size_t len)
 String8 String8::getPathLeaf(void) const
 {
     const char* cp;
-    const char*const buf = mString;
+    const char*const buf = string();
 
     cp = strrchr(buf, OS_PATH_SEPARATOR);
     if (cp == NULL)
@@ -500,7 +472,7 @@ String8 String8::getPathLeaf(void) const
 String8 String8::getPathDir(void) const
 {
     const char* cp;
-    const char*const str = mString;
+    const char*const str = string();
 
     cp = strrchr(str, OS_PATH_SEPARATOR);
     if (cp == NULL)
@@ -512,7 +484,7 @@ String8 String8::getPathDir(void) const
 String8 String8::walkPath(String8* outRemains) const
 {
     const char* cp;
-    const char*const str = mString;
+    const char*const str = string();
     const char* buf = str;
 
     cp = strchr(buf, OS_PATH_SEPARATOR);
@@ -536,14 +508,14 @@ String8 String8::walkPath(String8* outRemains) const
 /*
  * Helper function for finding the start of an extension in a pathname.
  *
- * Returns a pointer inside mString, or NULL if no extension was found.
+ * Returns a pointer inside string(), or NULL if no extension was found.
  */
 char* String8::find_extension(void) const
 {
     const char* lastSlash;
     const char* lastDot;
     int extLen;
-    const char* const str = mString;
+    const char* const str = string();
 
     // only look at the filename
     lastSlash = strrchr(str, OS_PATH_SEPARATOR);
@@ -575,7 +547,7 @@ String8 String8::getPathExtension(void) const
 String8 String8::getBasePath(void) const
 {
     char* ext;
-    const char* const str = mString;
+    const char* const str = string();
 
     ext = find_extension();
     if (ext == NULL)
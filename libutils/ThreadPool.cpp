@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ThreadPool"
+
+#include <utils/ThreadPool.h>
+#include <utils/AndroidThreads.h>
+#include <utils/Log.h>
+#include <utils/Thread.h>
+
+#include <cutils/atomic.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace android {
+
+// Times an idle worker yields before it goes to sleep.
+static const int IDLE_YIELDS = 4;
+
+static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gTLSKey = 0;
+
+static void initTLSKey() {
+    int result = pthread_key_create(&gTLSKey, NULL);
+    LOG_ALWAYS_FATAL_IF(result != 0, "Could not allocate TLS key.");
+}
+
+static size_t defaultThreadCount() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? size_t(cpus) : 1;
+}
+
+// ---------------------------------------------------------------------------
+
+/*
+ * A bounded Chase-Lev work-stealing deque.  The owning worker pushes and pops
+ * at the bottom; any thread may steal from the top.  The owner only contends
+ * with thieves for the last task, which both sides claim with a CAS on mTop.
+ * Indices count up forever and are masked on use, as in the queues in
+ * ConcurrentQueue.h.
+ */
+class TaskDeque {
+public:
+    enum {
+        CAPACITY = ThreadPool::DEQUE_CAPACITY,
+        MASK = CAPACITY - 1,
+    };
+
+    TaskDeque() : mTop(0), mBottom(0) { }
+
+    // Owner only.  Fails if the deque is full.
+    bool push(ThreadPoolTask* task) {
+        int32_t bottom = mBottom;
+        if (bottom - android_atomic_acquire_load(&mTop) >= CAPACITY) {
+            return false;
+        }
+        mSlots[bottom & MASK] = task;
+        android_atomic_release_store(bottom + 1, &mBottom);
+        return true;
+    }
+
+    // Owner only.  Returns the newest task, or NULL.
+    ThreadPoolTask* pop() {
+        int32_t bottom = mBottom - 1;
+        mBottom = bottom;
+        // Taking back the slot has to be visible before we look at mTop,
+        // or a thief could take the same task.
+        int32_t top = android_atomic_release_load(&mTop);
+        if (bottom - top < 0) {
+            mBottom = bottom + 1;
+            return NULL;
+        }
+        ThreadPoolTask* task = mSlots[bottom & MASK];
+        if (bottom != top) {
+            return task;
+        }
+        if (android_atomic_release_cas(top, top + 1, &mTop) != 0) {
+            task = NULL;
+        }
+        mBottom = bottom + 1;
+        return task;
+    }
+
+    // Any thread.  Returns the oldest task, or NULL if the deque is empty or
+    // another thread got to it first.
+    ThreadPoolTask* steal() {
+        int32_t top = android_atomic_acquire_load(&mTop);
+        int32_t bottom = android_atomic_acquire_load(&mBottom);
+        if (bottom - top <= 0) {
+            return NULL;
+        }
+        // The owner does not reuse this slot until mTop has moved past it.
+        ThreadPoolTask* task = mSlots[top & MASK];
+        if (android_atomic_release_cas(top, top + 1, &mTop) != 0) {
+            return NULL;
+        }
+        return task;
+    }
+
+    // Approximate unless called by the owner.
+    bool isEmpty() const {
+        return mBottom - mTop <= 0;
+    }
+
+private:
+    TaskDeque(const TaskDeque&);
+    TaskDeque& operator=(const TaskDeque&);
+
+    ThreadPoolTask* volatile mSlots[CAPACITY];
+    volatile int32_t mTop;      // next task to steal
+    volatile int32_t mBottom;   // next free slot, written only by the owner
+};
+
+class ThreadPool::Worker : public Thread {
+public:
+    Worker(ThreadPool* pool, uint32_t seed)
+        : Thread(false), mPool(pool), mRandom(seed | 1) { }
+
+    // Picks the worker to try stealing from first.
+    size_t nextVictim(size_t count) {
+        mRandom ^= mRandom << 13;
+        mRandom ^= mRandom >> 17;
+        mRandom ^= mRandom << 5;
+        return mRandom % count;
+    }
+
+    ThreadPool* const mPool;
+    TaskDeque mDeque;
+
+private:
+    virtual bool threadLoop() {
+        pthread_setspecific(gTLSKey, this);
+        ThreadPoolTask* task;
+        while ((task = mPool->nextTask(this)) != NULL) {
+            mPool->runTask(task);
+        }
+        pthread_setspecific(gTLSKey, NULL);
+        return false;
+    }
+
+    uint32_t mRandom;
+};
+
+// ---------------------------------------------------------------------------
+
+ThreadPoolTask::ThreadPoolTask()
+    : mDone(0), mStatus(NO_ERROR) {
+}
+
+ThreadPoolTask::~ThreadPoolTask() {
+}
+
+bool ThreadPoolTask::isDone() const {
+    return android_atomic_acquire_load(&mDone) != 0;
+}
+
+status_t ThreadPoolTask::wait() {
+    if (!isDone()) {
+        ThreadPool::Worker* worker = ThreadPool::currentWorker();
+        if (worker != NULL) {
+            worker->mPool->helpUntilDone(worker, this);
+        }
+        mWaiters.waitUntil(this, &ThreadPoolTask::isDone);
+    }
+    return mStatus;
+}
+
+void ThreadPoolTask::onCompleted(status_t) {
+}
+
+void ThreadPoolTask::complete(status_t status) {
+    mStatus = status;
+    onCompleted(status);
+    android_atomic_release_store(1, &mDone);
+    mWaiters.wakeAll();
+}
+
+// ---------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : mThreadCount(threadCount != 0 ? threadCount : defaultThreadCount()),
+      mState(RUNNING), mPendingHead(0), mPendingCount(0) {
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown(true);
+}
+
+ThreadPool::Worker* ThreadPool::currentWorker() {
+    int result = pthread_once(&gTLSOnce, initTLSKey);
+    LOG_ALWAYS_FATAL_IF(result != 0, "pthread_once failed");
+    return static_cast<Worker*>(pthread_getspecific(gTLSKey));
+}
+
+status_t ThreadPool::start(const char* name, int32_t priority) {
+    if (!mWorkers.isEmpty() || android_atomic_acquire_load(&mState) != RUNNING) {
+        return INVALID_OPERATION;
+    }
+    currentWorker(); // creates the TLS key before any worker needs it
+
+    // Workers look at each other's deques as soon as they start, so they all
+    // have to exist first.
+    mWorkers.setCapacity(mThreadCount);
+    for (size_t i = 0; i < mThreadCount; i++) {
+        mWorkers.add(new Worker(this, uint32_t(i + 1) * 2654435761U));
+    }
+    for (size_t i = 0; i < mThreadCount; i++) {
+        status_t result = mWorkers[i]->run(name, priority);
+        if (result != NO_ERROR) {
+            ALOGE("Could not start worker %d of %s: %d", int(i), name, result);
+            return result;
+        }
+    }
+    return NO_ERROR;
+}
+
+status_t ThreadPool::setPriority(int32_t priority) {
+#ifdef HAVE_ANDROID_OS
+    status_t result = NO_ERROR;
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        pid_t tid = mWorkers[i]->getTid();
+        if (tid != -1 && androidSetThreadPriority(tid, priority) != 0) {
+            result = INVALID_OPERATION;
+        }
+    }
+    return result;
+#else
+    return INVALID_OPERATION;
+#endif
+}
+
+status_t ThreadPool::submit(const sp<ThreadPoolTask>& task) {
+    Worker* worker = currentWorker();
+    if (worker != NULL && worker->mPool != this) {
+        worker = NULL;
+    }
+
+    task->incStrong(this);
+    if (worker == NULL || !worker->mDeque.push(task.get())) {
+        AutoMutex _l(mPendingLock);
+        if (worker == NULL && mState != RUNNING) {
+            task->decStrong(this);
+            return INVALID_OPERATION;
+        }
+        mPending.add(task.get());
+        android_atomic_release_store(mPending.size() - mPendingHead, &mPendingCount);
+    }
+    mIdle.wakeOne();
+    return NO_ERROR;
+}
+
+status_t ThreadPool::shutdown(bool drain) {
+    Worker* worker = currentWorker();
+    if (worker != NULL && worker->mPool == this) {
+        return WOULD_BLOCK;
+    }
+
+    {
+        AutoMutex _l(mPendingLock);
+        if (mState == RUNNING || !drain) {
+            android_atomic_release_store(drain ? DRAINING : CANCELLING, &mState);
+        }
+    }
+    mIdle.wakeAll();
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        mWorkers[i]->join();
+    }
+    mWorkers.clear();
+
+    // Only left over if the pool was never started.
+    cancelQueuedTasks();
+    return NO_ERROR;
+}
+
+void ThreadPool::cancelQueuedTasks() {
+    Vector<ThreadPoolTask*> pending;
+    {
+        AutoMutex _l(mPendingLock);
+        for (size_t i = mPendingHead; i < mPending.size(); i++) {
+            pending.add(mPending[i]);
+        }
+        mPending.clear();
+        mPendingHead = 0;
+        mPendingCount = 0;
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+        pending[i]->complete(DEAD_OBJECT);
+        pending[i]->decStrong(this);
+    }
+}
+
+ThreadPoolTask* ThreadPool::takePending(Worker* worker) {
+    size_t taken = 0;
+    ThreadPoolTask* task = NULL;
+    {
+        AutoMutex _l(mPendingLock);
+        size_t count = mPending.size() - mPendingHead;
+        if (count == 0) {
+            return NULL;
+        }
+        // Take a share of the queue at a time, onto our deque where the
+        // other workers can still steal it.
+        size_t share = count / mThreadCount + 1;
+        if (share > count) {
+            share = count;
+        }
+        task = mPending[mPendingHead++];
+        while (++taken < share && worker->mDeque.push(mPending[mPendingHead])) {
+            mPendingHead++;
+        }
+        if (mPendingHead * 2 >= mPending.size()) {
+            mPending.removeItemsAt(0, mPendingHead);
+            mPendingHead = 0;
+        }
+        android_atomic_release_store(mPending.size() - mPendingHead, &mPendingCount);
+    }
+    if (taken > 1) {
+        mIdle.wakeOne();
+    }
+    return task;
+}
+
+ThreadPoolTask* ThreadPool::findTask(Worker* worker) {
+    ThreadPoolTask* task = worker->mDeque.pop();
+    if (task != NULL) {
+        return task;
+    }
+    if (android_atomic_acquire_load(&mPendingCount) != 0) {
+        task = takePending(worker);
+        if (task != NULL) {
+            return task;
+        }
+    }
+    size_t first = worker->nextVictim(mThreadCount);
+    for (size_t i = 0; i < mThreadCount; i++) {
+        Worker* victim = mWorkers[(first + i) % mThreadCount].get();
+        if (victim != worker) {
+            task = victim->mDeque.steal();
+            if (task != NULL) {
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+ThreadPoolTask* ThreadPool::nextTask(Worker* worker) {
+    for (int idle = 0; ; idle++) {
+        ThreadPoolTask* task = findTask(worker);
+        if (task != NULL) {
+            return task;
+        }
+        // Once shutting down, nothing new can arrive except from tasks that
+        // are still running, and their workers will pick those up.
+        if (android_atomic_acquire_load(&mState) != RUNNING) {
+            return NULL;
+        }
+        // Going to sleep and being woken up costs far more than a small
+        // task, so give whoever is about to submit more work a chance first.
+        if (idle < IDLE_YIELDS) {
+            sched_yield();
+            continue;
+        }
+        mIdle.waitUntil(this, &ThreadPool::hasWorkOrStopping);
+    }
+}
+
+bool ThreadPool::hasWorkOrStopping() const {
+    if (mState != RUNNING || mPendingCount != 0) {
+        return true;
+    }
+    for (size_t i = 0; i < mThreadCount; i++) {
+        if (!mWorkers[i]->mDeque.isEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runTask(ThreadPoolTask* task) {
+    if (android_atomic_acquire_load(&mState) == CANCELLING) {
+        task->complete(DEAD_OBJECT);
+    } else {
+        task->run();
+        task->complete(NO_ERROR);
+    }
+    task->decStrong(this);
+}
+
+// Runs other tasks until 'task' is done or there is nothing left that this
+// worker can take, in which case 'task' is running on another worker.
+void ThreadPool::helpUntilDone(Worker* worker, ThreadPoolTask* task) {
+    while (!task->isDone()) {
+        ThreadPoolTask* other = findTask(worker);
+        if (other == NULL) {
+            return;
+        }
+        runTask(other);
+    }
+}
+
+}; // namespace android
@@ -18,6 +18,12 @@
 
 #include <stddef.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #ifdef HAVE_WINSOCK
 # undef  nhtol
 # undef  htonl
@@ -68,6 +74,137 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// --------------------------------------------------------------------------
+// ASCII runs
+// --------------------------------------------------------------------------
+
+// Most text converted between UTF-8 and UTF-16 is largely ASCII.  These
+// helpers handle the ASCII run at the start of their input, kAsciiBlock
+// characters per step with SSE2 or NEON, and return its length; callers
+// decode anything else one code point at a time.
+
+static const size_t kAsciiBlock = 16;
+
+static inline size_t utf8_ascii_prefix(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const int high = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (src + i)));
+        if (high != 0) {
+            return i + __builtin_ctz(high);
+        }
+    }
+#elif defined(__ARM_NEON__)
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const uint8x16_t v = vld1q_u8(src + i);
+        const uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+static inline size_t utf8_ascii_to_utf16(const uint8_t* src, size_t len, char16_t* dst)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*) (dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(__ARM_NEON__)
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const uint8x16_t v = vld1q_u8(src + i);
+        const uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) & 0x8080808080808080ULL) {
+            break;
+        }
+        vst1q_u16((uint16_t*) (dst + i), vmovl_u8(vget_low_u8(v)));
+        vst1q_u16((uint16_t*) (dst + i + 8), vmovl_u8(vget_high_u8(v)));
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        dst[i] = src[i];
+        i++;
+    }
+    return i;
+}
+
+static inline size_t utf16_ascii_prefix(const char16_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i nonAscii = _mm_set1_epi16((short) 0xff80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const __m128i a = _mm_loadu_si128((const __m128i*) (src + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*) (src + i + 8));
+        const __m128i high = _mm_and_si128(_mm_or_si128(a, b), nonAscii);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xffff) {
+            break;
+        }
+    }
+#elif defined(__ARM_NEON__)
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const uint16x8_t both = vorrq_u16(vld1q_u16((const uint16_t*) (src + i)),
+                vld1q_u16((const uint16_t*) (src + i + 8)));
+        const uint16x4_t folded = vorr_u16(vget_low_u16(both), vget_high_u16(both));
+        if (vget_lane_u64(vreinterpret_u64_u16(folded), 0) & 0xff80ff80ff80ff80ULL) {
+            break;
+        }
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+static inline size_t utf16_ascii_to_utf8(const char16_t* src, size_t len, char* dst)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i nonAscii = _mm_set1_epi16((short) 0xff80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const __m128i a = _mm_loadu_si128((const __m128i*) (src + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*) (src + i + 8));
+        const __m128i high = _mm_and_si128(_mm_or_si128(a, b), nonAscii);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xffff) {
+            break;
+        }
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(__ARM_NEON__)
+    for (; i + kAsciiBlock <= len; i += kAsciiBlock) {
+        const uint16x8_t a = vld1q_u16((const uint16_t*) (src + i));
+        const uint16x8_t b = vld1q_u16((const uint16_t*) (src + i + 8));
+        const uint16x8_t both = vorrq_u16(a, b);
+        const uint16x4_t folded = vorr_u16(vget_low_u16(both), vget_high_u16(both));
+        if (vget_lane_u64(vreinterpret_u64_u16(folded), 0) & 0xff80ff80ff80ff80ULL) {
+            break;
+        }
+        vst1q_u8((uint8_t*) (dst + i), vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        dst[i] = (char) src[i];
+        i++;
+    }
+    return i;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -340,6 +477,12 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst)
     const char16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            const size_t n = utf16_ascii_to_utf8(cur_utf16, end_utf16 - cur_utf16, cur);
+            cur_utf16 += n;
+            cur += n;
+            continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if ((*cur_utf16 & 0xFC00) == 0xD800) {
@@ -412,6 +555,12 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     size_t ret = 0;
     const char16_t* const end = src + src_len;
     while (src < end) {
+        if (*src < 0x80) {
+            const size_t n = utf16_ascii_prefix(src, end - src);
+            ret += n;
+            src += n;
+            continue;
+        }
         if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*++src & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
@@ -524,6 +673,12 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len)
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t n = utf8_ascii_prefix(u8cur, u8end - u8cur);
+            u16measuredLen += n;
+            u8cur += n;
+            continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8charLen);
@@ -549,6 +704,12 @@ char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* u8str, size_t u8len, c
     char16_t* u16cur = u16str;
 
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t n = utf8_ascii_to_utf16(u8cur, u8end - u8cur, u16cur);
+            u8cur += n;
+            u16cur += n;
+            continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
@@ -334,8 +334,14 @@ ssize_t VectorImpl::setCapacity(size_t new_capacity)
     SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
     if (sb) {
         void* array = sb->data();
-        _do_copy(array, mStorage, size());
-        release_storage();
+        const SharedBuffer* cur_sb = mStorage ? SharedBuffer::bufferFromData(mStorage) : 0;
+        if (cur_sb && cur_sb->onlyOwner()) {
+            _do_move_forward(array, mStorage, size());
+            cur_sb->release();
+        } else {
+            _do_copy(array, mStorage, size());
+            release_storage();
+        }
         mStorage = const_cast<void*>(array);
     } else {
         return NO_MEMORY;
@@ -353,6 +359,12 @@ ssize_t VectorImpl::resize(size_t size) {
     return result < 0 ? result : size;
 }
 
+void VectorImpl::setGrowthPolicy(uint32_t policy)
+{
+    const uint32_t mask = GROW_BY_DOUBLING | KEEP_CAPACITY;
+    mFlags = (mFlags & ~mask) | (policy & mask);
+}
+
 void VectorImpl::release_storage()
 {
     if (mStorage) {
@@ -364,6 +376,17 @@ void VectorImpl::release_storage()
     }
 }
 
+// Whether the buffer can be reallocated with its items moved bitwise.
+// Items that are only trivially movable can't be left behind in a buffer
+// that is still in use elsewhere.
+bool VectorImpl::_can_resize_in_place(const SharedBuffer* sb) const
+{
+    if ((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) {
+        return true;
+    }
+    return (mFlags & HAS_TRIVIAL_MOVE) && sb->onlyOwner();
+}
+
 void* VectorImpl::_grow(size_t where, size_t amount)
 {
 //    ALOGV("_grow(this=%p, where=%d, amount=%d) count=%d, capacity=%d",
@@ -375,33 +398,53 @@ void* VectorImpl::_grow(size_t where, size_t amount)
 
     const size_t new_size = mCount + amount;
     if (capacity() < new_size) {
-        const size_t new_capacity = max(kMinVectorCapacity, ((new_size*3)+1)/2);
+        const size_t new_capacity = max(kMinVectorCapacity,
+                (mFlags & GROW_BY_DOUBLING) ? new_size*2 : ((new_size*3)+1)/2);
 //        ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
-        if ((mStorage) &&
-            (mCount==where) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+        const SharedBuffer* cur_sb = mStorage ? SharedBuffer::bufferFromData(mStorage) : 0;
+        if ((cur_sb) &&
+            (mCount==where || cur_sb->onlyOwner()) &&
+            _can_resize_in_place(cur_sb))
         {
-            const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
             if (sb) {
                 mStorage = sb->data();
             } else {
                 return NULL;
             }
+            if (where != mCount) {
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* to = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                _do_move_forward(to, from, mCount - where);
+            }
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
                 void* array = sb->data();
+                // if nobody else uses the old buffer, its items can be moved
+                // instead of copied and destroyed.
+                const bool move = cur_sb && cur_sb->onlyOwner();
                 if (where != 0) {
-                    _do_copy(array, mStorage, where);
+                    if (move) {
+                        _do_move_forward(array, mStorage, where);
+                    } else {
+                        _do_copy(array, mStorage, where);
+                    }
                 }
                 if (where != mCount) {
                     const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
                     void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
+                    if (move) {
+                        _do_move_forward(dest, from, mCount-where);
+                    } else {
+                        _do_copy(dest, from, mCount-where);
+                    }
+                }
+                if (move) {
+                    cur_sb->release();
+                } else {
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else {
                 return NULL;
@@ -433,18 +476,26 @@ void VectorImpl::_shrink(size_t where, size_t amount)
             this, (int)where, (int)amount, (int)mCount); // caller already checked
 
     const size_t new_size = mCount - amount;
-    if (new_size*3 < capacity()) {
+    if (new_size*3 < capacity() && !(mFlags & KEEP_CAPACITY)) {
         const size_t new_capacity = max(kMinVectorCapacity, new_size*2);
 //        ALOGV("shrink vector %p, new_capacity=%d", this, (int)new_capacity);
-        if ((where == new_size) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+        const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
+        const bool only_owner = cur_sb->onlyOwner();
+        if ((where == new_size || only_owner) &&
+            _can_resize_in_place(cur_sb))
         {
-            const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
+            if (only_owner) {
+                void* to = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+                _do_destroy(to, amount);
+                if (where != new_size) {
+                    const void* from = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                    _do_move_backward(to, from, new_size - where);
+                }
+            }
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
             if (sb) {
                 mStorage = sb->data();
-            } else {
+            } else if (!only_owner) {
                 return;
             }
         } else {
@@ -452,14 +503,27 @@ void VectorImpl::_shrink(size_t where, size_t amount)
             if (sb) {
                 void* array = sb->data();
                 if (where != 0) {
-                    _do_copy(array, mStorage, where);
+                    if (only_owner) {
+                        _do_move_forward(array, mStorage, where);
+                    } else {
+                        _do_copy(array, mStorage, where);
+                    }
                 }
                 if (where != new_size) {
                     const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
                     void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
-                    _do_copy(dest, from, new_size - where);
+                    if (only_owner) {
+                        _do_move_forward(dest, from, new_size - where);
+                    } else {
+                        _do_copy(dest, from, new_size - where);
+                    }
+                }
+                if (only_owner) {
+                    _do_destroy(reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize, amount);
+                    cur_sb->release();
+                } else {
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else {
                 return;
@@ -587,39 +651,195 @@ ssize_t SortedVectorImpl::add(const void* item)
     return index;
 }
 
-ssize_t SortedVectorImpl::merge(const VectorImpl& vector)
+ssize_t SortedVectorImpl::addAll(const void* array, size_t count)
 {
-    // naive merge...
-    if (!vector.isEmpty()) {
-        const void* buffer = vector.arrayImpl();
-        const size_t is = itemSize();
-        size_t s = vector.size();
-        for (size_t i=0 ; i<s ; i++) {
-            ssize_t err = add( reinterpret_cast<const char*>(buffer) + i*is );
-            if (err<0) {
-                return err;
+    if (count == 0) {
+        return NO_ERROR;
+    }
+    const void** items = static_cast<const void**>(malloc(count * sizeof(void*)));
+    if (!items) {
+        return NO_MEMORY;
+    }
+    const size_t is = itemSize();
+    bool sorted = true;
+    for (size_t i=0 ; i<count ; i++) {
+        items[i] = reinterpret_cast<const char*>(array) + i*is;
+        if (sorted && i && do_compare(items[i-1], items[i]) >= 0) {
+            sorted = false;
+        }
+    }
+
+    size_t unique = count;
+    if (!sorted) {
+        const void** scratch = static_cast<const void**>(malloc(count * sizeof(void*)));
+        if (!scratch) {
+            free(items);
+            return NO_MEMORY;
+        }
+        _sort(items, scratch, count);
+        free(scratch);
+
+        // the sort is stable, so of equal items the last one given comes
+        // last, and is the one add() would have kept.
+        unique = 0;
+        for (size_t i=0 ; i<count ; i++) {
+            if (i+1 < count && do_compare(items[i], items[i+1]) == 0) {
+                continue;
             }
+            items[unique++] = items[i];
         }
     }
-    return NO_ERROR;
+
+    ssize_t err = _merge(items, unique);
+    free(items);
+    return err;
+}
+
+ssize_t SortedVectorImpl::merge(const VectorImpl& vector)
+{
+    return addAll(vector.arrayImpl(), vector.size());
 }
 
 ssize_t SortedVectorImpl::merge(const SortedVectorImpl& vector)
 {
     // we've merging a sorted vector... nice!
-    ssize_t err = NO_ERROR;
-    if (!vector.isEmpty()) {
-        // first take care of the case where the vectors are sorted together
-        if (do_compare(vector.itemLocation(vector.size()-1), arrayImpl()) <= 0) {
-            err = VectorImpl::insertVectorAt(static_cast<const VectorImpl&>(vector), 0);
-        } else if (do_compare(vector.arrayImpl(), itemLocation(size()-1)) >= 0) {
-            err = VectorImpl::appendVector(static_cast<const VectorImpl&>(vector));
+    const size_t count = vector.size();
+    if (count == 0 || &vector == this) {
+        return NO_ERROR;
+    }
+    const void** items = static_cast<const void**>(malloc(count * sizeof(void*)));
+    if (!items) {
+        return NO_MEMORY;
+    }
+    for (size_t i=0 ; i<count ; i++) {
+        items[i] = vector.itemLocation(i);
+    }
+    ssize_t err = _merge(items, count);
+    free(items);
+    return err;
+}
+
+// Stable bottom-up merge sort of an array of item pointers: insertion sorted
+// runs of 16 items, then merged pairwise, going back and forth between
+// 'items' and 'scratch'.
+void SortedVectorImpl::_sort(const void** items, const void** scratch, size_t count) const
+{
+    const size_t kRun = 16;
+    for (size_t start=0 ; start<count ; start+=kRun) {
+        const size_t end = start+kRun < count ? start+kRun : count;
+        for (size_t i=start+1 ; i<end ; i++) {
+            const void* item = items[i];
+            size_t j = i;
+            while (j > start && do_compare(items[j-1], item) > 0) {
+                items[j] = items[j-1];
+                j--;
+            }
+            items[j] = item;
+        }
+    }
+
+    const void** from = items;
+    const void** to = scratch;
+    for (size_t width=kRun ; width<count ; width*=2) {
+        for (size_t left=0 ; left<count ; left+=2*width) {
+            const size_t middle = left+width < count ? left+width : count;
+            const size_t right = middle+width < count ? middle+width : count;
+            size_t i = left, j = middle, k = left;
+            while (i < middle && j < right) {
+                // take from the left on ties to keep the sort stable
+                if (do_compare(from[j], from[i]) < 0) {
+                    to[k++] = from[j++];
+                } else {
+                    to[k++] = from[i++];
+                }
+            }
+            while (i < middle) to[k++] = from[i++];
+            while (j < right) to[k++] = from[j++];
+        }
+        const void** tmp = from;
+        from = to;
+        to = tmp;
+    }
+    if (from != items) {
+        memcpy(items, from, count * sizeof(void*));
+    }
+}
+
+// Merges 'count' sorted, distinct items into this vector in one pass.  An
+// item equal to one already in the vector replaces it, like add().
+ssize_t SortedVectorImpl::_merge(const void* const* items, size_t count)
+{
+    if (count == 0) {
+        return NO_ERROR;
+    }
+    const size_t n = size();
+    const size_t is = itemSize();
+    if (n == 0 || do_compare(itemLocation(n-1), items[0]) < 0) {
+        // all the new items go after the existing ones
+        char* where = static_cast<char*>(_grow(n, count));
+        if (!where) {
+            return NO_MEMORY;
+        }
+        for (size_t i=0 ; i<count ; i++) {
+            _do_copy(where + i*is, items[i], 1);
+        }
+        return NO_ERROR;
+    }
+
+    SharedBuffer* sb = SharedBuffer::alloc((n + count) * is);
+    if (!sb) {
+        return NO_MEMORY;
+    }
+    char* const dest = static_cast<char*>(sb->data());
+    char* const src = static_cast<char*>(mStorage);
+    const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
+    // if nobody else uses the old buffer, its items can be moved instead of
+    // copied and destroyed.
+    const bool move = cur_sb->onlyOwner();
+
+    size_t i = 0, j = 0, out = 0;
+    size_t run = 0; // first existing item not transferred yet
+    while (j < count) {
+        int c = -1;
+        while (i < n && (c = do_compare(src + i*is, items[j])) < 0) {
+            i++;
+        }
+        if (i != run) {
+            if (move) {
+                _do_move_forward(dest + out*is, src + run*is, i - run);
+            } else {
+                _do_copy(dest + out*is, src + run*is, i - run);
+            }
+            out += i - run;
+        }
+        _do_copy(dest + out*is, items[j], 1);
+        out++;
+        if (i < n && c == 0) {
+            if (move) {
+                _do_destroy(src + i*is, 1);
+            }
+            i++;
+        }
+        run = i;
+        j++;
+    }
+    if (run != n) {
+        if (move) {
+            _do_move_forward(dest + out*is, src + run*is, n - run);
         } else {
-            // this could be made a little better
-            err = merge(static_cast<const VectorImpl&>(vector));
+            _do_copy(dest + out*is, src + run*is, n - run);
         }
+        out += n - run;
     }
-    return err;
+
+    if (move) {
+        cur_sb->release();
+    } else {
+        release_storage();
+    }
+    mStorage = dest;
+    mCount = out;
+    return NO_ERROR;
 }
 
 ssize_t SortedVectorImpl::remove(const void* item)
@@ -4,12 +4,23 @@ include $(CLEAR_VARS)
 
 # Build the unit tests.
 test_src_files := \
+    Atomic_test.cpp \
     BasicHashtable_test.cpp \
     BlobCache_test.cpp \
     BitSet_test.cpp \
+    ConcurrentHashmap_test.cpp \
+    ConcurrentQueue_test.cpp \
+    FlatHashMap_test.cpp \
+    LogBatch_test.cpp \
     Looper_test.cpp \
     LruCache_test.cpp \
+    Properties_test.cpp \
+    RefBase_test.cpp \
+    SortedVector_test.cpp \
+    StrParms_test.cpp \
+    String16_test.cpp \
     String8_test.cpp \
+    ThreadPool_test.cpp \
     Unicode_test.cpp \
     Vector_test.cpp
 
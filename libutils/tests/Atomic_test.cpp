@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/atomic.h>
+#include <cutils/atomic-explicit.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+
+TEST(AtomicTest, Operations) {
+    volatile int32_t value = 5;
+    EXPECT_EQ(5, android_atomic_inc(&value));
+    EXPECT_EQ(6, android_atomic_dec(&value));
+    EXPECT_EQ(5, android_atomic_add(10, &value));
+    EXPECT_EQ(15, android_atomic_and(6, &value));
+    EXPECT_EQ(6, android_atomic_or(9, &value));
+    EXPECT_EQ(15, android_atomic_acquire_load(&value));
+    EXPECT_EQ(15, android_atomic_release_load(&value));
+    android_atomic_acquire_store(3, &value);
+    android_atomic_release_store(4, &value);
+    EXPECT_EQ(4, value);
+    EXPECT_NE(0, android_atomic_acquire_cas(3, 7, &value));
+    EXPECT_EQ(0, android_atomic_acquire_cas(4, 7, &value));
+    EXPECT_EQ(0, android_atomic_release_cas(7, 8, &value));
+    EXPECT_EQ(8, value);
+}
+
+TEST(AtomicTest, ExplicitOperations) {
+    volatile int32_t value = 5;
+    EXPECT_EQ(5, android_atomic_add_explicit(1, &value, ANDROID_MEMORY_ORDER_RELAXED));
+    EXPECT_EQ(6, android_atomic_add_explicit(-2, &value, ANDROID_MEMORY_ORDER_RELEASE));
+    EXPECT_EQ(4, android_atomic_or_explicit(3, &value, ANDROID_MEMORY_ORDER_ACQ_REL));
+    EXPECT_EQ(7, android_atomic_and_explicit(5, &value, ANDROID_MEMORY_ORDER_SEQ_CST));
+    EXPECT_EQ(5, android_atomic_load_explicit(&value, ANDROID_MEMORY_ORDER_ACQUIRE));
+    android_atomic_store_explicit(9, &value, ANDROID_MEMORY_ORDER_RELEASE);
+    EXPECT_EQ(9, android_atomic_load_explicit(&value, ANDROID_MEMORY_ORDER_RELAXED));
+    EXPECT_NE(0, android_atomic_cas_explicit(8, 1, &value, ANDROID_MEMORY_ORDER_ACQUIRE));
+    EXPECT_EQ(0, android_atomic_cas_explicit(9, 1, &value, ANDROID_MEMORY_ORDER_RELEASE));
+    EXPECT_EQ(1, value);
+
+    const int64_t big = 0x100000000LL;
+    volatile int64_t value64 = big - 1;
+    EXPECT_EQ(big - 1, android_atomic64_add_explicit(1, &value64, ANDROID_MEMORY_ORDER_RELAXED));
+    EXPECT_EQ(big, android_atomic64_load_explicit(&value64, ANDROID_MEMORY_ORDER_ACQUIRE));
+    android_atomic64_store_explicit(-big, &value64, ANDROID_MEMORY_ORDER_RELEASE);
+    EXPECT_EQ(-big, android_atomic64_load_explicit(&value64, ANDROID_MEMORY_ORDER_SEQ_CST));
+    EXPECT_NE(0, android_atomic64_cas_explicit(big, 0, &value64, ANDROID_MEMORY_ORDER_ACQ_REL));
+    EXPECT_EQ(0, android_atomic64_cas_explicit(-big, big * 3, &value64,
+            ANDROID_MEMORY_ORDER_RELAXED));
+    EXPECT_EQ(big * 3, value64);
+}
+
+// ---------------------------------------------------------------------------
+// Litmus tests.  Each runs two or more threads through a pattern many times
+// and checks for an outcome the memory orders forbid.  A pass does not prove
+// much on a machine that happens not to reorder (or has a single CPU), but a
+// failure is a real bug.
+
+static void runThreads(void* (*body)(void*), void* arg, int count) {
+    pthread_t threads[8];
+    for (int i = 0; i < count; i++) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, body, arg));
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Message passing: a RELEASE store of the flag publishes the data written
+// before it to a thread that reads the flag with ACQUIRE.
+struct MessagePassing {
+    volatile int32_t data;
+    volatile int32_t flag;
+    volatile int32_t started;
+    volatile int32_t failures;
+};
+
+static const int32_t kMessages = 1000000;
+
+static void* messagePassingThread(void* arg) {
+    MessagePassing* mp = static_cast<MessagePassing*>(arg);
+    if (android_atomic_add_explicit(1, &mp->started, ANDROID_MEMORY_ORDER_RELAXED) == 0) {
+        for (int32_t i = 1; i <= kMessages; i++) {
+            android_atomic_store_explicit(i, &mp->data, ANDROID_MEMORY_ORDER_RELAXED);
+            android_atomic_store_explicit(i, &mp->flag, ANDROID_MEMORY_ORDER_RELEASE);
+        }
+    } else {
+        int32_t flag = 0;
+        while (flag < kMessages) {
+            flag = android_atomic_load_explicit(&mp->flag, ANDROID_MEMORY_ORDER_ACQUIRE);
+            // data only grows, and was at least 'flag' before flag was stored.
+            if (android_atomic_load_explicit(&mp->data, ANDROID_MEMORY_ORDER_RELAXED) < flag) {
+                mp->failures++;
+            }
+        }
+    }
+    return NULL;
+}
+
+TEST(AtomicLitmusTest, MessagePassing) {
+    MessagePassing mp = { 0, 0, 0, 0 };
+    runThreads(messagePassingThread, &mp, 2);
+    EXPECT_EQ(0, mp.failures);
+}
+
+// Store buffering: with a SEQ_CST fence between each thread's store and its
+// load, at least one of the two threads sees the other's store.
+struct StoreBuffering {
+    volatile int32_t x;
+    volatile int32_t y;
+    volatile int32_t round;
+    volatile int32_t arrived;
+    volatile int32_t started;
+    int32_t seen[2];
+    volatile int32_t failures;
+};
+
+static const int32_t kRounds = 20000;
+
+// Waits for both threads, then starts the next round.
+static void nextRound(StoreBuffering* sb, int32_t round) {
+    if (android_atomic_add_explicit(1, &sb->arrived, ANDROID_MEMORY_ORDER_ACQ_REL) % 2 == 1) {
+        android_atomic_store_explicit(round + 1, &sb->round, ANDROID_MEMORY_ORDER_RELEASE);
+    }
+    while (android_atomic_load_explicit(&sb->round, ANDROID_MEMORY_ORDER_ACQUIRE) <= round) {
+        sched_yield();
+    }
+}
+
+static void* storeBufferingThread(void* arg) {
+    StoreBuffering* sb = static_cast<StoreBuffering*>(arg);
+    const int32_t self = android_atomic_add_explicit(1, &sb->started,
+            ANDROID_MEMORY_ORDER_RELAXED);
+    volatile int32_t* mine = self ? &sb->y : &sb->x;
+    volatile int32_t* theirs = self ? &sb->x : &sb->y;
+    for (int32_t round = 0; round < kRounds; round++) {
+        android_atomic_store_explicit(round + 1, mine, ANDROID_MEMORY_ORDER_RELAXED);
+        android_atomic_fence(ANDROID_MEMORY_ORDER_SEQ_CST);
+        sb->seen[self] = android_atomic_load_explicit(theirs, ANDROID_MEMORY_ORDER_RELAXED);
+        nextRound(sb, 2 * round);
+        if (self == 0 && sb->seen[0] <= round && sb->seen[1] <= round) {
+            sb->failures++;
+        }
+        nextRound(sb, 2 * round + 1);
+    }
+    return NULL;
+}
+
+TEST(AtomicLitmusTest, StoreBufferingWithFences) {
+    StoreBuffering sb;
+    memset(&sb, 0, sizeof(sb));
+    runThreads(storeBufferingThread, &sb, 2);
+    EXPECT_EQ(0, sb.failures);
+}
+
+// Read-modify-write operations are atomic with any order, for 32 and 64 bits.
+struct Counters {
+    volatile int32_t count32;
+    volatile int64_t count64;
+};
+
+static const int kIncrements = 200000;
+
+static void* incrementThread(void* arg) {
+    Counters* counters = static_cast<Counters*>(arg);
+    for (int i = 0; i < kIncrements; i++) {
+        android_atomic_add_explicit(1, &counters->count32, ANDROID_MEMORY_ORDER_RELAXED);
+        // carries across the two halves on 32-bit CPUs
+        android_atomic64_add_explicit(0x100000001LL, &counters->count64,
+                ANDROID_MEMORY_ORDER_RELAXED);
+    }
+    return NULL;
+}
+
+TEST(AtomicLitmusTest, RelaxedIncrementsAreAtomic) {
+    Counters counters = { 0, 0 };
+    runThreads(incrementThread, &counters, 4);
+    EXPECT_EQ(4 * kIncrements, counters.count32);
+    EXPECT_EQ(4 * kIncrements * 0x100000001LL, counters.count64);
+}
+
+// 64-bit loads and stores are never torn.
+struct Tearing {
+    volatile int64_t value;
+    volatile int32_t started;
+    volatile int32_t done;
+    volatile int32_t failures;
+};
+
+static void* tearingThread(void* arg) {
+    Tearing* t = static_cast<Tearing*>(arg);
+    if (android_atomic_add_explicit(1, &t->started, ANDROID_MEMORY_ORDER_RELAXED) == 0) {
+        for (int i = 0; i < kIncrements; i++) {
+            android_atomic64_store_explicit(i & 1 ? -1 : 0, &t->value,
+                    ANDROID_MEMORY_ORDER_RELAXED);
+        }
+        android_atomic_store_explicit(1, &t->done, ANDROID_MEMORY_ORDER_RELEASE);
+    } else {
+        while (!android_atomic_load_explicit(&t->done, ANDROID_MEMORY_ORDER_ACQUIRE)) {
+            int64_t value = android_atomic64_load_explicit(&t->value,
+                    ANDROID_MEMORY_ORDER_RELAXED);
+            if (value != 0 && value != -1) {
+                t->failures++;
+            }
+        }
+    }
+    return NULL;
+}
+
+TEST(AtomicLitmusTest, NoTorn64BitAccesses) {
+    Tearing t = { 0, 0, 0, 0 };
+    runThreads(tearingThread, &t, 2);
+    EXPECT_EQ(0, t.failures);
+}
+
+// The thread that drops the last reference sees everything the other owners
+// wrote before dropping theirs.
+class Shared : public LightRefBase<Shared> {
+public:
+    Shared(volatile int32_t* failures) : mFailures(failures) {
+        memset(mWritten, 0, sizeof(mWritten));
+    }
+    ~Shared() {
+        for (int i = 0; i < 4; i++) {
+            if (mWritten[i] != 1) {
+                android_atomic_inc(mFailures);
+            }
+        }
+    }
+    int32_t mWritten[4];
+    volatile int32_t* mFailures;
+};
+
+struct RefCounting {
+    Shared* shared;
+    volatile int32_t next;
+};
+
+static void* refCountingThread(void* arg) {
+    RefCounting* rc = static_cast<RefCounting*>(arg);
+    const int32_t self = android_atomic_add_explicit(1, &rc->next, ANDROID_MEMORY_ORDER_RELAXED);
+    Shared* shared = rc->shared;
+    shared->mWritten[self] = 1;
+    shared->decStrong(rc);
+    return NULL;
+}
+
+TEST(AtomicLitmusTest, LastReferenceSeesOtherOwnersWrites) {
+    volatile int32_t failures = 0;
+    for (int round = 0; round < 1000; round++) {
+        RefCounting rc = { new Shared(&failures), 0 };
+        for (int i = 0; i < 4; i++) {
+            rc.shared->incStrong(&rc);
+        }
+        runThreads(refCountingThread, &rc, 4);
+    }
+    EXPECT_EQ(0, failures);
+}
+
+// ---------------------------------------------------------------------------
+
+class Counted : public RefBase {
+};
+
+class LightCounted : public LightRefBase<LightCounted> {
+};
+
+static const int kIterations = 10000000;
+
+// The increment and decrement of one reference, as in incStrong()/decStrong().
+TEST(AtomicBenchmark, Benchmark_RefCounting) {
+    volatile int32_t count = 1;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        android_atomic_inc(&count);
+        android_atomic_dec(&count);
+    }
+    nsecs_t legacy = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        android_atomic_add_explicit(1, &count, ANDROID_MEMORY_ORDER_RELAXED);
+        if (android_atomic_add_explicit(-1, &count, ANDROID_MEMORY_ORDER_RELEASE) == 1) {
+            android_atomic_fence(ANDROID_MEMORY_ORDER_ACQUIRE);
+        }
+    }
+    nsecs_t explicitOrder = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    sp<Counted> counted = new Counted();
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        counted->incStrong(&start);
+        counted->decStrong(&start);
+    }
+    nsecs_t refBase = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    RefBase::weakref_type* weak = counted->createWeak(&start);
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        counted->incStrong(&start);
+        counted->decStrong(&start);
+    }
+    nsecs_t inflated = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    weak->decWeak(&start);
+
+    sp<LightCounted> light = new LightCounted();
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        light->incStrong(&start);
+        light->decStrong(&start);
+    }
+    nsecs_t lightRefBase = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    printf("inc + dec: android_atomic_inc/dec %.1f ns, explicit %.1f ns; "
+            "RefBase %.1f ns (%.1f ns with weak refs), LightRefBase %.1f ns\n",
+            double(legacy) / kIterations, double(explicitOrder) / kIterations,
+            double(refBase) / kIterations, double(inflated) / kIterations,
+            double(lightRefBase) / kIterations);
+}
+
+} // namespace android
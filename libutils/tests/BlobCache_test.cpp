@@ -16,11 +16,14 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <gtest/gtest.h>
 
 #include <utils/BlobCache.h>
 #include <utils/Errors.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -235,7 +238,7 @@ TEST_F(BlobCacheTest, CacheSizeDoesntExceedTotalLimit) {
     ASSERT_GE(MAX_TOTAL_SIZE / 2, numCached);
 }
 
-TEST_F(BlobCacheTest, ExceedingTotalLimitHalvesCacheSize) {
+TEST_F(BlobCacheTest, ExceedingTotalLimitEvictsOldestEntry) {
     // Fill up the entire cache with 1 char key/value pairs.
     const int maxEntries = MAX_TOTAL_SIZE / 2;
     for (int i = 0; i < maxEntries; i++) {
@@ -247,15 +250,55 @@ TEST_F(BlobCacheTest, ExceedingTotalLimitHalvesCacheSize) {
         uint8_t k = maxEntries;
         mBC->set(&k, 1, "x", 1);
     }
-    // Count the number of entries in the cache.
-    int numCached = 0;
+    // Only the first entry should have been evicted.
     for (int i = 0; i < maxEntries+1; i++) {
         uint8_t k = i;
-        if (mBC->get(&k, 1, NULL, 0) == 1) {
-            numCached++;
-        }
+        ASSERT_EQ(size_t(i == 0 ? 0 : 1), mBC->get(&k, 1, NULL, 0)) << "key " << i;
+    }
+}
+
+TEST_F(BlobCacheTest, GetProtectsEntryFromEviction) {
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
     }
-    ASSERT_EQ(maxEntries/2 + 1, numCached);
+    // Use the oldest entry, then overflow the cache.
+    uint8_t k = 0;
+    ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    k = maxEntries;
+    mBC->set(&k, 1, "x", 1);
+
+    k = 0;
+    ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    k = 1;
+    ASSERT_EQ(size_t(0), mBC->get(&k, 1, NULL, 0));
+}
+
+TEST_F(BlobCacheTest, LargeValueEvictsOnlyWhatItNeeds) {
+    mBC->set("a", 1, "1", 1);
+    mBC->set("b", 1, "2", 1);
+    mBC->set("c", 1, "3", 1);
+    mBC->set("d", 1, "4", 1);
+    // 8 bytes are in use; a 9 byte pair needs the oldest two pairs to go.
+    mBC->set("e", 1, "55555555", 8);
+    ASSERT_EQ(size_t(0), mBC->get("a", 1, NULL, 0));
+    ASSERT_EQ(size_t(0), mBC->get("b", 1, NULL, 0));
+    ASSERT_EQ(size_t(1), mBC->get("c", 1, NULL, 0));
+    ASSERT_EQ(size_t(1), mBC->get("d", 1, NULL, 0));
+    ASSERT_EQ(size_t(8), mBC->get("e", 1, NULL, 0));
+}
+
+TEST_F(BlobCacheTest, ReplacingValueReleasesItsSpace) {
+    mBC->set("abcd", 4, "efgh", 4);
+    for (int i = 0; i < 10; i++) {
+        mBC->set("abcd", 4, "ijklmnop", 8);
+        mBC->set("abcd", 4, "efgh", 4);
+    }
+    // 8 of 13 bytes are in use, so a 5 byte pair fits without evicting.
+    mBC->set("q", 1, "rstu", 4);
+    ASSERT_EQ(size_t(4), mBC->get("abcd", 4, NULL, 0));
+    ASSERT_EQ(size_t(4), mBC->get("q", 1, NULL, 0));
 }
 
 class BlobCacheFlattenTest : public BlobCacheTest {
@@ -311,6 +354,49 @@ TEST_F(BlobCacheFlattenTest, FlattenFullCache) {
     }
 }
 
+TEST_F(BlobCacheFlattenTest, UnflattenReplacesFullCache) {
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, &k, 1);
+        k += maxEntries;
+        mBC2->set(&k, 1, &k, 1);
+    }
+
+    roundTrip();
+
+    // The old contents of mBC2 must not take up space any more.
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        uint8_t v = 0xee;
+        ASSERT_EQ(size_t(1), mBC2->get(&k, 1, &v, 1));
+        ASSERT_EQ(k, v);
+        k += maxEntries;
+        ASSERT_EQ(size_t(0), mBC2->get(&k, 1, NULL, 0));
+    }
+}
+
+TEST_F(BlobCacheFlattenTest, UnflattenKeepsLruOrder) {
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, &k, 1);
+    }
+    // Make key 0 the most recently used, so key 1 is the oldest.
+    uint8_t k = 0;
+    ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+
+    roundTrip();
+
+    // Overflowing the deserialized cache must evict exactly key 1.
+    k = maxEntries;
+    mBC2->set(&k, 1, &k, 1);
+    for (int i = 0; i < maxEntries + 1; i++) {
+        k = i;
+        ASSERT_EQ(size_t(i == 1 ? 0 : 1), mBC2->get(&k, 1, NULL, 0)) << "key " << i;
+    }
+}
+
 TEST_F(BlobCacheFlattenTest, FlattenDoesntChangeCache) {
     // Fill up the entire cache with 1 char key/value pairs.
     const int maxEntries = MAX_TOTAL_SIZE / 2;
@@ -418,4 +504,74 @@ TEST_F(BlobCacheFlattenTest, UnflattenCatchesBufferTooSmall) {
     ASSERT_EQ(size_t(0), mBC2->get("abcd", 4, buf, 4));
 }
 
+// Replays a shader cache workload: programs are looked up with a Zipf-like
+// popularity, and every miss is followed by a set of the compiled binary.
+// The limits match the EGL blob cache; the working set is about three times
+// the total size limit.
+TEST(BlobCacheBenchmark, Benchmark_HitRateAndLatency) {
+    const size_t kPrograms = 4096;
+    const size_t kLookups = 200000;
+    const size_t kKeySize = 32;
+    const size_t kMaxValueSize = 2560;
+    sp<BlobCache> cache(new BlobCache(1024, 64 * 1024, 2 * 1024 * 1024));
+
+    // cdf[i] is the probability that one of the i + 1 most popular programs
+    // is used.
+    double* cdf = new double[kPrograms];
+    double total = 0;
+    for (size_t i = 0; i < kPrograms; i++) {
+        total += 1.0 / (i + 1);
+        cdf[i] = total;
+    }
+
+    srand(1);
+    uint8_t key[kKeySize];
+    uint8_t* value = new uint8_t[kMaxValueSize];
+    memset(value, 0x5a, kMaxValueSize);
+    size_t hits = 0;
+    nsecs_t getTime = 0, setTime = 0, maxSetTime = 0;
+    for (size_t i = 0; i < kLookups; i++) {
+        double r = total * rand() / RAND_MAX;
+        size_t lo = 0, hi = kPrograms - 1;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (cdf[mid] < r) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        // Scatter the popular programs over the key space.
+        uint32_t program = uint32_t(lo) * 2654435761U;
+        for (size_t j = 0; j < kKeySize; j += sizeof(program)) {
+            memcpy(key + j, &program, sizeof(program));
+        }
+        size_t valueSize = 512 + (program >> 21);
+
+        nsecs_t start = systemTime();
+        size_t found = cache->get(key, kKeySize, value, kMaxValueSize);
+        nsecs_t end = systemTime();
+        getTime += end - start;
+        if (found) {
+            hits++;
+            continue;
+        }
+        start = systemTime();
+        cache->set(key, kKeySize, value, valueSize);
+        end = systemTime();
+        setTime += end - start;
+        if (end - start > maxSetTime) {
+            maxSetTime = end - start;
+        }
+    }
+    size_t misses = kLookups - hits;
+    printf("%u programs, %u lookups: hit rate %.1f%%, get %lld ns, "
+            "set %lld ns (max %lld us), flattened size %u\n",
+            unsigned(kPrograms), unsigned(kLookups), 100.0 * hits / kLookups,
+            getTime / kLookups, misses ? setTime / misses : 0,
+            maxSetTime / 1000, unsigned(cache->getFlattenedSize()));
+    delete[] value;
+    delete[] cdf;
+}
+
 } // namespace android
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/atomic.h>
+#include <cutils/concurrent_hashmap.h>
+#include <cutils/hashmap.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace android {
+
+// Keys are small integers stored in the pointer itself.
+static int intptrHash(void* key) {
+    return int(intptr_t(key));
+}
+
+static bool intptrEquals(void* keyA, void* keyB) {
+    return keyA == keyB;
+}
+
+static void* keyFor(int i) {
+    return (void*) intptr_t(i + 1);
+}
+
+class ConcurrentHashmapTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        mMap = concurrentHashmapCreate(0, intptrHash, intptrEquals);
+        ASSERT_TRUE(mMap != NULL);
+    }
+
+    virtual void TearDown() {
+        concurrentHashmapFree(mMap);
+    }
+
+    ConcurrentHashmap* mMap;
+};
+
+TEST_F(ConcurrentHashmapTest, PutGetRemove) {
+    EXPECT_EQ(NULL, concurrentHashmapPut(mMap, keyFor(1), keyFor(10)));
+    EXPECT_EQ(NULL, concurrentHashmapPut(mMap, keyFor(2), keyFor(20)));
+    EXPECT_EQ(keyFor(10), concurrentHashmapPut(mMap, keyFor(1), keyFor(11)));
+    EXPECT_EQ(2U, concurrentHashmapSize(mMap));
+
+    EXPECT_EQ(keyFor(11), concurrentHashmapGet(mMap, keyFor(1)));
+    EXPECT_EQ(keyFor(20), concurrentHashmapGet(mMap, keyFor(2)));
+    EXPECT_EQ(NULL, concurrentHashmapGet(mMap, keyFor(3)));
+    EXPECT_TRUE(concurrentHashmapContainsKey(mMap, keyFor(2)));
+    EXPECT_FALSE(concurrentHashmapContainsKey(mMap, keyFor(3)));
+
+    EXPECT_EQ(keyFor(20), concurrentHashmapRemove(mMap, keyFor(2)));
+    EXPECT_EQ(NULL, concurrentHashmapRemove(mMap, keyFor(2)));
+    EXPECT_FALSE(concurrentHashmapContainsKey(mMap, keyFor(2)));
+    EXPECT_EQ(1U, concurrentHashmapSize(mMap));
+}
+
+static void* memoizedValue(void* key, void* context) {
+    (*static_cast<int*>(context))++;
+    return key;
+}
+
+TEST_F(ConcurrentHashmapTest, Memoize) {
+    int calls = 0;
+    EXPECT_EQ(keyFor(5), concurrentHashmapMemoize(mMap, keyFor(5), memoizedValue, &calls));
+    EXPECT_EQ(keyFor(5), concurrentHashmapMemoize(mMap, keyFor(5), memoizedValue, &calls));
+    EXPECT_EQ(1, calls);
+    EXPECT_EQ(keyFor(5), concurrentHashmapGet(mMap, keyFor(5)));
+}
+
+struct ForEachState {
+    int* seen;
+    int count;
+};
+
+static bool countEntry(void* key, void* value, void* context) {
+    ForEachState* state = static_cast<ForEachState*>(context);
+    state->seen[intptr_t(key) - 1]++;
+    state->count++;
+    return key != value; // stops at an entry mapped to itself
+}
+
+// Every entry stays reachable while stripes are halfway through a resize.
+TEST_F(ConcurrentHashmapTest, GrowsIncrementally) {
+    const int kCount = 20000;
+    size_t capacity = concurrentHashmapCurrentCapacity(mMap);
+    for (int i = 0; i < kCount; i++) {
+        ASSERT_EQ(NULL, concurrentHashmapPut(mMap, keyFor(i), keyFor(i + 1)));
+        if (i % 97 == 0) {
+            for (int j = 0; j <= i; j++) {
+                ASSERT_EQ(keyFor(j + 1), concurrentHashmapGet(mMap, keyFor(j))) << j;
+            }
+        }
+    }
+    EXPECT_EQ(size_t(kCount), concurrentHashmapSize(mMap));
+    EXPECT_LT(capacity, concurrentHashmapCurrentCapacity(mMap));
+
+    int seen[kCount] = { 0 };
+    ForEachState state = { seen, 0 };
+    concurrentHashmapForEach(mMap, countEntry, &state);
+    EXPECT_EQ(kCount, state.count);
+    for (int i = 0; i < kCount; i++) {
+        ASSERT_EQ(1, seen[i]) << i;
+    }
+
+    for (int i = 0; i < kCount; i += 2) {
+        ASSERT_EQ(keyFor(i + 1), concurrentHashmapRemove(mMap, keyFor(i)));
+    }
+    EXPECT_EQ(size_t(kCount / 2), concurrentHashmapSize(mMap));
+    for (int i = 0; i < kCount; i++) {
+        ASSERT_EQ(i % 2 != 0, concurrentHashmapContainsKey(mMap, keyFor(i))) << i;
+    }
+}
+
+TEST_F(ConcurrentHashmapTest, ForEachStops) {
+    for (int i = 0; i < 100; i++) {
+        concurrentHashmapPut(mMap, keyFor(i), keyFor(i == 50 ? i : i + 1));
+    }
+    int seen[100] = { 0 };
+    ForEachState state = { seen, 0 };
+    concurrentHashmapForEach(mMap, countEntry, &state);
+    EXPECT_EQ(1, seen[50]);
+    EXPECT_GT(100, state.count);
+}
+
+struct WriterArgs {
+    ConcurrentHashmap* map;
+    int first;
+    int count;
+    volatile int32_t* mismatches;
+};
+
+// Adds, checks and removes half of its own range of keys, repeatedly.
+static void* churnKeys(void* data) {
+    WriterArgs* args = static_cast<WriterArgs*>(data);
+    for (int round = 0; round < 20; round++) {
+        for (int i = args->first; i < args->first + args->count; i++) {
+            concurrentHashmapPut(args->map, keyFor(i), keyFor(i + round));
+        }
+        for (int i = args->first; i < args->first + args->count; i++) {
+            if (concurrentHashmapGet(args->map, keyFor(i)) != keyFor(i + round)) {
+                android_atomic_inc(args->mismatches);
+            }
+            if (i % 2 == 0) {
+                concurrentHashmapRemove(args->map, keyFor(i));
+            }
+        }
+    }
+    return NULL;
+}
+
+TEST_F(ConcurrentHashmapTest, ConcurrentWriters) {
+    const int kThreads = 4;
+    const int kKeysPerThread = 5000;
+    volatile int32_t mismatches = 0;
+    pthread_t threads[kThreads];
+    WriterArgs args[kThreads];
+    for (int i = 0; i < kThreads; i++) {
+        args[i].map = mMap;
+        args[i].first = i * kKeysPerThread;
+        args[i].count = kKeysPerThread;
+        args[i].mismatches = &mismatches;
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, churnKeys, &args[i]));
+    }
+    for (int i = 0; i < kThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    EXPECT_EQ(0, mismatches);
+    EXPECT_EQ(size_t(kThreads * kKeysPerThread / 2), concurrentHashmapSize(mMap));
+    for (int i = 0; i < kThreads * kKeysPerThread; i++) {
+        ASSERT_EQ(i % 2 == 0 ? NULL : keyFor(i + 19), concurrentHashmapGet(mMap, keyFor(i)));
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+// The same operations on a Hashmap behind hashmapLock(), the way callers
+// share one today.
+struct LockedMap {
+    static void* get(void* map, void* key) {
+        Hashmap* hashmap = static_cast<Hashmap*>(map);
+        hashmapLock(hashmap);
+        void* value = hashmapGet(hashmap, key);
+        hashmapUnlock(hashmap);
+        return value;
+    }
+    static void* put(void* map, void* key, void* value) {
+        Hashmap* hashmap = static_cast<Hashmap*>(map);
+        hashmapLock(hashmap);
+        void* old = hashmapPut(hashmap, key, value);
+        hashmapUnlock(hashmap);
+        return old;
+    }
+    static void* remove(void* map, void* key) {
+        Hashmap* hashmap = static_cast<Hashmap*>(map);
+        hashmapLock(hashmap);
+        void* old = hashmapRemove(hashmap, key);
+        hashmapUnlock(hashmap);
+        return old;
+    }
+};
+
+struct StripedMap {
+    static void* get(void* map, void* key) {
+        return concurrentHashmapGet(static_cast<ConcurrentHashmap*>(map), key);
+    }
+    static void* put(void* map, void* key, void* value) {
+        return concurrentHashmapPut(static_cast<ConcurrentHashmap*>(map), key, value);
+    }
+    static void* remove(void* map, void* key) {
+        return concurrentHashmapRemove(static_cast<ConcurrentHashmap*>(map), key);
+    }
+};
+
+static const int kBenchmarkKeys = 4096;
+static const int kBenchmarkReads = 1000000;
+
+struct BenchmarkArgs {
+    void* map;
+    int seed;
+    volatile int32_t* stop;
+};
+
+template<typename Map>
+static void* readKeys(void* data) {
+    BenchmarkArgs* args = static_cast<BenchmarkArgs*>(data);
+    uint32_t x = args->seed;
+    for (int i = 0; i < kBenchmarkReads; i++) {
+        x = x * 1103515245 + 12345;
+        Map::get(args->map, keyFor((x >> 8) % kBenchmarkKeys));
+    }
+    return NULL;
+}
+
+// Replaces keys above the ones the readers look up until told to stop.
+template<typename Map>
+static void* writeKeys(void* data) {
+    BenchmarkArgs* args = static_cast<BenchmarkArgs*>(data);
+    for (int i = 0; !android_atomic_acquire_load(args->stop); i++) {
+        int key = kBenchmarkKeys + i % 1024;
+        Map::put(args->map, keyFor(key), keyFor(i));
+        Map::remove(args->map, keyFor(key + 512));
+    }
+    return NULL;
+}
+
+// Nanoseconds per lookup, over all reader threads.
+template<typename Map>
+static nsecs_t timeReaders(void* map, int readers, bool writer) {
+    for (int i = 0; i < kBenchmarkKeys; i++) {
+        Map::put(map, keyFor(i), keyFor(i));
+    }
+    volatile int32_t stop = 0;
+    BenchmarkArgs args[8];
+    pthread_t threads[8];
+    pthread_t writerThread;
+    args[0].map = map;
+    args[0].seed = 0;
+    args[0].stop = &stop;
+    if (writer) {
+        pthread_create(&writerThread, NULL, writeKeys<Map>, &args[0]);
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < readers; i++) {
+        args[i].map = map;
+        args[i].seed = i;
+        args[i].stop = &stop;
+        pthread_create(&threads[i], NULL, readKeys<Map>, &args[i]);
+    }
+    for (int i = 0; i < readers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    if (writer) {
+        android_atomic_release_store(1, &stop);
+        pthread_join(writerThread, NULL);
+    }
+    return elapsed / (nsecs_t(readers) * kBenchmarkReads);
+}
+
+// Lookups from several reader threads, with and without a thread writing at
+// the same time.
+TEST(ConcurrentHashmapBenchmark, Benchmark_Readers) {
+    const int readerCounts[] = { 1, 2, 4, 8 };
+    for (int writer = 0; writer < 2; writer++) {
+        for (size_t i = 0; i < sizeof(readerCounts) / sizeof(readerCounts[0]); i++) {
+            Hashmap* hashmap = hashmapCreate(0, intptrHash, intptrEquals);
+            nsecs_t locked = timeReaders<LockedMap>(hashmap, readerCounts[i], writer);
+            hashmapFree(hashmap);
+
+            ConcurrentHashmap* striped = concurrentHashmapCreate(0, intptrHash, intptrEquals);
+            nsecs_t concurrent = timeReaders<StripedMap>(striped, readerCounts[i], writer);
+            concurrentHashmapFree(striped);
+
+            printf("%d readers%s: Hashmap %lld ns, ConcurrentHashmap %lld ns per lookup\n",
+                    readerCounts[i], writer ? " + writer" : "", locked, concurrent);
+        }
+    }
+}
+
+// Cost per put and the longest single put while growing from empty, and the
+// cost of removing and re-adding an entry.
+TEST(ConcurrentHashmapBenchmark, Benchmark_Growth) {
+    const int kCount = 1 << 20;
+    for (int striped = 0; striped < 2; striped++) {
+        Hashmap* hashmap = hashmapCreate(0, intptrHash, intptrEquals);
+        ConcurrentHashmap* concurrent = concurrentHashmapCreate(0, intptrHash, intptrEquals);
+        void* map = striped ? (void*) concurrent : (void*) hashmap;
+
+        nsecs_t longest = 0;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < kCount; i++) {
+            nsecs_t before = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (striped) {
+                StripedMap::put(map, keyFor(i), keyFor(i));
+            } else {
+                LockedMap::put(map, keyFor(i), keyFor(i));
+            }
+            nsecs_t took = systemTime(SYSTEM_TIME_MONOTONIC) - before;
+            if (took > longest) {
+                longest = took;
+            }
+        }
+        nsecs_t grow = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / kCount;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < kCount; i++) {
+            if (striped) {
+                StripedMap::remove(map, keyFor(i));
+                StripedMap::put(map, keyFor(i), keyFor(i));
+            } else {
+                LockedMap::remove(map, keyFor(i));
+                LockedMap::put(map, keyFor(i), keyFor(i));
+            }
+        }
+        nsecs_t churn = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / kCount;
+
+        printf("%s: %lld ns per put, longest put %lld us; remove + put %lld ns\n",
+                striped ? "ConcurrentHashmap" : "Hashmap", grow, longest / 1000, churn);
+        hashmapFree(hashmap);
+        concurrentHashmapFree(concurrent);
+    }
+}
+
+} // namespace android
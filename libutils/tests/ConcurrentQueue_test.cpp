@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <utils/ConcurrentQueue.h>
+#include <utils/RefBase.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class Counted : public RefBase {
+public:
+    static int instances;
+
+    Counted() { instances++; }
+
+protected:
+    virtual ~Counted() { instances--; }
+};
+
+int Counted::instances = 0;
+
+// Producer id in the high bits, sequence number in the low bits.
+static int32_t makeItem(int producer, int seq) {
+    return (producer << 24) | seq;
+}
+
+template<typename QUEUE>
+class PushThread : public Thread {
+public:
+    PushThread(QUEUE* queue, int id, int count, bool blocking) :
+            Thread(false), mQueue(queue), mId(id), mCount(count), mBlocking(blocking) { }
+
+private:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mCount; i++) {
+            int32_t item = makeItem(mId, i);
+            if (mBlocking) {
+                mQueue->push(item);
+            } else {
+                while (!mQueue->tryPush(item)) {
+                    sched_yield();
+                }
+            }
+        }
+        return false;
+    }
+
+    QUEUE* mQueue;
+    int mId;
+    int mCount;
+    bool mBlocking;
+};
+
+/*
+ * Reference queue for the benchmark: what code in the tree does today.
+ */
+class LockedQueue {
+public:
+    explicit LockedQueue(size_t capacity) : mCapacity(capacity) { }
+
+    bool tryPush(int32_t item) {
+        AutoMutex _l(mLock);
+        if (mItems.size() >= mCapacity) {
+            return false;
+        }
+        mItems.push(item);
+        mNotEmpty.signal();
+        return true;
+    }
+
+    void push(int32_t item) {
+        AutoMutex _l(mLock);
+        while (mItems.size() >= mCapacity) {
+            mNotFull.wait(mLock);
+        }
+        mItems.push(item);
+        mNotEmpty.signal();
+    }
+
+    void pop(int32_t* outItem) {
+        AutoMutex _l(mLock);
+        while (mItems.isEmpty()) {
+            mNotEmpty.wait(mLock);
+        }
+        *outItem = mItems[0];
+        mItems.removeAt(0);
+        mNotFull.signal();
+    }
+
+private:
+    const size_t mCapacity;
+    Mutex mLock;
+    Condition mNotEmpty;
+    Condition mNotFull;
+    Vector<int32_t> mItems;
+};
+
+// Pops 'total' items and checks that each producer's items arrive in order.
+template<typename QUEUE>
+static void drainAndCheckOrder(QUEUE* queue, int producers, int total) {
+    Vector<int> next;
+    next.insertAt(0, 0, producers);
+    for (int i = 0; i < total; i++) {
+        int32_t item;
+        queue->pop(&item);
+        int producer = item >> 24;
+        ASSERT_LT(producer, producers);
+        ASSERT_EQ(next[producer], item & 0xffffff)
+                << "items from one producer should arrive in order";
+        next.editItemAt(producer)++;
+    }
+}
+
+template<typename QUEUE>
+static nsecs_t timeTransfer(QUEUE* queue, int producers, int perProducer) {
+    Vector<sp<Thread> > threads;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < producers; i++) {
+        sp<Thread> thread = new PushThread<QUEUE>(queue, i, perProducer, true);
+        threads.push(thread);
+        thread->run();
+    }
+    int32_t item;
+    for (int i = 0; i < producers * perProducer; i++) {
+        queue->pop(&item);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->requestExitAndWait();
+    }
+    return elapsed;
+}
+
+// ---------------------------------------------------------------------------
+
+TEST(ConcurrentQueueTest, CapacityIsRoundedUpToPowerOfTwo) {
+    SpscQueue<int32_t> spsc(5);
+    MpscQueue<int32_t> mpsc(16);
+
+    EXPECT_EQ(size_t(8), spsc.capacity());
+    EXPECT_EQ(size_t(16), mpsc.capacity());
+}
+
+TEST(ConcurrentQueueTest, SpscQueue_KeepsFifoOrderAcrossWraparound) {
+    SpscQueue<int32_t> queue(4);
+    int32_t next = 0;
+    int32_t expected = 0;
+    int32_t item;
+
+    for (int round = 0; round < 10; round++) {
+        while (queue.tryPush(next)) {
+            next++;
+        }
+        EXPECT_EQ(size_t(4), queue.size()) << "push should fail only when full";
+        ASSERT_TRUE(queue.tryPop(&item));
+        EXPECT_EQ(expected++, item);
+        ASSERT_TRUE(queue.tryPop(&item));
+        EXPECT_EQ(expected++, item);
+    }
+    while (queue.tryPop(&item)) {
+        EXPECT_EQ(expected++, item);
+    }
+    EXPECT_EQ(next, expected);
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(ConcurrentQueueTest, MpscQueue_KeepsFifoOrderAcrossWraparound) {
+    MpscQueue<int32_t> queue(4);
+    int32_t next = 0;
+    int32_t expected = 0;
+    int32_t item;
+
+    for (int round = 0; round < 10; round++) {
+        while (queue.tryPush(next)) {
+            next++;
+        }
+        EXPECT_EQ(size_t(4), queue.size()) << "push should fail only when full";
+        ASSERT_TRUE(queue.tryPop(&item));
+        EXPECT_EQ(expected++, item);
+    }
+    while (queue.tryPop(&item)) {
+        EXPECT_EQ(expected++, item);
+    }
+    EXPECT_EQ(next, expected);
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(ConcurrentQueueTest, TryPop_WhenEmpty_ReturnsFalse) {
+    SpscQueue<int32_t> spsc(2);
+    MpscQueue<int32_t> mpsc(2);
+    int32_t item = 42;
+
+    EXPECT_FALSE(spsc.tryPop(&item));
+    EXPECT_FALSE(mpsc.tryPop(&item));
+    EXPECT_EQ(42, item) << "item should be untouched";
+}
+
+TEST(ConcurrentQueueTest, Pop_ReleasesReferenceHeldBySlot) {
+    Counted::instances = 0;
+    {
+        SpscQueue<sp<Counted> > spsc(4);
+        MpscQueue<sp<Counted> > mpsc(4);
+        spsc.push(new Counted());
+        mpsc.push(new Counted());
+        EXPECT_EQ(2, Counted::instances);
+
+        sp<Counted> item;
+        spsc.pop(&item);
+        mpsc.pop(&item);
+        item.clear();
+        EXPECT_EQ(0, Counted::instances) << "popped slots should not keep items alive";
+
+        spsc.push(new Counted());
+        mpsc.push(new Counted());
+    }
+    EXPECT_EQ(0, Counted::instances) << "destroying the queue should release its items";
+}
+
+TEST(ConcurrentQueueTest, SpscQueue_TransfersAllItemsBetweenThreads) {
+    const int count = 200000;
+    SpscQueue<int32_t> queue(64);
+    sp<Thread> producer = new PushThread<SpscQueue<int32_t> >(&queue, 0, count, false);
+    producer->run();
+
+    int32_t item;
+    for (int i = 0; i < count; i++) {
+        while (!queue.tryPop(&item)) {
+            sched_yield();
+        }
+        ASSERT_EQ(i, item);
+    }
+    producer->requestExitAndWait();
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(ConcurrentQueueTest, SpscQueue_BlockingPushAndPop) {
+    SpscQueue<int32_t> queue(2);
+    sp<Thread> producer = new PushThread<SpscQueue<int32_t> >(&queue, 0, 50000, true);
+    producer->run();
+
+    drainAndCheckOrder(&queue, 1, 50000);
+    producer->requestExitAndWait();
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(ConcurrentQueueTest, MpscQueue_TransfersAllItemsFromSeveralProducers) {
+    const int producers = 4;
+    const int perProducer = 50000;
+    MpscQueue<int32_t> queue(16);
+    Vector<sp<Thread> > threads;
+    for (int i = 0; i < producers; i++) {
+        // Half the producers spin on tryPush(), half block in push().
+        sp<Thread> thread = new PushThread<MpscQueue<int32_t> >(&queue, i, perProducer,
+                i % 2 == 0);
+        threads.push(thread);
+        thread->run();
+    }
+
+    drainAndCheckOrder(&queue, producers, producers * perProducer);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->requestExitAndWait();
+    }
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(ConcurrentQueueTest, Benchmark_TransferAgainstMutexAndVector) {
+    const int perProducer = 200000;
+    const size_t capacity = 256;
+
+    // Uncontended cost of one push + pop on a single thread.
+    {
+        LockedQueue reference(capacity);
+        SpscQueue<int32_t> spsc(capacity);
+        MpscQueue<int32_t> mpsc(capacity);
+        int32_t item;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < perProducer; i++) {
+            reference.push(i);
+            reference.pop(&item);
+        }
+        nsecs_t locked = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < perProducer; i++) {
+            spsc.push(i);
+            spsc.pop(&item);
+        }
+        nsecs_t spscTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < perProducer; i++) {
+            mpsc.push(i);
+            mpsc.pop(&item);
+        }
+        nsecs_t mpscTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        printf("uncontended:  Mutex+Vector %6lld ns/item, SpscQueue %6lld ns/item, "
+                "MpscQueue %6lld ns/item\n", (long long) (locked / perProducer),
+                (long long) (spscTime / perProducer), (long long) (mpscTime / perProducer));
+    }
+
+    LockedQueue reference(capacity);
+    SpscQueue<int32_t> spsc(capacity);
+    nsecs_t locked = timeTransfer(&reference, 1, perProducer);
+    nsecs_t lockFree = timeTransfer(&spsc, 1, perProducer);
+    printf("1 producer:   Mutex+Vector %6lld ns/item, SpscQueue %6lld ns/item\n",
+            (long long) (locked / perProducer), (long long) (lockFree / perProducer));
+
+    const int producerCounts[] = { 2, 4 };
+    for (size_t p = 0; p < sizeof(producerCounts) / sizeof(producerCounts[0]); p++) {
+        const int producers = producerCounts[p];
+        const int total = producers * perProducer;
+        LockedQueue lockedQueue(capacity);
+        MpscQueue<int32_t> mpsc(capacity);
+        locked = timeTransfer(&lockedQueue, producers, perProducer);
+        lockFree = timeTransfer(&mpsc, producers, perProducer);
+        printf("%d producers: Mutex+Vector %6lld ns/item, MpscQueue %6lld ns/item\n",
+                producers, (long long) (locked / total), (long long) (lockFree / total));
+    }
+}
+
+} // namespace android
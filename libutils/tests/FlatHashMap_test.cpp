@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FlatHashMap_test"
+
+#include <utils/BasicHashtable.h>
+#include <utils/FlatHashMap.h>
+#include <utils/KeyedVector.h>
+#include <utils/Timers.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace android {
+
+struct ComplexKey {
+    int k;
+
+    explicit ComplexKey(int k) : k(k) {
+        instanceCount += 1;
+    }
+
+    ComplexKey(const ComplexKey& other) : k(other.k) {
+        instanceCount += 1;
+    }
+
+    ~ComplexKey() {
+        instanceCount -= 1;
+    }
+
+    bool operator ==(const ComplexKey& other) const {
+        return k == other.k;
+    }
+
+    static ssize_t instanceCount;
+};
+
+ssize_t ComplexKey::instanceCount = 0;
+
+// Keys only hash to 0 or 1, so every entry starts probing from one of two
+// buckets and even and odd keys form two long probe runs.
+template<> inline hash_t hash_type(const ComplexKey& value) {
+    return value.k & 1;
+}
+
+struct ComplexValue {
+    int v;
+
+    ComplexValue() : v(0) {
+        instanceCount += 1;
+    }
+
+    explicit ComplexValue(int v) : v(v) {
+        instanceCount += 1;
+    }
+
+    ComplexValue(const ComplexValue& other) : v(other.v) {
+        instanceCount += 1;
+    }
+
+    ~ComplexValue() {
+        instanceCount -= 1;
+    }
+
+    static ssize_t instanceCount;
+};
+
+ssize_t ComplexValue::instanceCount = 0;
+
+typedef FlatHashMap<int, int> IntMap;
+typedef FlatHashMap<ComplexKey, ComplexValue> ComplexMap;
+
+class FlatHashMapTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        ComplexKey::instanceCount = 0;
+        ComplexValue::instanceCount = 0;
+        // ComplexMap::valueFor() keeps one default value around.
+        ComplexMap empty;
+        empty.valueFor(ComplexKey(0));
+        baseValues = ComplexValue::instanceCount;
+    }
+
+    virtual void TearDown() {
+        EXPECT_EQ(0, ComplexKey::instanceCount);
+        EXPECT_EQ(baseValues, ComplexValue::instanceCount);
+    }
+
+    ssize_t baseValues;
+};
+
+// Cheap deterministic pseudo-random numbers, so runs are reproducible.
+static uint32_t nextRandom(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+TEST_F(FlatHashMapTest, EmptyMap) {
+    IntMap map;
+    EXPECT_EQ(0U, map.size());
+    EXPECT_TRUE(map.isEmpty());
+    EXPECT_EQ(NAME_NOT_FOUND, map.indexOfKey(1));
+    EXPECT_EQ(0, map.valueFor(1));
+    EXPECT_EQ(NAME_NOT_FOUND, map.removeItem(1));
+    EXPECT_EQ(-1, map.next(-1));
+    map.clear();
+    EXPECT_EQ(0U, map.size());
+}
+
+TEST_F(FlatHashMapTest, AddReplacesExistingValue) {
+    IntMap map;
+    ssize_t index = map.add(5, 50);
+    ASSERT_GE(index, 0);
+    EXPECT_EQ(5, map.keyAt(index));
+    EXPECT_EQ(50, map.valueAt(index));
+
+    EXPECT_EQ(index, map.add(5, 55));
+    EXPECT_EQ(1U, map.size());
+    EXPECT_EQ(55, map.valueFor(5));
+
+    map.editValueAt(index) = 56;
+    EXPECT_EQ(56, map.valueFor(5));
+}
+
+TEST_F(FlatHashMapTest, MatchesKeyedVectorUnderRandomOperations) {
+    IntMap map;
+    KeyedVector<int, int> reference;
+    uint32_t seed = 1;
+    for (int i = 0; i < 100000; i++) {
+        const int key = nextRandom(&seed) % 2000;
+        switch (nextRandom(&seed) % 3) {
+        case 0:
+        case 1: {
+            ssize_t index = map.add(key, i);
+            ASSERT_EQ(key, map.keyAt(index));
+            ASSERT_EQ(i, map.valueAt(index));
+            reference.replaceValueFor(key, i);
+            break;
+        }
+        case 2:
+            ASSERT_EQ(reference.removeItem(key) >= 0, map.removeItem(key) >= 0);
+            break;
+        }
+        ASSERT_EQ(reference.size(), map.size());
+    }
+
+    for (int key = 0; key < 2000; key++) {
+        ssize_t expected = reference.indexOfKey(key);
+        ssize_t index = map.indexOfKey(key);
+        ASSERT_EQ(expected >= 0, index >= 0) << "key " << key;
+        if (index >= 0) {
+            EXPECT_EQ(reference.valueAt(expected), map.valueAt(index));
+        }
+    }
+}
+
+TEST_F(FlatHashMapTest, NextVisitsEveryEntryOnce) {
+    IntMap map;
+    for (int i = 0; i < 1000; i++) {
+        map.add(i * 7, i);
+    }
+    for (int i = 0; i < 1000; i += 3) {
+        map.removeItem(i * 7);
+    }
+
+    KeyedVector<int, bool> seen;
+    for (ssize_t index = map.next(-1); index >= 0; index = map.next(index)) {
+        EXPECT_LT(seen.indexOfKey(map.keyAt(index)), 0) << "visited twice";
+        seen.add(map.keyAt(index), true);
+        EXPECT_EQ(map.keyAt(index), map.valueAt(index) * 7);
+    }
+    EXPECT_EQ(map.size(), seen.size());
+}
+
+TEST_F(FlatHashMapTest, CollidingKeysAndInstanceCounts) {
+    {
+        ComplexMap map;
+        for (int i = 0; i < 200; i++) {
+            map.add(ComplexKey(i), ComplexValue(i * 10));
+        }
+        EXPECT_EQ(200, ComplexKey::instanceCount);
+        EXPECT_EQ(baseValues + 200, ComplexValue::instanceCount);
+
+        for (int i = 0; i < 200; i += 2) {
+            EXPECT_GE(map.removeItem(ComplexKey(i)), 0);
+        }
+        for (int i = 0; i < 200; i++) {
+            ssize_t index = map.indexOfKey(ComplexKey(i));
+            if (i % 2) {
+                ASSERT_GE(index, 0) << "key " << i;
+                EXPECT_EQ(i * 10, map.valueAt(index).v);
+            } else {
+                EXPECT_EQ(NAME_NOT_FOUND, index) << "key " << i;
+            }
+        }
+
+        ComplexMap copy(map);
+        EXPECT_EQ(200, ComplexKey::instanceCount);
+        copy.add(ComplexKey(1), ComplexValue(-1));
+        EXPECT_EQ(10, map.valueFor(ComplexKey(1)).v) << "copies should not share storage";
+
+        copy.clear();
+        EXPECT_EQ(100, ComplexKey::instanceCount);
+        copy = map;
+        EXPECT_EQ(200, ComplexKey::instanceCount);
+    }
+}
+
+TEST_F(FlatHashMapTest, SetCapacityAvoidsRehashing) {
+    IntMap map(1000);
+    const size_t capacity = map.capacity();
+    EXPECT_GE(capacity, 1000U);
+    for (int i = 0; i < 1000; i++) {
+        map.add(i, i);
+    }
+    EXPECT_EQ(capacity, map.capacity());
+    map.add(-1, -1);
+    map.setCapacity(10);
+    EXPECT_EQ(capacity, map.capacity()) << "setCapacity() should never shrink";
+}
+
+// ---------------------------------------------------------------------------
+
+typedef key_value_pair_t<int, int> IntEntry;
+
+struct Timings {
+    nsecs_t build;
+    nsecs_t hit;
+    nsecs_t miss;
+    nsecs_t remove;
+};
+
+static inline nsecs_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+// Distinct even keys scattered over [0, 2^31) in random order, so key + 1
+// is never present.  Regularly spaced keys would favor BasicHashtable, whose
+// identity hash turns them into a fixed stride the prefetcher can follow.
+static int* scatteredKeys(size_t count) {
+    int* keys = new int[count];
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = int(((uint32_t(i) * 0x9E3779B1U) & 0x3fffffff) * 2);
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = rand() % (i + 1);
+        int key = keys[i];
+        keys[i] = keys[j];
+        keys[j] = key;
+    }
+    return keys;
+}
+
+static int compareInts(const void* lhs, const void* rhs) {
+    return *static_cast<const int*>(lhs) - *static_cast<const int*>(rhs);
+}
+
+static Timings timeFlatHashMap(const int* keys, size_t count, size_t lookups, int* sum) {
+    Timings t;
+    IntMap map;
+    nsecs_t start = now();
+    for (size_t i = 0; i < count; i++) {
+        map.add(keys[i], i);
+    }
+    t.build = now() - start;
+    start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        *sum += map.valueAt(map.indexOfKey(keys[i % count]));
+    }
+    t.hit = now() - start;
+    start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        *sum += map.indexOfKey(keys[i % count] + 1);
+    }
+    t.miss = now() - start;
+    start = now();
+    for (size_t i = 0; i < count; i += 2) {
+        map.removeItem(keys[i]);
+    }
+    t.remove = now() - start;
+    return t;
+}
+
+static Timings timeBasicHashtable(const int* keys, size_t count, size_t lookups, int* sum) {
+    Timings t;
+    BasicHashtable<int, IntEntry> table;
+    nsecs_t start = now();
+    for (size_t i = 0; i < count; i++) {
+        table.add(hash_type(keys[i]), IntEntry(keys[i], i));
+    }
+    t.build = now() - start;
+    start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        const int key = keys[i % count];
+        *sum += table.entryAt(table.find(-1, hash_type(key), key)).value;
+    }
+    t.hit = now() - start;
+    start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        const int key = keys[i % count] + 1;
+        *sum += table.find(-1, hash_type(key), key);
+    }
+    t.miss = now() - start;
+    start = now();
+    for (size_t i = 0; i < count; i += 2) {
+        table.removeAt(table.find(-1, hash_type(keys[i]), keys[i]));
+    }
+    t.remove = now() - start;
+    return t;
+}
+
+// Inserting 100K+ random keys into a sorted vector takes minutes, so the
+// KeyedVector is built from sorted keys, its best case.
+static Timings timeKeyedVector(const int* keys, size_t count, size_t lookups, int* sum) {
+    Timings t;
+    int* sorted = new int[count];
+    memcpy(sorted, keys, count * sizeof(int));
+    qsort(sorted, count, sizeof(int), compareInts);
+    KeyedVector<int, int> vector;
+    vector.setCapacity(count);
+    nsecs_t start = now();
+    for (size_t i = 0; i < count; i++) {
+        vector.add(sorted[i], i);
+    }
+    t.build = now() - start;
+    delete[] sorted;
+    start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        *sum += vector.valueAt(vector.indexOfKey(keys[i % count]));
+    }
+    t.hit = now() - start;
+    start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        *sum += vector.indexOfKey(keys[i % count] + 1);
+    }
+    t.miss = now() - start;
+    // Removing half of a large sorted vector is quadratic as well; time
+    // 200 removals and scale up.
+    const size_t removals = count / 2 < 200 ? count / 2 : 200;
+    start = now();
+    for (size_t i = 0; i < removals; i++) {
+        vector.removeItem(keys[i * 2]);
+    }
+    t.remove = (now() - start) * (count / 2) / removals;
+    return t;
+}
+
+static void printTimings(const char* name, const Timings& t, size_t count, size_t lookups) {
+    printf("  %-15s add %5lld ns, hit %4lld ns, miss %4lld ns, remove %6lld ns\n", name,
+            (long long) (t.build / count), (long long) (t.hit / lookups),
+            (long long) (t.miss / lookups), (long long) (t.remove / (count / 2)));
+}
+
+TEST_F(FlatHashMapTest, Benchmark_AgainstKeyedVectorAndBasicHashtable) {
+    const size_t counts[] = { 1000, 100000, 1000000 };
+    const size_t lookups = 1000000;
+    int sum = 0;
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        const size_t count = counts[c];
+        int* keys = scatteredKeys(count);
+        printf("%zu entries, per operation:\n", count);
+        printTimings("FlatHashMap", timeFlatHashMap(keys, count, lookups, &sum),
+                count, lookups);
+        printTimings("BasicHashtable", timeBasicHashtable(keys, count, lookups, &sum),
+                count, lookups);
+        printTimings("KeyedVector", timeKeyedVector(keys, count, lookups, &sum),
+                count, lookups);
+        delete[] keys;
+    }
+    EXPECT_NE(0, sum);
+}
+
+} // namespace android
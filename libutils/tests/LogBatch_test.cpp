@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <log/log.h>
+#include <log/logger.h>
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_ANDROID_OS
+
+namespace android {
+
+static const char* kTag = "LogBatchTest";
+static const int kThreads = 4;
+// Small enough that the main log does not wrap before the test reads it.
+static const int kLines = 500;
+
+// Opens the main log for reading, positioned after what is already in it.
+static int openMainLog() {
+    int fd = open("/dev/" LOGGER_LOG_MAIN, O_RDONLY | O_NONBLOCK);
+    if (fd >= 0) {
+        char buf[LOGGER_ENTRY_MAX_LEN + 1];
+        while (read(fd, buf, LOGGER_ENTRY_MAX_LEN) > 0) {
+        }
+    }
+    return fd;
+}
+
+static void* logLines(void* arg) {
+    int thread = int(intptr_t(arg));
+
+    // Only errors are written right away, so the lines go through the
+    // writer thread, which drains at the high-water mark.
+    __android_log_batch_begin(ANDROID_LOG_ERROR, 10000);
+    for (int i = 0; i < kLines; i++) {
+        __android_log_print(ANDROID_LOG_INFO, kTag, "%d %d", thread, i);
+    }
+    __android_log_batch_end();
+    return NULL;
+}
+
+TEST(LogBatchTest, ThreadsLinesArriveInOrder) {
+    int fd = openMainLog();
+    ASSERT_GE(fd, 0) << "cannot read /dev/" LOGGER_LOG_MAIN ": " << strerror(errno);
+
+    pthread_t threads[kThreads];
+    for (int t = 0; t < kThreads; t++) {
+        ASSERT_EQ(0, pthread_create(&threads[t], NULL, logLines, (void*) intptr_t(t)));
+    }
+    for (int t = 0; t < kThreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // __android_log_batch_end() writes out what is left, so everything is in.
+    int next[kThreads] = { 0 };
+    char buf[LOGGER_ENTRY_MAX_LEN + 1] __attribute__((aligned(4)));
+    ssize_t ret;
+    while ((ret = read(fd, buf, LOGGER_ENTRY_MAX_LEN)) > 0) {
+        struct logger_entry* entry = reinterpret_cast<struct logger_entry*>(buf);
+        buf[sizeof(*entry) + entry->len] = '\0';
+        // The payload is the priority, then the tag and message, each
+        // NUL-terminated.
+        const char* tag = entry->msg + 1;
+        if (entry->pid != getpid() || strcmp(tag, kTag) != 0) {
+            continue;
+        }
+        int thread, line;
+        ASSERT_EQ(2, sscanf(tag + strlen(tag) + 1, "%d %d", &thread, &line));
+        ASSERT_TRUE(thread >= 0 && thread < kThreads);
+        EXPECT_EQ(next[thread], line) << "thread " << thread;
+        next[thread] = line + 1;
+    }
+    EXPECT_EQ(EAGAIN, errno);
+    close(fd);
+
+    for (int t = 0; t < kThreads; t++) {
+        EXPECT_EQ(kLines, next[t]) << "thread " << t;
+    }
+}
+
+} // namespace android
+
+#endif // HAVE_ANDROID_OS
@@ -53,8 +53,8 @@ protected:
 
 class CallbackHandler {
 public:
-    void setCallback(const sp<Looper>& looper, int fd, int events) {
-        looper->addFd(fd, 0, events, staticHandler, this);
+    int setCallback(const sp<Looper>& looper, int fd, int events) {
+        return looper->addFd(fd, 0, events, staticHandler, this);
     }
 
 protected:
@@ -98,6 +98,36 @@ public:
     }
 };
 
+class CountingMessageHandler : public MessageHandler {
+public:
+    int count;
+
+    CountingMessageHandler() : count(0) { }
+
+    virtual void handleMessage(const Message& message) {
+        count += 1;
+    }
+};
+
+class MessageProducer : public Thread {
+    sp<Looper> mLooper;
+    sp<MessageHandler> mHandler;
+    int mCount;
+
+public:
+    MessageProducer(const sp<Looper>& looper, const sp<MessageHandler>& handler, int count) :
+        mLooper(looper), mHandler(handler), mCount(count) {
+    }
+
+protected:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mCount; i++) {
+            mLooper->sendMessage(mHandler, Message(MSG_TEST1));
+        }
+        return false;
+    }
+};
+
 class LooperTest : public testing::Test {
 protected:
     sp<Looper> mLooper;
@@ -690,4 +720,230 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenManyMessagesAreSentOutOfOrder_ShouldDeliverInTimeThenFifoOrder) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    const int count = 1000;
+    for (int i = 0; i < count; i++) {
+        // Scatter the times, with plenty of messages sharing each one.
+        nsecs_t uptime = now - ms2ns(1000) + ((i * 7919) % 50);
+        mLooper->sendMessageAtTime(uptime, handler, Message(i));
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(count), handler->messages.size())
+            << "handled all messages";
+    for (int i = 1; i < count; i++) {
+        int prev = handler->messages[i - 1].what;
+        int cur = handler->messages[i].what;
+        int prevTime = (prev * 7919) % 50;
+        int curTime = (cur * 7919) % 50;
+        EXPECT_TRUE(prevTime < curTime || (prevTime == curTime && prev < cur))
+                << "messages should be delivered by time, then in the order they were sent";
+    }
+}
+
+TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesFromLargeQueue_ShouldKeepOrderOfTheRest) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    sp<StubMessageHandler> otherHandler = new StubMessageHandler();
+    const int count = 500;
+    for (int i = 0; i < count; i++) {
+        nsecs_t uptime = now - ms2ns(1000) + (count - i) / 10;
+        mLooper->sendMessageAtTime(uptime, i % 2 ? handler : otherHandler, Message(i % 4));
+    }
+    mLooper->removeMessages(handler, 1);
+    mLooper->removeMessages(otherHandler);
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because messages were sent";
+    EXPECT_EQ(size_t(0), otherHandler->messages.size())
+            << "all messages for the other handler were removed";
+    ASSERT_EQ(size_t(count / 4), handler->messages.size())
+            << "only messages with what == 3 should remain";
+    for (size_t i = 0; i < handler->messages.size(); i++) {
+        EXPECT_EQ(3, handler->messages[i].what)
+                << "messages with what == 1 were removed";
+    }
+}
+
+TEST_F(LooperTest, Benchmark_SendMessageAtTime_WithDeepQueue) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    sp<StubMessageHandler> otherHandler = new StubMessageHandler();
+    const int counts[] = { 1000, 10000, 50000 };
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        const int count = counts[c];
+
+        // Delayed messages far in the future, in pseudo-random order.
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < count; i++) {
+            nsecs_t uptime = now + ms2ns(60000) + ((i * 7919) % count) * 1000;
+            mLooper->sendMessageAtTime(uptime, i % 2 ? handler : otherHandler, Message(i % 4));
+        }
+        nsecs_t sendTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        mLooper->removeMessages(handler, 1);
+        nsecs_t removeWhatTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        mLooper->removeMessages(handler);
+        mLooper->removeMessages(otherHandler);
+        nsecs_t removeAllTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        printf("queue depth %6d: %6lld ns/send, removeMessages(handler, what) %8lld us, "
+                "removeMessages(handler) x2 %8lld us\n", count,
+                (long long) (sendTime / count), (long long) ns2us(removeWhatTime),
+                (long long) ns2us(removeAllTime));
+    }
+
+    mLooper->pollOnce(0);
+    EXPECT_EQ(size_t(0), handler->messages.size() + otherHandler->messages.size())
+            << "all messages were removed";
+}
+
+TEST_F(LooperTest, Wake_WhenCalledRepeatedlyBeforePolling_ShouldWakeOnlyOnce) {
+    mLooper->wake();
+    mLooper->wake();
+    mLooper->wake();
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_WAKE, result)
+            << "pollOnce result should be ALOOPER_POLL_WAKE because loop was awoken";
+
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_TIMEOUT, result)
+            << "pollOnce result should be ALOOPER_POLL_TIMEOUT because all wakes were consumed";
+
+    mLooper->wake();
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_WAKE, result)
+            << "pollOnce result should be ALOOPER_POLL_WAKE because loop was awoken again";
+}
+
+TEST_F(LooperTest, Benchmark_SendMessage_FromSeveralProducerThreads) {
+    const int producerCounts[] = { 1, 4, 8 };
+    const int messagesPerProducer = 20000;
+
+    for (size_t p = 0; p < sizeof(producerCounts) / sizeof(producerCounts[0]); p++) {
+        const int producerCount = producerCounts[p];
+        const int total = producerCount * messagesPerProducer;
+        sp<CountingMessageHandler> handler = new CountingMessageHandler();
+        Vector<sp<MessageProducer> > producers;
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < producerCount; i++) {
+            sp<MessageProducer> producer = new MessageProducer(mLooper, handler,
+                    messagesPerProducer);
+            producers.push(producer);
+            producer->run();
+        }
+        while (handler->count < total) {
+            if (mLooper->pollOnce(1000) == ALOOPER_POLL_TIMEOUT) {
+                break;
+            }
+        }
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        for (size_t i = 0; i < producers.size(); i++) {
+            producers[i]->requestExitAndWait();
+        }
+
+        EXPECT_EQ(total, handler->count)
+                << "all messages should have been delivered";
+        printf("%d producer(s): %lld messages/sec\n", producerCount,
+                (long long) (total * 1000000000LL / (elapsed ? elapsed : 1)));
+    }
+}
+
+TEST_F(LooperTest, AddFd_WhenFdClosedWithoutRemoveAndNumberReused_ShouldInvokeNewCallback) {
+    Pipe* oldPipe = new Pipe();
+    const int fd = oldPipe->receiveFd;
+    StubCallbackHandler handler1(true);
+    StubCallbackHandler handler2(true);
+
+    handler1.setCallback(mLooper, fd, ALOOPER_EVENT_INPUT);
+    delete oldPipe; // closes fd behind the looper's back, so epoll forgets it
+
+    Pipe pipe;
+    if (pipe.receiveFd != fd) {
+        ASSERT_EQ(fd, dup2(pipe.receiveFd, fd));
+        close(pipe.receiveFd);
+        pipe.receiveFd = fd;
+    }
+
+    int result = handler2.setCallback(mLooper, fd, ALOOPER_EVENT_INPUT);
+    pipe.writeSignal();
+    int pollResult = mLooper->pollOnce(0);
+
+    EXPECT_EQ(1, result)
+            << "addFd should return 1 because the reused fd was registered again";
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, pollResult)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because the new fd was signalled";
+    EXPECT_EQ(0, handler1.callbackCount)
+            << "original handler callback should not be invoked because it was replaced";
+    EXPECT_EQ(1, handler2.callbackCount)
+            << "replacement handler callback should be invoked";
+}
+
+TEST_F(LooperTest, Benchmark_PollOnce_WithManyRegisteredFds) {
+    const int fdCounts[] = { 16, 128, 1024 };
+    const int rounds = 50;
+
+    for (size_t c = 0; c < sizeof(fdCounts) / sizeof(fdCounts[0]); c++) {
+        const int fdCount = fdCounts[c];
+        Pipe* pipes = new Pipe[fdCount];
+        StubCallbackHandler handler(true);
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < fdCount; i++) {
+            handler.setCallback(mLooper, pipes[i].receiveFd, ALOOPER_EVENT_INPUT);
+        }
+        nsecs_t addTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < fdCount; i++) {
+            handler.setCallback(mLooper, pipes[i].receiveFd, ALOOPER_EVENT_INPUT);
+        }
+        nsecs_t readdTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        // Only a handful of fds are ready at a time, which is the common case.
+        const int step = fdCount / 8;
+        nsecs_t pollTime = 0;
+        for (int r = 0; r < rounds; r++) {
+            for (int i = r % step; i < fdCount; i += step) {
+                pipes[i].writeSignal();
+            }
+            start = systemTime(SYSTEM_TIME_MONOTONIC);
+            mLooper->pollOnce(0);
+            pollTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            for (int i = r % step; i < fdCount; i += step) {
+                pipes[i].readSignal();
+            }
+        }
+
+        EXPECT_EQ(rounds * 8, handler.callbackCount)
+                << "every signalled fd should have been dispatched";
+
+        for (int i = 0; i < fdCount; i++) {
+            mLooper->removeFd(pipes[i].receiveFd);
+        }
+        delete[] pipes;
+
+        printf("%5d fds: addFd %5lld ns, re-addFd %5lld ns, pollOnce %6lld ns/event\n",
+                fdCount, (long long) (addTime / fdCount), (long long) (readdTime / fdCount),
+                (long long) (pollTime / (rounds * 8)));
+    }
+}
+
 } // namespace android
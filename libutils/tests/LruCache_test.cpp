@@ -14,9 +14,15 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <utils/JenkinsHash.h>
 #include <utils/LruCache.h>
+#include <utils/Mutex.h>
+#include <utils/ShardedLruCache.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 #include <cutils/log.h>
 #include <gtest/gtest.h>
 
@@ -93,6 +99,14 @@ public:
     StringValue lastValue;
 };
 
+// Charges each entry the length of its string.
+class StringSizer : public EntrySizer<SimpleKey, StringValue> {
+public:
+    size_t operator()(const SimpleKey& k, const StringValue& v) {
+        return strlen(v);
+    }
+};
+
 class LruCacheTest : public testing::Test {
 protected:
     virtual void SetUp() {
@@ -288,4 +302,262 @@ TEST_F(LruCacheTest, CallbackOnClear) {
     EXPECT_EQ(3, callback.callbackCount);
 }
 
+TEST_F(LruCacheTest, MaxSizeEvictsOldest) {
+    LruCache<SimpleKey, StringValue> cache(LruCache<SimpleKey, StringValue>::kUnlimitedCapacity);
+    StringSizer sizer;
+    cache.setMaxSize(10, &sizer);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    // 3 + 3 + 5 > 10, so "one" had to go.
+    EXPECT_EQ(NULL, cache.get(1));
+    EXPECT_STREQ("two", cache.get(2));
+    EXPECT_EQ(8u, cache.totalSize());
+
+    // "two" was just used, so "three" goes first.
+    cache.put(4, "four");
+    EXPECT_EQ(NULL, cache.get(3));
+    EXPECT_STREQ("two", cache.get(2));
+    EXPECT_STREQ("four", cache.get(4));
+    EXPECT_EQ(7u, cache.totalSize());
+}
+
+TEST_F(LruCacheTest, EntryLargerThanMaxSizeIsRejected) {
+    LruCache<SimpleKey, StringValue> cache(LruCache<SimpleKey, StringValue>::kUnlimitedCapacity);
+    StringSizer sizer;
+    cache.setMaxSize(4, &sizer);
+
+    cache.put(1, "one");
+    EXPECT_FALSE(cache.put(2, "three"));
+    EXPECT_STREQ("one", cache.get(1));
+    EXPECT_EQ(3u, cache.totalSize());
+}
+
+TEST_F(LruCacheTest, RemoveAndClearReleaseSize) {
+    LruCache<SimpleKey, StringValue> cache(100);
+    StringSizer sizer;
+    cache.setMaxSize(100, &sizer);
+
+    cache.put(1, "one");
+    cache.put(2, "three");
+    EXPECT_EQ(8u, cache.totalSize());
+    cache.remove(1);
+    EXPECT_EQ(5u, cache.totalSize());
+    cache.clear();
+    EXPECT_EQ(0u, cache.totalSize());
+}
+
+TEST_F(LruCacheTest, MaxSizeSurvivesRehash) {
+    LruCache<SimpleKey, StringValue> cache(LruCache<SimpleKey, StringValue>::kUnlimitedCapacity);
+    StringSizer sizer;
+    cache.setMaxSize(1000, &sizer);
+
+    // Enough entries to grow the table several times.
+    for (int i = 0; i < 1000; i++) {
+        cache.put(i, "x");
+    }
+    EXPECT_EQ(1000u, cache.totalSize());
+    EXPECT_EQ(0u, cache.evictionCount());
+
+    // The order must have been kept, so the oldest key goes first.
+    cache.put(1000, "x");
+    EXPECT_EQ(NULL, cache.get(0));
+    EXPECT_STREQ("x", cache.get(1));
+    EXPECT_EQ(1000u, cache.totalSize());
+}
+
+TEST_F(LruCacheTest, GetPtr) {
+    ComplexCache cache(100);
+
+    EXPECT_TRUE(cache.getPtr(ComplexKey(0)) == NULL);
+    cache.put(ComplexKey(0), ComplexValue(10));
+    const ComplexValue* value = cache.getPtr(ComplexKey(0));
+    ASSERT_TRUE(value != NULL);
+    EXPECT_EQ(10, value->v);
+    cache.clear();
+}
+
+TEST_F(LruCacheTest, Counters) {
+    LruCache<SimpleKey, StringValue> cache(2);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.get(1);
+    cache.getPtr(2);
+    cache.get(3);
+    cache.put(3, "three");
+    cache.remove(1);
+    EXPECT_EQ(2u, cache.hitCount());
+    EXPECT_EQ(1u, cache.missCount());
+    // Removing a key on request is not an eviction.
+    EXPECT_EQ(1u, cache.evictionCount());
+}
+
+TEST_F(LruCacheTest, ShardedCache) {
+    ShardedLruCache<SimpleKey, StringValue> cache(64, 4);
+
+    for (int i = 0; i < 1000; i++) {
+        cache.put(i, "value");
+    }
+    // Each shard holds at most its share of the capacity.
+    EXPECT_GE(64u, cache.size());
+    EXPECT_LT(0u, cache.size());
+
+    StringValue value = NULL;
+    EXPECT_FALSE(cache.get(-1, &value));
+    EXPECT_EQ(NULL, value);
+    cache.put(-1, "minus one");
+    EXPECT_TRUE(cache.get(-1, &value));
+    EXPECT_STREQ("minus one", value);
+    EXPECT_EQ(1u, cache.hitCount());
+    EXPECT_EQ(1u, cache.missCount());
+
+    EXPECT_TRUE(cache.remove(-1));
+    EXPECT_FALSE(cache.get(-1, &value));
+    cache.clear();
+    EXPECT_EQ(0u, cache.size());
+}
+
+// Draws ranks in [0, count) with probability proportional to 1 / (rank + 1).
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t count, unsigned int seed) : mCount(count), mSeed(seed) {
+        mCdf = new double[count];
+        double total = 0;
+        for (size_t i = 0; i < count; i++) {
+            total += 1.0 / (i + 1);
+            mCdf[i] = total;
+        }
+    }
+
+    ~ZipfGenerator() {
+        delete[] mCdf;
+    }
+
+    int next() {
+        double r = mCdf[mCount - 1] * rand_r(&mSeed) / RAND_MAX;
+        size_t lo = 0, hi = mCount - 1;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (mCdf[mid] < r) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        // Scatter the popular ranks over the key space.
+        return int(lo * 2654435761U);
+    }
+
+private:
+    double* mCdf;
+    size_t mCount;
+    unsigned int mSeed;
+};
+
+typedef LruCache<SimpleKey, StringValue> SimpleCache;
+
+class LockedCache {
+public:
+    LockedCache(uint32_t capacity) : mCache(capacity) { }
+
+    bool get(SimpleKey key, StringValue* outValue) {
+        Mutex::Autolock _l(mLock);
+        const StringValue* value = mCache.getPtr(key);
+        if (value == NULL) {
+            return false;
+        }
+        *outValue = *value;
+        return true;
+    }
+
+    void put(SimpleKey key, StringValue value) {
+        Mutex::Autolock _l(mLock);
+        mCache.put(key, value);
+    }
+
+private:
+    Mutex mLock;
+    SimpleCache mCache;
+};
+
+template <typename CACHE>
+class LookupThread : public Thread {
+public:
+    LookupThread(CACHE* cache, int lookups, unsigned int seed) :
+            Thread(false), mCache(cache), mLookups(lookups), mZipf(100000, seed) { }
+
+    virtual bool threadLoop() {
+        for (int i = 0; i < mLookups; i++) {
+            int key = mZipf.next();
+            StringValue value;
+            if (!mCache->get(key, &value)) {
+                mCache->put(key, "value");
+            }
+        }
+        return false;
+    }
+
+private:
+    CACHE* mCache;
+    int mLookups;
+    ZipfGenerator mZipf;
+};
+
+template <typename CACHE>
+static nsecs_t timeThreads(CACHE* cache, int threadCount, int lookupsPerThread) {
+    Vector<sp<Thread> > threads;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < threadCount; i++) {
+        sp<Thread> thread = new LookupThread<CACHE>(cache, lookupsPerThread, i + 1);
+        thread->run("LookupThread");
+        threads.add(thread);
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+    }
+    return systemTime(SYSTEM_TIME_MONOTONIC) - start;
+}
+
+// Looks up Zipf-distributed keys out of 100K, putting each key that misses.
+TEST_F(LruCacheTest, Benchmark_ZipfKeys) {
+    const size_t kKeys = 100000;
+    const int kLookups = 1000000;
+    const size_t kCapacities[] = { 1000, 10000, 50000 };
+
+    // Draw the keys up front so that only the cache is timed.
+    int* keys = new int[kLookups];
+    ZipfGenerator zipf(kKeys, 1);
+    for (int i = 0; i < kLookups; i++) {
+        keys[i] = zipf.next();
+    }
+    for (size_t c = 0; c < sizeof(kCapacities) / sizeof(kCapacities[0]); c++) {
+        SimpleCache cache(kCapacities[c]);
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < kLookups; i++) {
+            int key = keys[i];
+            if (cache.getPtr(key) == NULL) {
+                cache.put(key, "value");
+            }
+        }
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        printf("capacity %6u: hit rate %.1f%%, %lld ns per lookup\n",
+                unsigned(kCapacities[c]), 100.0 * cache.hitCount() / kLookups,
+                elapsed / kLookups);
+    }
+    delete[] keys;
+
+    // The same with several threads sharing one cache.  These times include
+    // drawing the keys.
+    const int kThreads = 4;
+    LockedCache locked(10000);
+    nsecs_t lockedTime = timeThreads(&locked, kThreads, kLookups / kThreads);
+    ShardedLruCache<SimpleKey, StringValue> sharded(10000);
+    nsecs_t shardedTime = timeThreads(&sharded, kThreads, kLookups / kThreads);
+    printf("%d threads, capacity 10000: one lock %lld ns, sharded %lld ns per lookup "
+            "(sharded hit rate %.1f%%)\n", kThreads, lockedTime / kLookups,
+            shardedTime / kLookups, 100.0 * sharded.hitCount() / kLookups);
+}
+
 }
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+
+static const char* kKey = "debug.libutils.test.handle";
+static const char* kMissingKey = "debug.libutils.test.missing";
+
+// property_set() goes through init on a device, so the new value shows up
+// a little later.
+static bool setAndWait(const char* key, const char* value) {
+    if (property_set(key, value) < 0) {
+        return false;
+    }
+    for (int i = 0; i < 100; i++) {
+        char current[PROPERTY_VALUE_MAX];
+        property_get(key, current, "");
+        if (strcmp(current, value) == 0) {
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+TEST(PropertyHandleTest, GetMatchesPropertyGet) {
+    ASSERT_TRUE(setAndWait(kKey, "hello"));
+
+    struct property_handle handle;
+    property_handle_init(&handle, kKey);
+    EXPECT_NE(0, property_handle_changed(&handle));
+    char value[PROPERTY_VALUE_MAX];
+    EXPECT_EQ(5, property_handle_get(&handle, value, "default"));
+    EXPECT_STREQ("hello", value);
+    EXPECT_EQ(5, property_handle_get(&handle, value, NULL));
+    EXPECT_STREQ("hello", value);
+
+    struct property_handle initialized = PROPERTY_HANDLE_INITIALIZER(kKey);
+    EXPECT_NE(0, property_handle_changed(&initialized));
+    EXPECT_EQ(5, property_handle_get(&initialized, value, "default"));
+    EXPECT_STREQ("hello", value);
+
+    struct property_handle missing;
+    property_handle_init(&missing, kMissingKey);
+    EXPECT_EQ(7, property_handle_get(&missing, value, "default"));
+    EXPECT_STREQ("default", value);
+    EXPECT_EQ(0, property_handle_get(&missing, value, NULL));
+    EXPECT_STREQ("", value);
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    EXPECT_EQ(0, property_handle_changed(&missing));
+#endif
+}
+
+TEST(PropertyHandleTest, SeesChanges) {
+    ASSERT_TRUE(setAndWait(kKey, "one"));
+
+    struct property_handle handle;
+    property_handle_init(&handle, kKey);
+    char value[PROPERTY_VALUE_MAX];
+    EXPECT_EQ(3, property_handle_get(&handle, value, NULL));
+    EXPECT_STREQ("one", value);
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    EXPECT_EQ(0, property_handle_changed(&handle));
+#endif
+
+    ASSERT_TRUE(setAndWait(kKey, "three"));
+    EXPECT_NE(0, property_handle_changed(&handle));
+    EXPECT_EQ(5, property_handle_get(&handle, value, NULL));
+    EXPECT_STREQ("three", value);
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    EXPECT_EQ(0, property_handle_changed(&handle));
+#endif
+
+    // An empty value reads as the default, as with property_get().
+    ASSERT_TRUE(setAndWait(kKey, ""));
+    EXPECT_EQ(7, property_handle_get(&handle, value, "default"));
+    EXPECT_STREQ("default", value);
+}
+
+// ---------------------------------------------------------------------------
+
+static const int kIterations = 1000000;
+
+// Polling one property, as atrace and log-level checks do.
+TEST(PropertyHandleBenchmark, Benchmark_Poll) {
+    ASSERT_TRUE(setAndWait(kKey, "1"));
+    char value[PROPERTY_VALUE_MAX];
+    int sum = 0;
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        property_get(kKey, value, "0");
+        sum += value[0] - '0';
+    }
+    nsecs_t get = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    struct property_handle handle;
+    property_handle_init(&handle, kKey);
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        property_handle_get(&handle, value, "0");
+        sum -= value[0] - '0';
+    }
+    nsecs_t handleGet = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        if (property_handle_changed(&handle)) {
+            property_handle_get(&handle, value, "0");
+        }
+    }
+    nsecs_t handleChanged = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    EXPECT_EQ(0, sum);
+    printf("poll: property_get %.1f ns, property_handle_get %.1f ns, "
+            "property_handle_changed %.1f ns\n",
+            double(get) / kIterations, double(handleGet) / kIterations,
+            double(handleChanged) / kIterations);
+}
+
+} // namespace android
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <utils/RefBase.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+static volatile int32_t gLiveObjects = 0;
+
+class PlainObject : public RefBase {
+public:
+    PlainObject() : firstRefs(0), lastStrongRefs(0) { android_atomic_inc(&gLiveObjects); }
+
+    void extendLifetimeToWeak() { extendObjectLifetime(OBJECT_LIFETIME_WEAK); }
+
+    int firstRefs;
+    int lastStrongRefs;
+
+protected:
+    virtual ~PlainObject() { android_atomic_dec(&gLiveObjects); }
+
+    virtual void onFirstRef() { firstRefs++; }
+    virtual void onLastStrongRef(const void* /*id*/) { lastStrongRefs++; }
+};
+
+// Takes its first weak reference while the last strong one goes away.
+class WeakOnLastStrongRef : public PlainObject {
+protected:
+    virtual void onLastStrongRef(const void* /*id*/) { mSelf = this; }
+
+private:
+    wp<WeakOnLastStrongRef> mSelf;
+};
+
+class RefBaseTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        gLiveObjects = 0;
+    }
+
+    virtual void TearDown() {
+        EXPECT_EQ(0, gLiveObjects) << "every object should have been destroyed";
+    }
+};
+
+template<typename T>
+class ChurnThread : public Thread {
+public:
+    ChurnThread(int count, bool withWeak) :
+            Thread(false), mCount(count), mWithWeak(withWeak) { }
+
+private:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mCount; i++) {
+            sp<T> object = new T();
+            sp<T> copy = object;
+            if (mWithWeak) {
+                wp<T> weak = object;
+            }
+        }
+        return false;
+    }
+
+    int mCount;
+    bool mWithWeak;
+};
+
+/*
+ * Several threads work on the same object at once, round after round, while
+ * the main thread holds a strong reference.  Half of them only copy strong
+ * references, the other half take weak references and promote them, so the
+ * weakref_impl gets created while strong counts are changing.
+ */
+struct RaceState {
+    RaceState() : round(0), done(0), object(NULL), failedPromotes(0) { }
+
+    volatile int32_t round;
+    volatile int32_t done;
+    PlainObject* volatile object;
+    volatile int32_t failedPromotes;
+};
+
+class RaceThread : public Thread {
+public:
+    RaceThread(RaceState* state, int id, int rounds) :
+            Thread(false), mState(state), mId(id), mRounds(rounds) { }
+
+private:
+    virtual bool threadLoop() {
+        for (int32_t round = 1; round <= mRounds; round++) {
+            while (android_atomic_acquire_load(&mState->round) != round) {
+                sched_yield();
+            }
+            PlainObject* object = mState->object;
+            for (int i = 0; i < 20; i++) {
+                if (mId % 2) {
+                    sp<PlainObject> strong = object;
+                    sp<PlainObject> copy = strong;
+                } else {
+                    wp<PlainObject> weak = object;
+                    sp<PlainObject> promoted = weak.promote();
+                    if (promoted == NULL) {
+                        android_atomic_inc(&mState->failedPromotes);
+                    }
+                }
+            }
+            android_atomic_inc(&mState->done);
+        }
+        return false;
+    }
+
+    RaceState* mState;
+    int mId;
+    int mRounds;
+};
+
+// Promotes a weak reference until the object is gone.
+class PromoteThread : public Thread {
+public:
+    PromoteThread(const wp<PlainObject>& object, volatile int32_t* promoted) :
+            Thread(false), mObject(object), mPromoted(promoted) { }
+
+private:
+    virtual bool threadLoop() {
+        for (;;) {
+            sp<PlainObject> strong = mObject.promote();
+            if (strong == NULL) {
+                return false;
+            }
+            android_atomic_inc(mPromoted);
+            strong.clear();
+            sched_yield();
+        }
+    }
+
+    wp<PlainObject> mObject;
+    volatile int32_t* mPromoted;
+};
+
+template<typename T>
+static nsecs_t timeChurn(int threadCount, int perThread, bool withWeak) {
+    Vector<sp<Thread> > threads;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < threadCount; i++) {
+        sp<Thread> thread = new ChurnThread<T>(perThread, withWeak);
+        threads.push(thread);
+        thread->run();
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+    }
+    return systemTime(SYSTEM_TIME_MONOTONIC) - start;
+}
+
+// ---------------------------------------------------------------------------
+
+TEST_F(RefBaseTest, LazyRefs_StrongOnlyLifetime) {
+    sp<PlainObject> object = new PlainObject();
+    EXPECT_EQ(1, object->getStrongCount());
+    EXPECT_EQ(1, object->firstRefs);
+
+    sp<PlainObject> copy = object;
+    EXPECT_EQ(2, object->getStrongCount());
+    copy.clear();
+    EXPECT_EQ(0, object->lastStrongRefs);
+    object.clear();
+    EXPECT_EQ(0, gLiveObjects);
+}
+
+TEST_F(RefBaseTest, LazyRefs_FirstWeakRefKeepsCounts) {
+    sp<PlainObject> object = new PlainObject();
+    sp<PlainObject> copy = object;
+
+    wp<PlainObject> weak = object;
+    EXPECT_EQ(2, object->getStrongCount()) << "inflating should keep the strong count";
+    EXPECT_EQ(3, weak.get_refs()->getWeakCount())
+            << "each strong reference should also hold a weak reference";
+
+    copy.clear();
+    object.clear();
+    EXPECT_EQ(0, gLiveObjects);
+    EXPECT_TRUE(weak.promote() == NULL);
+    EXPECT_EQ(1, weak.get_refs()->getWeakCount());
+}
+
+TEST_F(RefBaseTest, LazyRefs_WeakRefBeforeFirstStrongRef) {
+    PlainObject* raw = new PlainObject();
+    wp<PlainObject> weak = raw;
+
+    sp<PlainObject> object = weak.promote();
+    ASSERT_TRUE(object != NULL) << "an object that was never strongly held can be promoted";
+    EXPECT_EQ(1, object->getStrongCount());
+    object.clear();
+    EXPECT_EQ(0, gLiveObjects);
+}
+
+TEST_F(RefBaseTest, LazyRefs_WeakLifetimeIsPreserved) {
+    sp<PlainObject> object = new PlainObject();
+    object->extendLifetimeToWeak();
+    wp<PlainObject> weak = object;
+
+    object.clear();
+    EXPECT_EQ(1, gLiveObjects) << "a weak reference should keep the object alive";
+    EXPECT_TRUE(weak.promote() != NULL);
+    weak.clear();
+    EXPECT_EQ(0, gLiveObjects);
+}
+
+TEST_F(RefBaseTest, LazyRefs_WeakRefTakenInOnLastStrongRef) {
+    sp<WeakOnLastStrongRef> object = new WeakOnLastStrongRef();
+    object.clear();
+    EXPECT_EQ(0, gLiveObjects);
+}
+
+TEST_F(RefBaseTest, LazyRefs_StressInflationAgainstStrongRefs) {
+    const int threadCount = 4;
+    const int rounds = 2000;
+    RaceState state;
+    Vector<sp<Thread> > threads;
+    for (int i = 0; i < threadCount; i++) {
+        sp<Thread> thread = new RaceThread(&state, i, rounds);
+        threads.push(thread);
+        thread->run();
+    }
+
+    for (int32_t round = 1; round <= rounds; round++) {
+        sp<PlainObject> object = new PlainObject();
+        state.object = object.get();
+        state.done = 0;
+        android_atomic_release_store(round, &state.round);
+        while (android_atomic_acquire_load(&state.done) != threadCount) {
+            sched_yield();
+        }
+
+        ASSERT_EQ(1, object->getStrongCount()) << "round " << round;
+        ASSERT_EQ(1, object->firstRefs);
+        wp<PlainObject> weak = object;
+        object.clear();
+        ASSERT_EQ(0, gLiveObjects) << "round " << round;
+        ASSERT_TRUE(weak.promote() == NULL);
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+    }
+    EXPECT_EQ(0, state.failedPromotes)
+            << "promote should succeed while the main thread holds the object";
+}
+
+TEST_F(RefBaseTest, LazyRefs_StressPromoteAgainstLastStrongRelease) {
+    const int threadCount = 4;
+    for (int round = 0; round < 200; round++) {
+        sp<PlainObject> object = new PlainObject();
+        volatile int32_t promoted = 0;
+        Vector<sp<Thread> > threads;
+        for (int i = 0; i < threadCount; i++) {
+            sp<Thread> thread = new PromoteThread(object, &promoted);
+            threads.push(thread);
+            thread->run();
+        }
+        while (android_atomic_acquire_load(&promoted) < 10) {
+            sched_yield();
+        }
+        object.clear();
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+        }
+        ASSERT_EQ(0, gLiveObjects) << "round " << round;
+    }
+}
+
+TEST_F(RefBaseTest, Benchmark_CreateAndDestroy) {
+    const int perThread = 1000000;
+    const int threadCounts[] = { 1, 4 };
+
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+        const int threadCount = threadCounts[t];
+        const int total = threadCount * perThread;
+        nsecs_t strongOnly = timeChurn<PlainObject>(threadCount, perThread, false);
+        nsecs_t plain = timeChurn<PlainObject>(threadCount, perThread, true);
+        printf("%d thread(s), %d objects: sp<> only %4lld ns/object, sp<>+wp<> %4lld ns/object\n",
+                threadCount, total,
+                (long long) (strongOnly / total), (long long) (plain / total));
+    }
+}
+
+} // namespace android
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SortedVector_test"
+
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace android {
+
+typedef key_value_pair_t<int, int> IntPair;
+
+class SortedVectorTest : public testing::Test {
+protected:
+    // Checks that 'actual' holds what adding each pair with add() would.
+    static void expectSameAsAdd(const KeyedVector<int, int>& initial,
+            const Vector<IntPair>& pairs, const KeyedVector<int, int>& actual) {
+        KeyedVector<int, int> expected = initial;
+        for (size_t i = 0; i < pairs.size(); i++) {
+            expected.add(pairs[i].key, pairs[i].value);
+        }
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            EXPECT_EQ(expected.keyAt(i), actual.keyAt(i));
+            EXPECT_EQ(expected.valueAt(i), actual.valueAt(i)) << "key " << expected.keyAt(i);
+        }
+    }
+};
+
+TEST_F(SortedVectorTest, AddAllSortsAndKeepsLastOfEqualItems) {
+    const IntPair pairs[] = { IntPair(5, 0), IntPair(1, 1), IntPair(5, 2),
+            IntPair(3, 3), IntPair(1, 4), IntPair(5, 5) };
+    KeyedVector<int, int> vector;
+    ASSERT_EQ(NO_ERROR, vector.addAll(pairs, sizeof(pairs) / sizeof(pairs[0])));
+
+    ASSERT_EQ(3U, vector.size());
+    EXPECT_EQ(1, vector.keyAt(0));
+    EXPECT_EQ(4, vector.valueAt(0));
+    EXPECT_EQ(3, vector.keyAt(1));
+    EXPECT_EQ(3, vector.valueAt(1));
+    EXPECT_EQ(5, vector.keyAt(2));
+    EXPECT_EQ(5, vector.valueAt(2));
+}
+
+TEST_F(SortedVectorTest, AddAllMatchesAdd) {
+    srand(42);
+    for (int round = 0; round < 20; round++) {
+        KeyedVector<int, int> initial;
+        for (int i = rand() % 100; i > 0; i--) {
+            initial.add(rand() % 200, i);
+        }
+        Vector<IntPair> pairs;
+        for (int i = rand() % 100; i > 0; i--) {
+            pairs.add(IntPair(rand() % 200, -i));
+        }
+        if (round % 4 == 0) {
+            // an already sorted batch, which skips the sort
+            SortedVector<IntPair> sorted;
+            sorted.merge(pairs);
+            pairs = Vector<IntPair>(sorted);
+        }
+
+        KeyedVector<int, int> vector = initial;
+        ASSERT_EQ(NO_ERROR, vector.addAll(pairs.array(), pairs.size()));
+        expectSameAsAdd(initial, pairs, vector);
+    }
+}
+
+TEST_F(SortedVectorTest, MergeLeavesSharedCopyAlone) {
+    SortedVector<String8> vector;
+    vector.add(String8("b"));
+    vector.add(String8("d"));
+    SortedVector<String8> copy = vector;
+
+    SortedVector<String8> other;
+    other.add(String8("a"));
+    other.add(String8("c"));
+    other.add(String8("d"));
+    ASSERT_EQ(NO_ERROR, vector.merge(other));
+
+    const char* expected[] = { "a", "b", "c", "d" };
+    ASSERT_EQ(4U, vector.size());
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_STREQ(expected[i], vector[i].string());
+    }
+    ASSERT_EQ(2U, copy.size());
+    EXPECT_STREQ("b", copy[0].string());
+    EXPECT_STREQ("d", copy[1].string());
+
+    ASSERT_EQ(NO_ERROR, vector.merge(vector));
+    EXPECT_EQ(4U, vector.size());
+}
+
+class Counted : public RefBase {
+};
+
+TEST_F(SortedVectorTest, MergeReleasesReplacedValues) {
+    sp<Counted> replaced = new Counted();
+    sp<Counted> kept = new Counted();
+    sp<Counted> added = new Counted();
+    KeyedVector<int, sp<Counted> > vector;
+    vector.add(1, kept);
+    vector.add(2, replaced);
+    vector.add(4, kept);
+
+    KeyedVector<int, sp<Counted> > other;
+    other.add(2, added);
+    other.add(3, added);
+    ASSERT_EQ(NO_ERROR, vector.merge(other));
+    other.clear();
+
+    ASSERT_EQ(4U, vector.size());
+    EXPECT_EQ(1, replaced->getStrongCount());
+    EXPECT_EQ(3, kept->getStrongCount());
+    EXPECT_EQ(3, added->getStrongCount());
+    EXPECT_EQ(added, vector.valueFor(2));
+}
+
+// ---------------------------------------------------------------------------
+
+// Builds a table of 'count' shuffled keys with add() and with addAll(), and
+// merges two tables of interleaved keys, half the size each, with merge().
+// Before addAll() existed, merging interleaved tables was an add() loop.
+template<typename KEY>
+static void benchmarkBuild(const char* name, size_t count, KEY (*makeKey)(int)) {
+    typedef key_value_pair_t<KEY, int> Pair;
+    Vector<Pair> pairs;
+    pairs.setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        pairs.add(Pair(makeKey(int(i)), int(i)));
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = rand() % (i + 1);
+        Pair tmp = pairs[i];
+        pairs.editItemAt(i) = pairs[j];
+        pairs.editItemAt(j) = tmp;
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    KeyedVector<KEY, int> added;
+    for (size_t i = 0; i < count; i++) {
+        added.add(pairs[i].key, pairs[i].value);
+    }
+    nsecs_t add = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    KeyedVector<KEY, int> bulk;
+    bulk.addAll(pairs.array(), count);
+    nsecs_t addAll = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    EXPECT_EQ(count, bulk.size());
+
+    KeyedVector<KEY, int> evens, odds;
+    for (size_t i = 0; i < count; i += 2) {
+        evens.add(makeKey(int(i)), int(i));
+        if (i + 1 < count) {
+            odds.add(makeKey(int(i + 1)), int(i + 1));
+        }
+    }
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    evens.merge(odds);
+    nsecs_t merge = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    EXPECT_EQ(count, evens.size());
+
+    printf("%s x %d: add() loop %lld us, addAll() %lld us, merge() %lld us\n",
+            name, int(count), add / 1000, addAll / 1000, merge / 1000);
+}
+
+static int intKey(int i) {
+    return i;
+}
+
+static String8 stringKey(int i) {
+    return String8::format("key.%08d", i);
+}
+
+TEST_F(SortedVectorTest, Benchmark_BuildAndMerge) {
+    srand(42);
+    const size_t counts[] = { 10000, 100000 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        benchmarkBuild("int", counts[i], intKey);
+        benchmarkBuild("String8", counts[i], stringKey);
+    }
+}
+
+} // namespace android
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/str_parms.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+// The pairs of a "k=v;k=v" string, sorted, since str_parms_to_str() writes
+// them in hash order.
+static SortedVector<String8> sortedPairs(const char* str) {
+    SortedVector<String8> pairs;
+    const char* start = str;
+    for (const char* p = str; ; p++) {
+        if (*p == ';' || *p == '\0') {
+            if (p != start) {
+                pairs.add(String8(start, p - start));
+            }
+            if (*p == '\0') {
+                break;
+            }
+            start = p + 1;
+        }
+    }
+    return pairs;
+}
+
+static void expectSamePairs(const char* expected, const char* actual) {
+    SortedVector<String8> expectedPairs = sortedPairs(expected);
+    SortedVector<String8> actualPairs = sortedPairs(actual);
+    ASSERT_EQ(expectedPairs.size(), actualPairs.size()) << expected << " vs " << actual;
+    for (size_t i = 0; i < expectedPairs.size(); i++) {
+        EXPECT_STREQ(expectedPairs[i].string(), actualPairs[i].string());
+    }
+}
+
+TEST(StrParmsViewTest, ParsesLikeCreateStr) {
+    const char* strings[] = { "", ";", "=", "=;", "=bar", "=bar;", "foo=",
+            "foo=;", "foo=bar", "foo=bar;", "foo=bar;baz", "foo=bar;baz=",
+            "foo=bar;baz=bat", "foo=bar;baz=bat;", "foo=bar;baz=bat;foo=bar",
+            ";;foo=bar;;baz=a=b;foo=qux", "foo;foo=1;foo" };
+    const char* keys[] = { "foo", "baz", "bar", "" };
+
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        struct str_parms_pair pairs[8];
+        struct str_parms_view view;
+        ASSERT_EQ(0, str_parms_view_parse(&view, pairs, 8, strings[i])) << strings[i];
+        struct str_parms* parms = str_parms_create_str(strings[i]);
+        ASSERT_TRUE(parms != NULL);
+
+        for (size_t j = 0; j < sizeof(keys) / sizeof(keys[0]); j++) {
+            char expected[32] = "";
+            char actual[32] = "";
+            EXPECT_EQ(str_parms_get_str(parms, keys[j], expected, sizeof(expected)),
+                    str_parms_view_get_str(&view, keys[j], actual, sizeof(actual)))
+                    << strings[i] << " " << keys[j];
+            EXPECT_STREQ(expected, actual) << strings[i] << " " << keys[j];
+        }
+
+        char* expected = str_parms_to_str(parms);
+        char actual[64];
+        EXPECT_EQ(int(strlen(expected)), str_parms_view_to_str(&view, actual, sizeof(actual)));
+        expectSamePairs(expected, actual);
+        free(expected);
+        str_parms_destroy(parms);
+    }
+}
+
+TEST(StrParmsViewTest, GetNumbers) {
+    struct str_parms_pair pairs[8];
+    struct str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_parse(&view, pairs, 8,
+            "a=12;b=0x10;c=1.5;d=;e=12x;f=-3;g= 7"));
+
+    int i = 0;
+    EXPECT_EQ(0, str_parms_view_get_int(&view, "a", &i));
+    EXPECT_EQ(12, i);
+    EXPECT_EQ(0, str_parms_view_get_int(&view, "b", &i));
+    EXPECT_EQ(16, i);
+    EXPECT_EQ(0, str_parms_view_get_int(&view, "f", &i));
+    EXPECT_EQ(-3, i);
+    EXPECT_EQ(0, str_parms_view_get_int(&view, "g", &i));
+    EXPECT_EQ(7, i);
+    EXPECT_EQ(-EINVAL, str_parms_view_get_int(&view, "c", &i));
+    EXPECT_EQ(-EINVAL, str_parms_view_get_int(&view, "d", &i));
+    EXPECT_EQ(-EINVAL, str_parms_view_get_int(&view, "e", &i));
+    EXPECT_EQ(-ENOENT, str_parms_view_get_int(&view, "h", &i));
+
+    float f = 0;
+    EXPECT_EQ(0, str_parms_view_get_float(&view, "c", &f));
+    EXPECT_EQ(1.5f, f);
+    EXPECT_EQ(-EINVAL, str_parms_view_get_float(&view, "d", &f));
+    EXPECT_EQ(-EINVAL, str_parms_view_get_float(&view, "e", &f));
+
+    struct str_parms* parms = str_parms_create_str("c=1.5");
+    f = 0;
+    EXPECT_EQ(0, str_parms_get_float(parms, "c", &f));
+    EXPECT_EQ(1.5f, f);
+    str_parms_destroy(parms);
+}
+
+TEST(StrParmsViewTest, LastValueWins) {
+    struct str_parms_pair pairs[8];
+    struct str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_parse(&view, pairs, 8, "a=1;b=2;a=3"));
+    EXPECT_EQ(3U, view.count);
+
+    const struct str_parms_pair* pair = str_parms_view_find(&view, "a");
+    ASSERT_TRUE(pair != NULL);
+    EXPECT_EQ(1U, pair->value_len);
+    EXPECT_EQ('3', pair->value[0]);
+
+    char buf[16];
+    EXPECT_EQ(7, str_parms_view_to_str(&view, buf, sizeof(buf)));
+    EXPECT_STREQ("b=2;a=3", buf);
+    EXPECT_EQ(-ENOSPC, str_parms_view_to_str(&view, buf, 7));
+    EXPECT_STREQ("", buf);
+}
+
+TEST(StrParmsViewTest, TooManyPairs) {
+    struct str_parms_pair pairs[2];
+    struct str_parms_view view;
+    EXPECT_EQ(-ENOSPC, str_parms_view_parse(&view, pairs, 2, "a=1;b=2;c=3"));
+    EXPECT_EQ(2U, view.count);
+    EXPECT_TRUE(str_parms_view_find(&view, "b") != NULL);
+    EXPECT_TRUE(str_parms_view_find(&view, "c") == NULL);
+}
+
+TEST(StrParmsWriterTest, BuildsInPlace) {
+    char buf[32];
+    struct str_parms_writer writer;
+    str_parms_writer_init(&writer, buf, sizeof(buf));
+    EXPECT_STREQ("", buf);
+
+    EXPECT_EQ(0, str_parms_writer_add_str(&writer, "routing", "2"));
+    EXPECT_EQ(0, str_parms_writer_add_int(&writer, "rate", -48000));
+    EXPECT_STREQ("routing=2;rate=-48000", buf);
+    EXPECT_EQ(strlen(buf), writer.len);
+
+    // "routing=2;rate=-48000;gain=0.5000000000" does not fit.
+    EXPECT_EQ(-ENOSPC, str_parms_writer_add_float(&writer, "gain", 0.5f));
+    EXPECT_STREQ("routing=2;rate=-48000", buf);
+    EXPECT_EQ(0, str_parms_writer_add_str(&writer, "mute", ""));
+    EXPECT_STREQ("routing=2;rate=-48000;mute=", buf);
+
+    char big[64];
+    str_parms_writer_init(&writer, big, sizeof(big));
+    EXPECT_EQ(0, str_parms_writer_add_float(&writer, "gain", 0.5f));
+    struct str_parms* parms = str_parms_create();
+    str_parms_add_float(parms, "gain", 0.5f);
+    char* expected = str_parms_to_str(parms);
+    EXPECT_STREQ(expected, big);
+    free(expected);
+    str_parms_destroy(parms);
+}
+
+// ---------------------------------------------------------------------------
+
+static const char* kSetParameters =
+        "routing=2;format=1;channels=3;sampling_rate=48000;frame_count=960;input_source=1";
+static const int kIterations = 200000;
+
+// A HAL's set_parameters(): parse and read three ints.
+TEST(StrParmsBenchmark, Benchmark_ParseAndGet) {
+    int sum = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        struct str_parms* parms = str_parms_create_str(kSetParameters);
+        int value;
+        if (str_parms_get_int(parms, "routing", &value) == 0) sum += value;
+        if (str_parms_get_int(parms, "sampling_rate", &value) == 0) sum += value;
+        if (str_parms_get_int(parms, "frame_count", &value) == 0) sum += value;
+        str_parms_destroy(parms);
+    }
+    nsecs_t hashmap = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / kIterations;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        struct str_parms_pair pairs[8];
+        struct str_parms_view view;
+        str_parms_view_parse(&view, pairs, 8, kSetParameters);
+        int value;
+        if (str_parms_view_get_int(&view, "routing", &value) == 0) sum -= value;
+        if (str_parms_view_get_int(&view, "sampling_rate", &value) == 0) sum -= value;
+        if (str_parms_view_get_int(&view, "frame_count", &value) == 0) sum -= value;
+    }
+    nsecs_t view = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / kIterations;
+
+    EXPECT_EQ(0, sum);
+    printf("parse + 3 x get_int: str_parms %lld ns, view %lld ns\n", hashmap, view);
+}
+
+// A HAL's get_parameters(): format a reply with three values.
+TEST(StrParmsBenchmark, Benchmark_Format) {
+    size_t length = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        struct str_parms* parms = str_parms_create();
+        str_parms_add_str(parms, "sup_formats", "AUDIO_FORMAT_PCM_16_BIT");
+        str_parms_add_int(parms, "sampling_rate", 48000);
+        str_parms_add_int(parms, "channels", 3);
+        char* str = str_parms_to_str(parms);
+        length += strlen(str);
+        free(str);
+        str_parms_destroy(parms);
+    }
+    nsecs_t hashmap = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / kIterations;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        char buf[128];
+        struct str_parms_writer writer;
+        str_parms_writer_init(&writer, buf, sizeof(buf));
+        str_parms_writer_add_str(&writer, "sup_formats", "AUDIO_FORMAT_PCM_16_BIT");
+        str_parms_writer_add_int(&writer, "sampling_rate", 48000);
+        str_parms_writer_add_int(&writer, "channels", 3);
+        length -= writer.len;
+    }
+    nsecs_t writer = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / kIterations;
+
+    EXPECT_EQ(0U, length);
+    printf("3 x add + to_str: str_parms %lld ns, writer %lld ns\n", hashmap, writer);
+}
+
+} // namespace android
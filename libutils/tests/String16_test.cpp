@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "String16_test"
+#include <utils/Log.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+static String8 toUtf8(const String16& str) {
+    return String8(str);
+}
+
+TEST(String16Test, ShortStringsDoNotAllocate) {
+    String16 empty;
+    String16 word("status");
+    String16 full("1234567");
+    String16 fromString8(String8("health"));
+
+    EXPECT_TRUE(empty.sharedBuffer() == NULL);
+    EXPECT_TRUE(word.sharedBuffer() == NULL);
+    EXPECT_TRUE(full.sharedBuffer() == NULL);
+    EXPECT_TRUE(fromString8.sharedBuffer() == NULL);
+    EXPECT_EQ(0U, empty.size());
+    EXPECT_EQ(7U, full.size());
+    EXPECT_STREQ("1234567", toUtf8(full).string());
+    EXPECT_STREQ("health", toUtf8(fromString8).string());
+
+    String16 longer("12345678");
+    EXPECT_TRUE(longer.sharedBuffer() != NULL);
+    String16 copy(longer);
+    EXPECT_EQ(longer.sharedBuffer(), copy.sharedBuffer());
+}
+
+TEST(String16Test, EditsAcrossInlineLength) {
+    String16 str("abcd");
+    str.append(String16("efg"));
+    EXPECT_TRUE(str.sharedBuffer() == NULL);
+    str.insert(0, String16("__").string());
+    EXPECT_TRUE(str.sharedBuffer() != NULL);
+    EXPECT_STREQ("__abcdefg", toUtf8(str).string());
+
+    str.remove(3, 2);
+    EXPECT_TRUE(str.sharedBuffer() == NULL);
+    EXPECT_STREQ("abc", toUtf8(str).string()) << "remove() keeps len chars from begin";
+
+    str.append(str);
+    str.append(str);
+    EXPECT_STREQ("abcabcabcabc", toUtf8(str).string());
+    str.setTo(str, 4, 2);
+    EXPECT_STREQ("cabc", toUtf8(str).string());
+}
+
+TEST(String16Test, EditingACopyLeavesTheOriginal) {
+    String16 original("/system/framework");
+    String16 copy(original);
+    copy.replaceAll('/', '.');
+    EXPECT_STREQ("/system/framework", toUtf8(original).string());
+    EXPECT_STREQ(".system.framework", toUtf8(copy).string());
+
+    String16 upper("ABC");
+    String16 upperCopy(upper);
+    upperCopy.makeLower();
+    EXPECT_STREQ("ABC", toUtf8(upper).string());
+    EXPECT_STREQ("abc", toUtf8(upperCopy).string());
+    EXPECT_TRUE(upperCopy == String16("abc"));
+    EXPECT_TRUE(upper < upperCopy);
+}
+
+}
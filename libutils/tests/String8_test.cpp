@@ -17,8 +17,12 @@
 #define LOG_TAG "String8_test"
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <utils/String16.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 #include <gtest/gtest.h>
+#include <stdio.h>
 
 namespace android {
 
@@ -72,4 +76,220 @@ TEST_F(String8Test, OperatorPlusEquals) {
     EXPECT_STREQ(src3, " Verify me.");
 }
 
+// Number of distinct SharedBuffers behind the strings.
+static size_t countBuffers(const Vector<String8>& strings) {
+    Vector<const SharedBuffer*> buffers;
+    for (size_t i = 0; i < strings.size(); i++) {
+        const SharedBuffer* buf = strings[i].sharedBuffer();
+        bool seen = buf == NULL;
+        for (size_t j = 0; !seen && j < buffers.size(); j++) {
+            seen = buffers[j] == buf;
+        }
+        if (!seen) {
+            buffers.push(buf);
+        }
+    }
+    return buffers.size();
+}
+
+TEST_F(String8Test, ShortStringsDoNotAllocate) {
+    Vector<String8> strings;
+    strings.push(String8());
+    strings.push(String8(""));
+    strings.push(String8("ro.build.id"));
+    strings.push(String8("123456789012345"));
+    strings.push(String8::format("%d", 42));
+    strings.push(String8(String16("status")));
+    String8 appended("/sys");
+    appended.append("/class");
+    strings.push(appended);
+
+    EXPECT_EQ(0U, countBuffers(strings));
+    EXPECT_STREQ("123456789012345", strings[3].string());
+    EXPECT_EQ(15U, strings[3].length());
+    EXPECT_STREQ("42", strings[4].string());
+    EXPECT_STREQ("status", strings[5].string());
+    EXPECT_STREQ("/sys/class", strings[6].string());
+}
+
+TEST_F(String8Test, CopiesOfLongStringsShareTheirBuffer) {
+    Vector<String8> strings;
+    String8 path("/sys/class/power_supply/battery/capacity");
+    strings.push(path);
+    strings.push(path);
+    String8 copy(path);
+    strings.push(copy);
+    String8 assigned;
+    assigned = copy;
+    strings.push(assigned);
+
+    EXPECT_EQ(1U, countBuffers(strings));
+
+    copy.append("_level");
+    strings.push(copy);
+    EXPECT_EQ(2U, countBuffers(strings)) << "editing a shared string should copy it";
+    EXPECT_STREQ("/sys/class/power_supply/battery/capacity", path.string());
+    EXPECT_STREQ("/sys/class/power_supply/battery/capacity_level", copy.string());
+}
+
+TEST_F(String8Test, GrowsAndShrinksAcrossInlineLength) {
+    String8 str("0123456789");
+    str.append("abcde");
+    EXPECT_TRUE(str.sharedBuffer() == NULL);
+    str.append("f");
+    EXPECT_TRUE(str.sharedBuffer() != NULL);
+    EXPECT_STREQ("0123456789abcdef", str.string());
+    EXPECT_EQ(16U, str.length());
+
+    char* buf = str.lockBuffer(4);
+    ASSERT_TRUE(buf != NULL);
+    EXPECT_EQ(0, memcmp(buf, "0123", 4)) << "lockBuffer should keep the contents";
+    buf[4] = '\0';
+    str.unlockBuffer();
+    EXPECT_TRUE(str.sharedBuffer() == NULL);
+    EXPECT_STREQ("0123", str.string());
+    EXPECT_EQ(4U, str.length());
+
+    str.toUpper();
+    str.append("xyz");
+    EXPECT_STREQ("0123xyz", str.string());
+    str.setTo(str.string() + 2);
+    EXPECT_STREQ("23xyz", str.string());
+
+    str.clear();
+    EXPECT_TRUE(str.isEmpty());
+    EXPECT_STREQ("", str.string());
+}
+
+TEST_F(String8Test, SelfReferencingEdits) {
+    String8 shortStr("abc");
+    shortStr.append(shortStr);
+    EXPECT_STREQ("abcabc", shortStr.string());
+    shortStr.append(shortStr.string());
+    EXPECT_STREQ("abcabcabcabc", shortStr.string());
+    shortStr.append(shortStr);
+    EXPECT_STREQ("abcabcabcabcabcabcabcabc", shortStr.string());
+    shortStr.setTo(shortStr.string() + 20);
+    EXPECT_STREQ("cabc", shortStr.string());
+    shortStr = shortStr;
+    EXPECT_STREQ("cabc", shortStr.string());
+}
+
+TEST_F(String8Test, PathFunctionsOnShortStrings) {
+    String8 path("/tmp");
+    path.appendPath("foo.c");
+    EXPECT_STREQ("/tmp/foo.c", path.string());
+    EXPECT_STREQ("foo.c", path.getPathLeaf().string());
+    EXPECT_STREQ("/tmp", path.getPathDir().string());
+    EXPECT_STREQ(".c", path.getPathExtension().string());
+    EXPECT_STREQ("/tmp/foo", path.getBasePath().string());
+
+    path.appendPath("a_much_longer_file_name.txt");
+    EXPECT_STREQ("/tmp/foo.c/a_much_longer_file_name.txt", path.string());
+    String8 remains;
+    EXPECT_STREQ("tmp", path.walkPath(&remains).string());
+    EXPECT_STREQ("foo.c/a_much_longer_file_name.txt", remains.string());
+}
+
+TEST_F(String8Test, VectorRelocationKeepsShortAndLongStrings) {
+    Vector<String8> strings;
+    for (int i = 0; i < 100; i++) {
+        if (i % 2) {
+            strings.push(String8::format("%d", i));
+        } else {
+            strings.push(String8::format("a long string that needs a buffer %d", i));
+        }
+    }
+    strings.removeAt(0);
+    strings.insertAt(String8("front"), 0);
+    EXPECT_STREQ("front", strings[0].string());
+    for (int i = 1; i < 100; i++) {
+        String8 expected = i % 2 ? String8::format("%d", i)
+                : String8::format("a long string that needs a buffer %d", i);
+        EXPECT_STREQ(expected.string(), strings[i].string());
+    }
+}
+
+#if __cplusplus >= 201103L
+TEST_F(String8Test, MoveLeavesSourceEmpty) {
+    String8 longStr("/sys/class/power_supply/battery/capacity");
+    const SharedBuffer* buf = longStr.sharedBuffer();
+    String8 moved(static_cast<String8&&>(longStr));
+    EXPECT_EQ(buf, moved.sharedBuffer()) << "moving should not copy the buffer";
+    EXPECT_TRUE(longStr.isEmpty());
+
+    String8 shortStr("battery");
+    shortStr = static_cast<String8&&>(moved);
+    EXPECT_EQ(buf, shortStr.sharedBuffer());
+    EXPECT_TRUE(moved.isEmpty());
+    EXPECT_STREQ("/sys/class/power_supply/battery/capacity", shortStr.string());
+}
+#endif
+
+TEST_F(String8Test, Benchmark_ShortAndLongStrings) {
+    const int iterations = 1000000;
+    const char* const shortStrings[] = {
+        "ro.build.id", "status", "health", "present", "voltage_now", "/sys", "key",
+    };
+    const size_t shortCount = sizeof(shortStrings) / sizeof(shortStrings[0]);
+    const char* longString = "/sys/class/power_supply/battery/capacity";
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t total = 0;
+    for (int i = 0; i < iterations; i++) {
+        String8 str(shortStrings[i % shortCount]);
+        total += str.length();
+    }
+    nsecs_t shortCreate = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        String8 str(longString);
+        total += str.length();
+    }
+    nsecs_t longCreate = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    String8 shortSource("ro.build.id");
+    String8 longSource(longString);
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        String8 copy(shortSource);
+        total += copy.length();
+    }
+    nsecs_t shortCopy = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        String8 copy(longSource);
+        total += copy.length();
+    }
+    nsecs_t longCopy = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    // Splitting a line into short tokens, like Tokenizer::nextToken() callers.
+    const char* line = "key 0x12 DPAD_UP WAKE VIRTUAL FUNCTION";
+    Vector<String8> tokens;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations / 10; i++) {
+        tokens.clear();
+        const char* p = line;
+        while (*p) {
+            const char* end = strchr(p, ' ');
+            if (end == NULL) {
+                end = p + strlen(p);
+            }
+            tokens.push(String8(p, end - p));
+            p = *end ? end + 1 : end;
+        }
+    }
+    nsecs_t tokenize = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    EXPECT_EQ(6U, tokens.size());
+    EXPECT_LT(0U, total);
+
+    printf("create short %3lld ns, create long %3lld ns, copy short %3lld ns, "
+            "copy long %3lld ns, tokenize line %4lld ns; %zu buffers for %zu tokens\n",
+            (long long) (shortCreate / iterations), (long long) (longCreate / iterations),
+            (long long) (shortCopy / iterations), (long long) (longCopy / iterations),
+            (long long) (tokenize / (iterations / 10)), countBuffers(tokens), tokens.size());
+}
+
 }
@@ -0,0 +1,480 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ThreadPool_test"
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/SortedVector.h>
+#include <utils/Thread.h>
+#include <utils/ThreadPool.h>
+#include <utils/Timers.h>
+#include <cutils/atomic.h>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace android {
+
+class CountingTask : public ThreadPoolTask {
+public:
+    explicit CountingTask(volatile int32_t* counter) : mCounter(counter) { }
+
+protected:
+    virtual void run() {
+        android_atomic_inc(mCounter);
+    }
+
+private:
+    volatile int32_t* mCounter;
+};
+
+class CallbackTask : public ThreadPoolTask {
+public:
+    CallbackTask() : ran(false), ranBeforeCallback(false), callbacks(0),
+            completedStatus(NO_INIT) { }
+
+    bool ran;
+    bool ranBeforeCallback;
+    int callbacks;
+    status_t completedStatus;
+
+protected:
+    virtual void run() {
+        ran = true;
+    }
+
+    virtual void onCompleted(status_t status) {
+        ranBeforeCallback = ran;
+        callbacks++;
+        completedStatus = status;
+    }
+};
+
+// Sums [begin, end) by splitting it in halves that run as subtasks.
+class SumTask : public ThreadPoolTask {
+public:
+    SumTask(ThreadPool* pool, int begin, int end)
+        : sum(0), mPool(pool), mBegin(begin), mEnd(end) { }
+
+    int64_t sum;
+
+protected:
+    virtual void run() {
+        if (mEnd - mBegin <= 64) {
+            for (int i = mBegin; i < mEnd; i++) {
+                sum += i;
+            }
+            return;
+        }
+        int middle = mBegin + (mEnd - mBegin) / 2;
+        sp<SumTask> left = new SumTask(mPool, mBegin, middle);
+        sp<SumTask> right = new SumTask(mPool, middle, mEnd);
+        mPool->submit(left);
+        mPool->submit(right);
+        left->wait();
+        right->wait();
+        sum = left->sum + right->sum;
+    }
+
+private:
+    ThreadPool* mPool;
+    int mBegin;
+    int mEnd;
+};
+
+// Records which thread it ran on.
+class SleepingTask : public ThreadPoolTask {
+public:
+    SleepingTask(Mutex* lock, SortedVector<pthread_t>* threads, useconds_t sleep)
+        : mLock(lock), mThreads(threads), mSleep(sleep) { }
+
+protected:
+    virtual void run() {
+        usleep(mSleep);
+        AutoMutex _l(*mLock);
+        mThreads->add(pthread_self());
+    }
+
+private:
+    Mutex* mLock;
+    SortedVector<pthread_t>* mThreads;
+    useconds_t mSleep;
+};
+
+class SpawningTask : public ThreadPoolTask {
+public:
+    SpawningTask(ThreadPool* pool, Mutex* lock, SortedVector<pthread_t>* threads)
+        : mPool(pool), mLock(lock), mThreads(threads) { }
+
+protected:
+    virtual void run() {
+        sp<ThreadPoolTask> tasks[8];
+        for (size_t i = 0; i < 8; i++) {
+            tasks[i] = new SleepingTask(mLock, mThreads, 10000);
+            mPool->submit(tasks[i]);
+        }
+        for (size_t i = 0; i < 8; i++) {
+            tasks[i]->wait();
+        }
+    }
+
+private:
+    ThreadPool* mPool;
+    Mutex* mLock;
+    SortedVector<pthread_t>* mThreads;
+};
+
+class BlockingTask : public ThreadPoolTask {
+public:
+    BlockingTask() : mStarted(false) { }
+
+    void waitUntilStarted() {
+        AutoMutex _l(mLock);
+        while (!mStarted) {
+            mCondition.wait(mLock);
+        }
+    }
+
+protected:
+    virtual void run() {
+        {
+            AutoMutex _l(mLock);
+            mStarted = true;
+            mCondition.broadcast();
+        }
+        usleep(200000);
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    bool mStarted;
+};
+
+TEST(ThreadPoolTest, RunsEverySubmittedTask) {
+    const int kTasks = 1000;
+    volatile int32_t counter = 0;
+    ThreadPool pool(4);
+    ASSERT_EQ(NO_ERROR, pool.start());
+
+    Vector<sp<ThreadPoolTask> > tasks;
+    for (int i = 0; i < kTasks; i++) {
+        tasks.add(new CountingTask(&counter));
+        ASSERT_EQ(NO_ERROR, pool.submit(tasks[i]));
+    }
+    for (int i = 0; i < kTasks; i++) {
+        EXPECT_EQ(NO_ERROR, tasks[i]->wait());
+        EXPECT_TRUE(tasks[i]->isDone());
+    }
+    EXPECT_EQ(kTasks, counter);
+}
+
+TEST(ThreadPoolTest, TasksSubmittedBeforeStartRunAfterIt) {
+    volatile int32_t counter = 0;
+    ThreadPool pool(2);
+    sp<ThreadPoolTask> task = new CountingTask(&counter);
+    ASSERT_EQ(NO_ERROR, pool.submit(task));
+    EXPECT_FALSE(task->isDone());
+
+    ASSERT_EQ(NO_ERROR, pool.start());
+    EXPECT_EQ(NO_ERROR, task->wait());
+    EXPECT_EQ(1, counter);
+}
+
+TEST(ThreadPoolTest, CompletionCallbackRunsBeforeWaitReturns) {
+    ThreadPool pool(2);
+    ASSERT_EQ(NO_ERROR, pool.start());
+    sp<CallbackTask> task = new CallbackTask();
+    ASSERT_EQ(NO_ERROR, pool.submit(task));
+    EXPECT_EQ(NO_ERROR, task->wait());
+    EXPECT_TRUE(task->ran);
+    EXPECT_TRUE(task->ranBeforeCallback);
+    EXPECT_EQ(1, task->callbacks);
+    EXPECT_EQ(NO_ERROR, task->completedStatus);
+}
+
+// Every task but the leaves waits for its subtasks, which only finishes
+// on two threads because waiting threads run other tasks meanwhile.
+TEST(ThreadPoolTest, WaitingTasksHelpRunSubtasks) {
+    const int kCount = 100000;
+    ThreadPool pool(2);
+    ASSERT_EQ(NO_ERROR, pool.start());
+    sp<SumTask> task = new SumTask(&pool, 0, kCount);
+    ASSERT_EQ(NO_ERROR, pool.submit(task));
+    EXPECT_EQ(NO_ERROR, task->wait());
+    EXPECT_EQ(int64_t(kCount) * (kCount - 1) / 2, task->sum);
+}
+
+TEST(ThreadPoolTest, IdleWorkersStealSubtasks) {
+    Mutex lock;
+    SortedVector<pthread_t> threads;
+    ThreadPool pool(4);
+    ASSERT_EQ(NO_ERROR, pool.start());
+    sp<ThreadPoolTask> task = new SpawningTask(&pool, &lock, &threads);
+    ASSERT_EQ(NO_ERROR, pool.submit(task));
+    EXPECT_EQ(NO_ERROR, task->wait());
+
+    AutoMutex _l(lock);
+    EXPECT_LT(1U, threads.size());
+}
+
+TEST(ThreadPoolTest, ShutdownRunsQueuedTasks) {
+    const int kTasks = 100;
+    volatile int32_t counter = 0;
+    ThreadPool pool(1);
+    ASSERT_EQ(NO_ERROR, pool.start());
+    for (int i = 0; i < kTasks; i++) {
+        ASSERT_EQ(NO_ERROR, pool.submit(new CountingTask(&counter)));
+    }
+    EXPECT_EQ(NO_ERROR, pool.shutdown());
+    EXPECT_EQ(kTasks, counter);
+}
+
+TEST(ThreadPoolTest, ShutdownWithoutDrainCancelsQueuedTasks) {
+    ThreadPool pool(1);
+    ASSERT_EQ(NO_ERROR, pool.start());
+    sp<BlockingTask> running = new BlockingTask();
+    ASSERT_EQ(NO_ERROR, pool.submit(running));
+    running->waitUntilStarted();
+
+    sp<CallbackTask> queued[10];
+    for (size_t i = 0; i < 10; i++) {
+        queued[i] = new CallbackTask();
+        ASSERT_EQ(NO_ERROR, pool.submit(queued[i]));
+    }
+    EXPECT_EQ(NO_ERROR, pool.shutdown(false));
+
+    EXPECT_EQ(NO_ERROR, running->wait());
+    for (size_t i = 0; i < 10; i++) {
+        EXPECT_EQ(DEAD_OBJECT, queued[i]->wait());
+        EXPECT_FALSE(queued[i]->ran);
+        EXPECT_EQ(1, queued[i]->callbacks);
+        EXPECT_EQ(DEAD_OBJECT, queued[i]->completedStatus);
+    }
+}
+
+TEST(ThreadPoolTest, SubmitAfterShutdownFails) {
+    volatile int32_t counter = 0;
+    ThreadPool pool(1);
+    ASSERT_EQ(NO_ERROR, pool.start());
+    EXPECT_EQ(NO_ERROR, pool.shutdown());
+
+    sp<ThreadPoolTask> task = new CountingTask(&counter);
+    EXPECT_EQ(INVALID_OPERATION, pool.submit(task));
+    EXPECT_FALSE(task->isDone());
+    EXPECT_EQ(0, counter);
+}
+
+// ---------------------------------------------------------------------------
+
+// The obvious alternative to compare with: one queue behind one lock that all
+// workers take tasks from.
+class LockedTask : public RefBase {
+public:
+    virtual void run() = 0;
+};
+
+class SingleLockPool {
+public:
+    explicit SingleLockPool(size_t threadCount) : mHead(0), mExiting(false) {
+        for (size_t i = 0; i < threadCount; i++) {
+            mWorkers.add(new Worker(this));
+        }
+    }
+
+    ~SingleLockPool() {
+        {
+            AutoMutex _l(mLock);
+            mExiting = true;
+            mCondition.broadcast();
+        }
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            mWorkers[i]->join();
+        }
+    }
+
+    void start() {
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            mWorkers[i]->run("SingleLockPool");
+        }
+    }
+
+    void submit(const sp<LockedTask>& task) {
+        AutoMutex _l(mLock);
+        mQueue.add(task);
+        mCondition.signal();
+    }
+
+private:
+    class Worker : public Thread {
+    public:
+        explicit Worker(SingleLockPool* pool) : Thread(false), mPool(pool) { }
+
+    private:
+        virtual bool threadLoop() {
+            sp<LockedTask> task;
+            {
+                AutoMutex _l(mPool->mLock);
+                while (mPool->mHead == mPool->mQueue.size() && !mPool->mExiting) {
+                    mPool->mCondition.wait(mPool->mLock);
+                }
+                if (mPool->mHead == mPool->mQueue.size()) {
+                    return false;
+                }
+                task = mPool->mQueue[mPool->mHead];
+                mPool->mQueue.editItemAt(mPool->mHead++).clear();
+                if (mPool->mHead * 2 >= mPool->mQueue.size()) {
+                    mPool->mQueue.removeItemsAt(0, mPool->mHead);
+                    mPool->mHead = 0;
+                }
+            }
+            task->run();
+            return true;
+        }
+
+        SingleLockPool* mPool;
+    };
+
+    Mutex mLock;
+    Condition mCondition;
+    Vector<sp<LockedTask> > mQueue;
+    size_t mHead;
+    bool mExiting;
+    Vector<sp<Worker> > mWorkers;
+};
+
+class Latch {
+public:
+    explicit Latch(int32_t count) : mCount(count) { }
+
+    void countDown() {
+        if (android_atomic_dec(&mCount) == 1) {
+            AutoMutex _l(mLock);
+            mCondition.broadcast();
+        }
+    }
+
+    void wait() {
+        AutoMutex _l(mLock);
+        while (android_atomic_acquire_load(&mCount) > 0) {
+            mCondition.wait(mLock);
+        }
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    volatile int32_t mCount;
+};
+
+// A few dozen nanoseconds of work.
+static void burn() {
+    volatile int32_t x = 0;
+    for (int i = 0; i < 32; i++) {
+        x += i;
+    }
+}
+
+template<typename Base>
+class FlatTask : public Base {
+public:
+    explicit FlatTask(Latch* latch) : mLatch(latch) { }
+
+    virtual void run() {
+        burn();
+        mLatch->countDown();
+    }
+
+private:
+    Latch* mLatch;
+};
+
+// Submits two subtasks until 'depth' reaches 0, for 2^(depth + 1) - 1 tasks.
+template<typename Pool, typename Base>
+class TreeTask : public Base {
+public:
+    TreeTask(Pool* pool, Latch* latch, int depth)
+        : mPool(pool), mLatch(latch), mDepth(depth) { }
+
+    virtual void run() {
+        if (mDepth > 0) {
+            mPool->submit(new TreeTask(mPool, mLatch, mDepth - 1));
+            mPool->submit(new TreeTask(mPool, mLatch, mDepth - 1));
+        }
+        burn();
+        mLatch->countDown();
+    }
+
+private:
+    Pool* mPool;
+    Latch* mLatch;
+    int mDepth;
+};
+
+// Nanoseconds per task for 'tasks' tasks submitted from outside the pool.
+template<typename Pool, typename Base>
+static nsecs_t timeFlatTasks(Pool* pool, int tasks) {
+    Latch latch(tasks);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < tasks; i++) {
+        pool->submit(new FlatTask<Base>(&latch));
+    }
+    latch.wait();
+    return (systemTime(SYSTEM_TIME_MONOTONIC) - start) / tasks;
+}
+
+// Nanoseconds per task for a tree of tasks submitted by the pool's threads.
+template<typename Pool, typename Base>
+static nsecs_t timeTreeTasks(Pool* pool, int depth) {
+    int tasks = (2 << depth) - 1;
+    Latch latch(tasks);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    pool->submit(new TreeTask<Pool, Base>(pool, &latch, depth));
+    latch.wait();
+    return (systemTime(SYSTEM_TIME_MONOTONIC) - start) / tasks;
+}
+
+// Throughput of tiny tasks, submitted all at once from outside ("flat") or
+// by the tasks themselves ("tree"), on 1 and 4 threads.
+TEST(ThreadPoolBenchmark, Benchmark_FineGrainedTasks) {
+    const int kFlatTasks = 200000;
+    const int kTreeDepth = 17;
+    const size_t threadCounts[] = { 1, 4 };
+
+    for (size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++) {
+        size_t threads = threadCounts[i];
+        nsecs_t lockedFlat, lockedTree, stealingFlat, stealingTree;
+        {
+            SingleLockPool pool(threads);
+            pool.start();
+            lockedFlat = timeFlatTasks<SingleLockPool, LockedTask>(&pool, kFlatTasks);
+            lockedTree = timeTreeTasks<SingleLockPool, LockedTask>(&pool, kTreeDepth);
+        }
+        {
+            ThreadPool pool(threads);
+            ASSERT_EQ(NO_ERROR, pool.start());
+            stealingFlat = timeFlatTasks<ThreadPool, ThreadPoolTask>(&pool, kFlatTasks);
+            stealingTree = timeTreeTasks<ThreadPool, ThreadPoolTask>(&pool, kTreeDepth);
+        }
+        printf("%d threads: single lock %lld ns flat, %lld ns tree; "
+                "work stealing %lld ns flat, %lld ns tree\n", int(threads),
+                lockedFlat, lockedTree, stealingFlat, stealingTree);
+    }
+}
+
+} // namespace android
@@ -16,9 +16,12 @@
 
 #define LOG_TAG "Unicode_test"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 #include <utils/Unicode.h>
 
 #include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
 
 namespace android {
 
@@ -112,4 +115,192 @@ TEST_F(UnicodeTest, UTF8toUTF16Normal) {
             << "should be NULL terminated";
 }
 
+// Reference encoder for the conversion tests: builds the same text in UTF-8
+// and UTF-16 one code point at a time.
+class TextPair {
+public:
+    enum { MAX_UNITS = 4096 };
+
+    TextPair() : u8len(0), u16len(0) { }
+
+    void append(char32_t cp) {
+        if (cp < 0x80) {
+            u8[u8len++] = cp;
+        } else if (cp < 0x800) {
+            u8[u8len++] = 0xC0 | (cp >> 6);
+            u8[u8len++] = 0x80 | (cp & 0x3F);
+        } else if (cp < 0x10000) {
+            u8[u8len++] = 0xE0 | (cp >> 12);
+            u8[u8len++] = 0x80 | ((cp >> 6) & 0x3F);
+            u8[u8len++] = 0x80 | (cp & 0x3F);
+        } else {
+            u8[u8len++] = 0xF0 | (cp >> 18);
+            u8[u8len++] = 0x80 | ((cp >> 12) & 0x3F);
+            u8[u8len++] = 0x80 | ((cp >> 6) & 0x3F);
+            u8[u8len++] = 0x80 | (cp & 0x3F);
+        }
+        if (cp < 0x10000) {
+            u16[u16len++] = cp;
+        } else {
+            u16[u16len++] = 0xD800 + ((cp - 0x10000) >> 10);
+            u16[u16len++] = 0xDC00 + ((cp - 0x10000) & 0x3FF);
+        }
+    }
+
+    void appendAscii(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            append('a' + i % 26);
+        }
+    }
+
+    uint8_t u8[MAX_UNITS];
+    size_t u8len;
+    char16_t u16[MAX_UNITS];
+    size_t u16len;
+};
+
+// Runs all four conversions on the text and compares them with the encoder.
+static testing::AssertionResult convertsCorrectly(const TextPair& text) {
+    char16_t out16[TextPair::MAX_UNITS + 1];
+    char out8[TextPair::MAX_UNITS + 1];
+
+    ssize_t len = utf8_to_utf16_length(text.u8, text.u8len);
+    if (len != ssize_t(text.u16len)) {
+        return testing::AssertionFailure() << "utf8_to_utf16_length() returned " << len
+                << " instead of " << text.u16len;
+    }
+    utf8_to_utf16(text.u8, text.u8len, out16);
+    if (memcmp(out16, text.u16, text.u16len * sizeof(char16_t)) != 0
+            || out16[text.u16len] != 0) {
+        return testing::AssertionFailure() << "utf8_to_utf16() output differs, "
+                << text.u16len << " units";
+    }
+    if (text.u16len == 0) {
+        return testing::AssertionSuccess();
+    }
+
+    len = utf16_to_utf8_length(text.u16, text.u16len);
+    if (len != ssize_t(text.u8len)) {
+        return testing::AssertionFailure() << "utf16_to_utf8_length() returned " << len
+                << " instead of " << text.u8len;
+    }
+    utf16_to_utf8(text.u16, text.u16len, out8);
+    if (memcmp(out8, text.u8, text.u8len) != 0 || out8[text.u8len] != 0) {
+        return testing::AssertionFailure() << "utf16_to_utf8() output differs, "
+                << text.u8len << " bytes";
+    }
+    return testing::AssertionSuccess();
+}
+
+TEST_F(UnicodeTest, ConvertsEveryAsciiValue) {
+    TextPair text;
+    for (int round = 0; round < 3; round++) {
+        for (char32_t cp = 0; cp < 0x80; cp++) {
+            text.append(cp);
+        }
+    }
+    EXPECT_TRUE(convertsCorrectly(text));
+}
+
+TEST_F(UnicodeTest, ConvertsEveryCodePointAtShiftingOffsets) {
+    for (char32_t cp = 0x80; cp <= 0x10FFFF; cp++) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+            continue;
+        }
+        // Put 0 to 34 ASCII units in front of the code point, so that it lands
+        // at every offset of the first two 16-unit ASCII blocks and past them.
+        TextPair text;
+        text.appendAscii(cp % 35);
+        text.append(cp);
+        text.appendAscii(20);
+        ASSERT_TRUE(convertsCorrectly(text)) << "code point " << cp;
+    }
+}
+
+TEST_F(UnicodeTest, ConvertsAsciiRunsOfEveryLengthAndBreak) {
+    const char32_t breaks[] = {
+        0x7F, 0x80, 0xE9, 0x7FF, 0x800, 0x4E2D, 0xFFFF, 0x10000, 0x1F600, 0x10FFFF,
+    };
+    for (size_t length = 0; length <= 70; length++) {
+        TextPair plain;
+        plain.appendAscii(length);
+        ASSERT_TRUE(convertsCorrectly(plain)) << length << " ASCII characters";
+
+        for (size_t pos = 0; pos <= length; pos++) {
+            for (size_t b = 0; b < sizeof(breaks) / sizeof(breaks[0]); b++) {
+                TextPair text;
+                text.appendAscii(pos);
+                text.append(breaks[b]);
+                text.appendAscii(length - pos);
+                text.append(breaks[b]);
+                ASSERT_TRUE(convertsCorrectly(text)) << "code point " << breaks[b]
+                        << " after " << pos << " of " << length << " ASCII characters";
+            }
+        }
+    }
+}
+
+TEST_F(UnicodeTest, Benchmark_ConversionThroughput) {
+    static const struct {
+        const char* name;
+        char32_t other;  // every 8th character, or 0 for plain ASCII
+        bool onlyOther;
+    } kTexts[] = {
+        { "ascii", 0, false },
+        { "latin", 0xE9, false },
+        { "cjk", 0x4E2D, true },
+    };
+    const int rounds = 2000;
+
+    for (size_t t = 0; t < sizeof(kTexts) / sizeof(kTexts[0]); t++) {
+        TextPair* text = new TextPair();
+        for (size_t i = 0; text->u8len + 4 <= TextPair::MAX_UNITS; i++) {
+            if (kTexts[t].other && (kTexts[t].onlyOther || i % 8 == 7)) {
+                text->append(kTexts[t].other);
+            } else {
+                text->append('a' + i % 26);
+            }
+        }
+        char16_t* out16 = new char16_t[text->u16len + 1];
+        char* out8 = new char[text->u8len + 1];
+        size_t check = 0;
+
+        nsecs_t times[4];
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int r = 0; r < rounds; r++) {
+            check += utf8_to_utf16_length(text->u8, text->u8len);
+        }
+        times[0] = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int r = 0; r < rounds; r++) {
+            utf8_to_utf16(text->u8, text->u8len, out16);
+            check += out16[r % text->u16len];
+        }
+        times[1] = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int r = 0; r < rounds; r++) {
+            check += utf16_to_utf8_length(text->u16, text->u16len);
+        }
+        times[2] = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int r = 0; r < rounds; r++) {
+            utf16_to_utf8(text->u16, text->u16len, out8);
+            check += out8[r % text->u8len];
+        }
+        times[3] = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        EXPECT_LT(0U, check);
+
+        // Throughput in UTF-8 bytes per microsecond, i.e. MB/s.
+        const double bytes = double(text->u8len) * rounds * 1000.0;
+        printf("%-5s utf8_to_utf16_length %6.0f MB/s, utf8_to_utf16 %6.0f MB/s, "
+                "utf16_to_utf8_length %6.0f MB/s, utf16_to_utf8 %6.0f MB/s\n",
+                kTexts[t].name, bytes / times[0], bytes / times[1],
+                bytes / times[2], bytes / times[3]);
+
+        delete[] out8;
+        delete[] out16;
+        delete text;
+    }
+}
+
 }
@@ -16,9 +16,13 @@
 
 #define LOG_TAG "Vector_test"
 
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 #include <cutils/log.h>
 #include <gtest/gtest.h>
+#include <stdio.h>
 #include <unistd.h>
 
 namespace android {
@@ -71,5 +75,117 @@ TEST_F(VectorTest, CopyOnWrite_CopyAndAddElements) {
     EXPECT_EQ(other[3], 5);
 }
 
+class Counted : public RefBase {
+public:
+    explicit Counted(int value) : value(value) { }
+    int value;
+};
+
+// Growing and shrinking move the items to a new buffer when the vector is
+// the only user of its buffer, and copy them when it is not.
+TEST_F(VectorTest, ReallocationKeepsReferences) {
+    const int kCount = 100;
+    Vector<sp<Counted> > vector;
+    for (int i = 0; i < kCount; i++) {
+        vector.insertAt(new Counted(i), i / 2);
+    }
+    // the copy shares the buffer until one of them is modified
+    Vector<sp<Counted> > shared = vector;
+    for (int i = 0; i < kCount; i++) {
+        EXPECT_EQ(1, vector[i]->getStrongCount());
+    }
+
+    vector.insertAt(new Counted(kCount), kCount / 2);
+    for (int i = 0; i <= kCount; i++) {
+        EXPECT_EQ(i == kCount / 2 ? 1 : 2, vector[i]->getStrongCount());
+    }
+    shared.clear();
+
+    vector.removeItemsAt(1, kCount - 1);
+    ASSERT_EQ(2U, vector.size());
+    EXPECT_EQ(1, vector[0]->getStrongCount());
+    EXPECT_EQ(1, vector[1]->getStrongCount());
+    EXPECT_EQ(1, vector[0]->value);
+    EXPECT_EQ(0, vector[1]->value);
+}
+
+TEST_F(VectorTest, ReallocationMovesTriviallyMovableItems) {
+    const int kCount = 100;
+    Vector<String8> vector;
+    for (int i = 0; i < kCount; i++) {
+        vector.insertAt(String8::format("%d", i), 0);
+    }
+    Vector<String8> shared = vector;
+    vector.insertAt(String8("middle"), kCount / 2);
+    vector.removeItemsAt(0, kCount / 2);
+    vector.removeItemsAt(1, kCount / 2 - 1);
+
+    ASSERT_EQ(2U, vector.size());
+    EXPECT_STREQ("middle", vector[0].string());
+    EXPECT_STREQ("0", vector[1].string());
+    ASSERT_EQ(size_t(kCount), shared.size());
+    for (int i = 0; i < kCount; i++) {
+        EXPECT_EQ(String8::format("%d", kCount - 1 - i), shared[i]);
+    }
+}
+
+TEST_F(VectorTest, GrowthPolicy) {
+    Vector<int> vector;
+    vector.setGrowthPolicy(VectorImpl::GROW_BY_DOUBLING | VectorImpl::KEEP_CAPACITY);
+    for (int i = 0; i < 5; i++) {
+        vector.add(i);
+    }
+    EXPECT_EQ(10U, vector.capacity());
+
+    vector.clear();
+    EXPECT_EQ(10U, vector.capacity());
+
+    vector.setGrowthPolicy(VectorImpl::GROW_BY_HALF);
+    for (int i = 0; i < 11; i++) {
+        vector.add(i);
+    }
+    EXPECT_EQ(17U, vector.capacity());
+    vector.clear();
+    EXPECT_EQ(4U, vector.capacity());
+}
+
+// Nanoseconds per operation for building a vector of 'count' items by
+// appending or inserting at the front, then removing them from the front.
+template<typename T>
+static void benchmarkVector(const char* name, const T& item, size_t count) {
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    Vector<T> vector;
+    for (size_t i = 0; i < count; i++) {
+        vector.push(item);
+    }
+    nsecs_t push = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    Vector<T> front;
+    for (size_t i = 0; i < count; i++) {
+        front.insertAt(item, 0);
+    }
+    nsecs_t insert = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    while (!front.isEmpty()) {
+        front.removeAt(0);
+    }
+    nsecs_t remove = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    printf("%s x %d: push %lld ns, insert at front %lld ns, remove from front %lld ns\n",
+            name, int(count), push / count, insert / count, remove / count);
+}
+
+TEST_F(VectorTest, Benchmark_PushInsertRemove) {
+    sp<Counted> strong = new Counted(0);
+    String8 string("a string that is long enough to be on the heap");
+    const size_t counts[] = { 100, 1000, 10000 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        benchmarkVector("sp<>", strong, counts[i]);
+        benchmarkVector("String8", string, counts[i]);
+    }
+}
+
 
 } // namespace android
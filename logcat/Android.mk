@@ -5,7 +5,9 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= logcat.cpp event.logtags
 
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_C_INCLUDES := external/zlib
+
+LOCAL_SHARED_LIBRARIES := liblog libz
 
 LOCAL_MODULE:= logcat
 
@@ -24,6 +26,8 @@ LOCAL_MODULE_PATH := $(TARGET_RECOVERY_ROOT_OUT)/sbin
 
 LOCAL_SRC_FILES:= logcat.cpp event.logtags
 
-LOCAL_STATIC_LIBRARIES := liblog libc libstdc++
+LOCAL_C_INCLUDES := external/zlib
+
+LOCAL_STATIC_LIBRARIES := liblog libz libc libstdc++
 
 include $(BUILD_EXECUTABLE)
@@ -16,6 +16,8 @@
 #include <errno.h>
 #include <assert.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <zlib.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <arpa/inet.h>
@@ -23,6 +25,13 @@
 #define DEFAULT_LOG_ROTATE_SIZE_KBYTES 16
 #define DEFAULT_MAX_ROTATED_LOGS 4
 
+/* formatted lines are coalesced into this buffer and written in one go */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+/* flush once this much is pending, so a line never has to be split */
+#define OUTPUT_FLUSH_THRESHOLD (OUTPUT_BUFFER_SIZE - LOGGER_ENTRY_MAX_LEN * 4)
+/* and never hold output back for longer than this while logs keep coming */
+#define OUTPUT_FLUSH_INTERVAL_MS 250
+
 static AndroidLogFormat * g_logformat;
 static bool g_nonblock = false;
 static int g_tail_lines = 0;
@@ -92,11 +101,16 @@ namespace android {
 static const char * g_outputFileName = NULL;
 static int g_logRotateSizeKBytes = 0;                   // 0 means "no log rotation"
 static int g_maxRotatedLogs = DEFAULT_MAX_ROTATED_LOGS; // 0 means "unbounded"
+static bool g_compressRotatedLogs = false;
 static int g_outFD = -1;
 static off_t g_outByteCount = 0;
 static int g_printBinary = 0;
 static int g_devCount = 0;
 
+static char g_outBuffer[OUTPUT_BUFFER_SIZE];
+static size_t g_outBufferLen = 0;
+static int64_t g_lastFlushMs = 0;
+
 static EventTagMap* g_eventTagMap = NULL;
 
 static int openLogFile (const char *pathname)
@@ -104,6 +118,149 @@ static int openLogFile (const char *pathname)
     return open(pathname, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
 }
 
+static int64_t uptimeMillis()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void writeOutput(const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t ret = write(g_outFD, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("output error");
+            exit(-1);
+        }
+        buf += ret;
+        len -= ret;
+    }
+}
+
+static void flushOutput()
+{
+    if (g_outBufferLen > 0) {
+        writeOutput(g_outBuffer, g_outBufferLen);
+        g_outBufferLen = 0;
+    }
+    g_lastFlushMs = uptimeMillis();
+}
+
+static void maybeFlushOutput()
+{
+    if (g_outBufferLen >= OUTPUT_FLUSH_THRESHOLD
+            || uptimeMillis() - g_lastFlushMs >= OUTPUT_FLUSH_INTERVAL_MS) {
+        flushOutput();
+    }
+}
+
+static void bufferOutput(const char *buf, size_t len)
+{
+    if (g_outBufferLen + len > sizeof(g_outBuffer)) {
+        flushOutput();
+    }
+    if (len > sizeof(g_outBuffer)) {
+        writeOutput(buf, len);
+        return;
+    }
+    memcpy(g_outBuffer + g_outBufferLen, buf, len);
+    g_outBufferLen += len;
+}
+
+/*
+ * With -z, the file just rotated out to <name>.1 is gzip'ed to <name>.1.gz
+ * on a background thread, so the reader never stalls on the compressor.
+ * Only one segment is compressed at a time; rotateLogs() waits for the
+ * previous one before renaming the chain.
+ */
+static pthread_t g_compressThread;
+static bool g_compressPending = false;
+
+static void* compressLogFile(void* arg)
+{
+    char *src = (char *) arg;
+    char *dst, *tmp;
+    char buf[64 * 1024];
+    bool ok = true;
+    int fd;
+    gzFile gz;
+
+    asprintf(&dst, "%s.gz", src);
+    asprintf(&tmp, "%s.gz.tmp", src);
+
+    fd = open(src, O_RDONLY);
+    if (fd < 0) {
+        perror("couldn't open rotated log");
+        goto done;
+    }
+
+    gz = gzopen(tmp, "wb1");
+    if (gz == NULL) {
+        perror("couldn't create compressed log");
+        close(fd);
+        goto done;
+    }
+
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = (n == 0);
+            break;
+        }
+        if (gzwrite(gz, buf, n) != n) {
+            ok = false;
+            break;
+        }
+    }
+    close(fd);
+
+    if (gzclose(gz) != Z_OK) {
+        ok = false;
+    }
+
+    // Only replace the plain segment once its compressed copy is complete,
+    // so a reader always finds one or the other.
+    if (ok && rename(tmp, dst) == 0) {
+        unlink(src);
+    } else {
+        fprintf(stderr, "couldn't compress rotated log %s\n", src);
+        unlink(tmp);
+    }
+
+done:
+    free(tmp);
+    free(dst);
+    free(src);
+    return NULL;
+}
+
+static void waitForCompression()
+{
+    if (g_compressPending) {
+        pthread_join(g_compressThread, NULL);
+        g_compressPending = false;
+    }
+}
+
+static void startCompression(const char *pathname)
+{
+    char *arg = strdup(pathname);
+
+    if (pthread_create(&g_compressThread, NULL, compressLogFile, arg) != 0) {
+        // fall back to doing it inline rather than leaving it uncompressed
+        compressLogFile(arg);
+        return;
+    }
+    g_compressPending = true;
+}
+
 static void rotateLogs()
 {
     int err;
@@ -113,17 +270,25 @@ static void rotateLogs()
         return;
     }
 
+    // Everything accounted to the current file must land in it
+    flushOutput();
+
     close(g_outFD);
 
+    waitForCompression();
+
+    const char *suffix = g_compressRotatedLogs ? ".gz" : "";
+
     for (int i = g_maxRotatedLogs ; i > 0 ; i--) {
         char *file0, *file1;
 
-        asprintf(&file1, "%s.%d", g_outputFileName, i);
-
         if (i - 1 == 0) {
+            // the live file is always plain text; it's compressed below
+            asprintf(&file1, "%s.%d", g_outputFileName, i);
             asprintf(&file0, "%s", g_outputFileName);
         } else {
-            asprintf(&file0, "%s.%d", g_outputFileName, i - 1);
+            asprintf(&file1, "%s.%d%s", g_outputFileName, i, suffix);
+            asprintf(&file0, "%s.%d%s", g_outputFileName, i - 1, suffix);
         }
 
         err = rename (file0, file1);
@@ -136,6 +301,14 @@ static void rotateLogs()
         free(file0);
     }
 
+    if (g_compressRotatedLogs && g_maxRotatedLogs > 0) {
+        char *file1;
+
+        asprintf(&file1, "%s.1", g_outputFileName);
+        startCompression(file1);
+        free(file1);
+    }
+
     g_outFD = openLogFile (g_outputFileName);
 
     if (g_outFD < 0) {
@@ -150,16 +323,42 @@ static void rotateLogs()
 void printBinary(struct logger_entry *buf)
 {
     size_t size = sizeof(logger_entry) + buf->len;
-    int ret;
-    
-    do {
-        ret = write(g_outFD, buf, size);
-    } while (ret < 0 && errno == EINTR);
+
+    bufferOutput((const char *) buf, size);
+    maybeFlushOutput();
+}
+
+/*
+ * Formats the entry straight into the free tail of the output buffer, so
+ * the common case costs neither a copy nor a write.  Returns the number
+ * of bytes queued for output.
+ */
+static size_t bufferLogLine(const AndroidLogEntry *entry)
+{
+    char *tail = g_outBuffer + g_outBufferLen;
+    size_t totalLen;
+    char *line;
+
+    line = android_log_formatLogLine(g_logformat, tail,
+            sizeof(g_outBuffer) - g_outBufferLen, entry, &totalLen);
+    if (line == NULL) {
+        perror("output error");
+        exit(-1);
+    }
+
+    if (line == tail) {
+        g_outBufferLen += totalLen;
+    } else {
+        // didn't fit in what was left; it was malloc'ed instead
+        bufferOutput(line, totalLen);
+        free(line);
+    }
+    return totalLen;
 }
 
 static void processBuffer(log_device_t* dev, struct logger_entry *buf)
 {
-    int bytesWritten = 0;
+    size_t bytesWritten = 0;
     int err;
     AndroidLogEntry entry;
     char binaryMsgBuf[1024];
@@ -180,19 +379,10 @@ static void processBuffer(log_device_t* dev, struct logger_entry *buf)
         if (false && g_devCount > 1) {
             binaryMsgBuf[0] = dev->label;
             binaryMsgBuf[1] = ' ';
-            bytesWritten = write(g_outFD, binaryMsgBuf, 2);
-            if (bytesWritten < 0) {
-                perror("output error");
-                exit(-1);
-            }
+            bufferOutput(binaryMsgBuf, 2);
         }
 
-        bytesWritten = android_log_printLogLine(g_logformat, g_outFD, &entry);
-
-        if (bytesWritten < 0) {
-            perror("output error");
-            exit(-1);
-        }
+        bytesWritten = bufferLogLine(&entry);
     }
 
     g_outByteCount += bytesWritten;
@@ -201,6 +391,8 @@ static void processBuffer(log_device_t* dev, struct logger_entry *buf)
         && (g_outByteCount / 1024) >= g_logRotateSizeKBytes
     ) {
         rotateLogs();
+    } else {
+        maybeFlushOutput();
     }
 
 error:
@@ -222,10 +414,7 @@ static void maybePrintStart(log_device_t* dev) {
         if (g_devCount > 1 && !g_printBinary) {
             char buf[1024];
             snprintf(buf, sizeof(buf), "--------- beginning of %s\n", dev->device);
-            if (write(g_outFD, buf, strlen(buf)) < 0) {
-                perror("output error");
-                exit(-1);
-            }
+            bufferOutput(buf, strlen(buf));
         }
     }
 }
@@ -326,6 +515,9 @@ static void readLogLines(log_device_t* devices)
                     --queued_lines;
                 }
 
+                // don't sit on buffered output while we block for more
+                flushOutput();
+
                 // the caller requested to just dump the log and exit
                 if (g_nonblock) {
                     return;
@@ -401,6 +593,7 @@ static void show_help(const char *cmd)
                     "  -f <filename>   Log to file. Default to stdout\n"
                     "  -r [<kbytes>]   Rotate log every kbytes. (16 if unspecified). Requires -f\n"
                     "  -n <count>      Sets max number of rotated logs to <count>, default 4\n"
+                    "  -z              gzip rotated logs in the background. Requires -r\n"
                     "  -v <format>     Sets the log print format, where <format> is one of:\n\n"
                     "                  brief process tag thread raw time threadtime long\n\n"
                     "  -c              clear (flush) the entire log and exit\n"
@@ -481,7 +674,7 @@ int main(int argc, char **argv)
     for (;;) {
         int ret;
 
-        ret = getopt(argc, argv, "cdt:gsQf:r::n:v:b:B");
+        ret = getopt(argc, argv, "cdt:gsQf:r::n:zv:b:B");
 
         if (ret < 0) {
             break;
@@ -572,6 +765,10 @@ int main(int argc, char **argv)
                 android::g_maxRotatedLogs = atoi(optarg);
             break;
 
+            case 'z':
+                android::g_compressRotatedLogs = true;
+            break;
+
             case 'v':
                 err = setLogFormat (optarg);
                 if (err < 0) {
@@ -679,6 +876,14 @@ int main(int argc, char **argv)
         exit(-1);
     }
 
+    if (android::g_compressRotatedLogs
+        && android::g_logRotateSizeKBytes == 0
+    ) {
+        fprintf(stderr,"-z requires -r as well\n");
+        android::show_help(argv[0]);
+        exit(-1);
+    }
+
     android::setupOutput();
 
     if (hasSetLogFormat == 0) {
@@ -785,5 +990,7 @@ int main(int argc, char **argv)
 
     android::readLogLines(devices);
 
+    android::waitForCompression();
+
     return 0;
 }